@@ -0,0 +1,75 @@
+/**
+ * Recall and latency of the approximate closest() queries, compared with the exact search.
+ *
+ * usage: ann-recall MODEL [QUERIES] [N] [LISTS]
+ *
+ * The index saved with MODEL is used if there is one, otherwise it is built with LISTS lists.
+ * QUERIES words, spread over the vocabulary, are searched one at a time (N closest words), with
+ * the exact search and with an increasing number of probes.
+ */
+#include "../multivec/monolingual.hpp"
+#include <set>
+
+static double elapsed(high_resolution_clock::time_point start) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " MODEL [QUERIES] [N] [LISTS]" << std::endl;
+        return 1;
+    }
+    string model_file(argv[1]);
+    int n_queries = argc > 2 ? atoi(argv[2]) : 1000;
+    int n = argc > 3 ? atoi(argv[3]) : 10;
+    int lists = argc > 4 ? atoi(argv[4]) : 0;
+
+    Config config;
+    MonolingualModel model(&config);
+    model.load(model_file, true); // inference mode: the exact search doesn't normalize the weights at each query
+    config.threads = 1; // latency of a single query
+
+    if (!model.hasIndex()) {
+        auto start = high_resolution_clock::now();
+        model.buildIndex(lists);
+        std::cout << "index built in " << elapsed(start) << " s" << std::endl;
+    }
+
+    auto words = model.getWords();
+    vector<string> queries;
+    for (int i = 0; i < n_queries && !words.empty(); ++i) {
+        queries.push_back(words[static_cast<size_t>(i) * words.size() / n_queries].first);
+    }
+
+    vector<set<string>> exact;
+    auto start = high_resolution_clock::now();
+    for (auto it = queries.begin(); it != queries.end(); ++it) {
+        set<string> neighbors;
+        auto res = model.closest(*it, n);
+        for (auto jt = res.begin(); jt != res.end(); ++jt) neighbors.insert(jt->first);
+        exact.push_back(neighbors);
+    }
+    double exact_time = elapsed(start);
+
+    std::cout << std::setw(8) << "probes" << std::setw(12) << "recall@" + std::to_string(n)
+              << std::setw(14) << "ms/query" << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::setw(8) << "exact" << std::setw(12) << 1.0
+              << std::setw(14) << 1000 * exact_time / queries.size() << std::setw(10) << 1.0 << std::endl;
+
+    for (int probes = 1; ; probes *= 2) {
+        long long found = 0, total = 0;
+        start = high_resolution_clock::now();
+        for (size_t q = 0; q < queries.size(); ++q) {
+            auto res = model.closest(queries[q], n, 0, probes);
+            for (auto it = res.begin(); it != res.end(); ++it) found += exact[q].count(it->first);
+            total += exact[q].size();
+        }
+        double time = elapsed(start);
+
+        std::cout << std::setw(8) << probes << std::setw(12) << (total == 0 ? 1.0 : static_cast<double>(found) / total)
+                  << std::setw(14) << 1000 * time / queries.size() << std::setw(10) << exact_time / time << std::endl;
+        if (found == total || probes >= static_cast<int>(words.size())) break;
+    }
+
+    return 0;
+}
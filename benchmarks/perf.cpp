@@ -0,0 +1,264 @@
+/**
+ * Reproducible performance benchmarks of training and queries, with JSON output to track them between versions.
+ *
+ * usage: perf [OUTPUT] [WORDS] [THREADS] [WORD2VEC]
+ *
+ * A synthetic corpus of WORDS words (default: 2M) is generated with a fixed seed (Zipf distribution over 10,000
+ * words, lines of 5 to 30 words), next to OUTPUT (default: perf.json). The microbenchmarks measure the SIMD
+ * kernels (dot, axpy), the training updates (negSamplingUpdate, hierarchicalUpdate), the tokenization of the
+ * sentences (getIndices, time per word), exact closest() queries, and model save and load. Each one is the
+ * median of 5 runs.
+ *
+ * Then CBOW and skip-gram models are trained on the corpus (1 epoch, default options) with 1, 2, 4... threads
+ * up to THREADS (default: all the hardware threads), and the words/sec and words/sec/thread are reported. If
+ * WORD2VEC is given (e.g. bin/word2vec), the original word2vec is trained with the same options and threads.
+ * Training times are wall-clock times, including the vocabulary.
+ *
+ * The results are printed, and written to OUTPUT.
+ */
+#include "../multivec/monolingual.hpp"
+#include <cstdio>
+
+static double elapsed(high_resolution_clock::time_point start) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+/**
+ * @brief Access to the private training methods measured by the microbenchmarks
+ */
+struct PerfBenchmark {
+    static void negSamplingUpdate(MonolingualModel& model, TrainingContext& ctx, int word, const vec& hidden) {
+        model.negSamplingUpdate(ctx, word, hidden, 1e-4f);
+    }
+    static void hierarchicalUpdate(MonolingualModel& model, TrainingContext& ctx, int word, const vec& hidden) {
+        model.hierarchicalUpdate(ctx, word, hidden, 1e-4f);
+    }
+    static void getIndices(const MonolingualModel& model, const string& sentence, vector<int>& indices) {
+        model.getIndices(sentence, indices);
+    }
+};
+
+/**
+ * @brief Median time in ns of one of the `ops` operations of `run`, over 5 runs (after a warm-up run)
+ */
+template <typename Function>
+static double measure(long long ops, Function run) {
+    run();
+    vector<double> times;
+    for (int i = 0; i < 5; ++i) {
+        auto start = high_resolution_clock::now();
+        run();
+        times.push_back(1e9 * elapsed(start) / ops);
+    }
+    sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/**
+ * @brief Synthetic corpus of `words` words drawn from a Zipf distribution over `vocabulary` words
+ */
+static void generateCorpus(const string& filename, long long words, int vocabulary, unsigned long long seed) {
+    vector<double> cumulative(vocabulary);
+    double total = 0;
+    for (int i = 0; i < vocabulary; ++i) {
+        total += 1.0 / (i + 1);
+        cumulative[i] = total;
+    }
+
+    ofstream outfile(filename);
+    check_is_open(outfile, filename);
+    multivec::Random rand(seed);
+    string line;
+    while (words > 0) {
+        int length = static_cast<int>(min<long long>(5 + rand() % 26, words));
+        line.clear();
+        for (int i = 0; i < length; ++i) {
+            double x = total * ((rand() & 0xFFFFFFFF) / 4294967296.0);
+            size_t word = lower_bound(cumulative.begin(), cumulative.end(), x) - cumulative.begin();
+            line += (i > 0 ? " w" : "w") + std::to_string(min<size_t>(word, vocabulary - 1));
+        }
+        outfile << line << '\n';
+        words -= length;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 5) {
+        std::cerr << "usage: " << argv[0] << " [OUTPUT] [WORDS] [THREADS] [WORD2VEC]" << std::endl;
+        return 1;
+    }
+    string output_file = argc > 1 ? argv[1] : "perf.json";
+    long long corpus_words = argc > 2 ? atoll(argv[2]) : 2000000;
+    int max_threads = argc > 3 ? atoi(argv[3]) : max<int>(thread::hardware_concurrency(), 1);
+    string word2vec = argc > 4 ? argv[4] : "";
+
+    const int vocabulary = 10000;
+    const unsigned long long seed = 1;
+    string corpus_file = output_file + ".corpus.txt";
+    string model_file = output_file + ".model.bin";
+    generateCorpus(corpus_file, corpus_words, vocabulary, seed);
+
+    std::ostringstream log; // training progress, not displayed
+    std::streambuf* cout_buffer = std::cout.rdbuf(log.rdbuf());
+    Config config;
+    config.threads = 1;
+    config.iterations = 1;
+    config.hierarchical_softmax = true; // both output matrices are trained
+    MonolingualModel model(&config);
+    model.train(corpus_file);
+    std::cout.rdbuf(cout_buffer);
+
+    vector<string> micro; // JSON fields of each result, without braces
+    auto addMicro = [&](const string& name, int dimension, double ns) {
+        std::cout << std::setw(24) << std::left << name << std::setw(6) << std::right << dimension
+                  << std::setw(12) << std::setprecision(4) << ns << " ns" << std::endl;
+        std::ostringstream json;
+        json << "\"name\": \"" << name << "\", \"dimension\": " << dimension << ", \"ns_per_op\": " << ns;
+        micro.push_back(json.str());
+    };
+
+    std::cout << "SIMD kernels: " << simd::kernels.name << std::endl;
+    volatile float sink = 0;
+    for (int dimension : {100, 300}) {
+        const int rows = 4096, ops = 1000000;
+        vector<float> x(static_cast<size_t>(rows) * dimension, 0.01f), y(dimension, 0.02f);
+        addMicro("dot", dimension, measure(ops, [&]() {
+            float sum = 0;
+            for (int i = 0; i < ops; ++i)
+                sum += simd::dot(&x[static_cast<size_t>(i % rows) * dimension], y.data(), dimension);
+            sink = sum;
+        }));
+        addMicro("axpy", dimension, measure(ops, [&]() {
+            for (int i = 0; i < ops; ++i)
+                simd::axpy(1e-6f, y.data(), &x[static_cast<size_t>(i % rows) * dimension], dimension);
+        }));
+    }
+
+    vector<string> words = model.getWordsByIndex();
+    int d = config.dimension;
+    TrainingContext ctx(d, seed);
+    vec hidden(d);
+    for (int i = 0; i < d; ++i) hidden[i] = (ctx.rand.randf() - 0.5f) / d;
+    multivec::Random word_rand(seed);
+    vector<int> targets(100000);
+    for (auto it = targets.begin(); it != targets.end(); ++it) {
+        *it = static_cast<int>(word_rand() % words.size());
+    }
+    addMicro("negSamplingUpdate", d, measure(targets.size(), [&]() {
+        for (auto it = targets.begin(); it != targets.end(); ++it)
+            PerfBenchmark::negSamplingUpdate(model, ctx, *it, hidden);
+    }));
+    addMicro("hierarchicalUpdate", d, measure(targets.size(), [&]() {
+        for (auto it = targets.begin(); it != targets.end(); ++it)
+            PerfBenchmark::hierarchicalUpdate(model, ctx, *it, hidden);
+    }));
+
+    vector<string> sentences;
+    {
+        ifstream infile(corpus_file);
+        string line;
+        long long n_words = 0;
+        while (sentences.size() < 10000 && getline(infile, line)) {
+            sentences.push_back(line);
+            n_words += count(line.begin(), line.end(), ' ') + 1;
+        }
+        vector<int> indices;
+        addMicro("getIndices", d, measure(n_words, [&]() { // time per word
+            for (auto it = sentences.begin(); it != sentences.end(); ++it)
+                PerfBenchmark::getIndices(model, *it, indices);
+        }));
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(words[static_cast<size_t>(i) * words.size() / 100]);
+    }
+    addMicro("closest", d, measure(queries.size(), [&]() {
+        for (auto it = queries.begin(); it != queries.end(); ++it) model.closest(*it, 10);
+    }));
+
+    cout_buffer = std::cout.rdbuf(log.rdbuf());
+    double save_ns = measure(1, [&]() { model.save(model_file); });
+    double load_ns = measure(1, [&]() {
+        MonolingualModel loaded(&config);
+        loaded.load(model_file);
+    });
+    std::cout.rdbuf(cout_buffer);
+    addMicro("save", d, save_ns);
+    addMicro("load", d, load_ns);
+    remove(model_file.c_str());
+
+    vector<string> training;
+    vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    std::cout << std::endl << std::setw(10) << std::left << "tool" << std::setw(10) << "model" << std::right
+              << std::setw(8) << "threads" << std::setw(12) << "time (s)" << std::setw(14) << "words/s"
+              << std::setw(16) << "words/s/thread" << std::endl;
+    auto addTraining = [&](const string& tool, bool skip_gram, int threads, double seconds) {
+        double speed = corpus_words / seconds;
+        std::cout << std::setw(10) << std::left << tool << std::setw(10) << (skip_gram ? "skip-gram" : "CBOW")
+                  << std::right << std::setw(8) << threads << std::setw(12) << std::setprecision(4) << seconds
+                  << std::setw(14) << std::setprecision(6) << speed << std::setw(16) << speed / threads << std::endl;
+        std::ostringstream json;
+        json << "\"tool\": \"" << tool << "\", \"model\": \"" << (skip_gram ? "skip-gram" : "cbow")
+             << "\", \"threads\": " << threads << ", \"seconds\": " << seconds << ", \"words_per_sec\": " << speed
+             << ", \"words_per_sec_per_thread\": " << speed / threads;
+        training.push_back(json.str());
+    };
+
+    for (int skip_gram = 0; skip_gram < 2; ++skip_gram) {
+        for (auto it = thread_counts.begin(); it != thread_counts.end(); ++it) {
+            Config train_config;
+            train_config.threads = *it;
+            train_config.iterations = 1;
+            train_config.skip_gram = skip_gram;
+            MonolingualModel train_model(&train_config);
+
+            cout_buffer = std::cout.rdbuf(log.rdbuf());
+            auto start = high_resolution_clock::now();
+            train_model.train(corpus_file);
+            double seconds = elapsed(start);
+            std::cout.rdbuf(cout_buffer);
+            addTraining("multivec", skip_gram, *it, seconds);
+
+            if (word2vec.empty()) continue;
+            string vectors_file = output_file + ".vectors.txt";
+            std::ostringstream command;
+            command << word2vec << " --train " << corpus_file << " --save-vectors " << vectors_file << " --threads "
+                    << *it << " --iter 1 --dimension " << train_config.dimension << " --min-count "
+                    << train_config.min_count << " --window-size " << train_config.window_size << " --negative "
+                    << train_config.negative << " --alpha " << train_config.learning_rate << " --subsampling "
+                    << train_config.subsampling << (skip_gram ? " --sg" : "") << " > /dev/null";
+            start = high_resolution_clock::now();
+            if (system(command.str().c_str()) != 0) {
+                std::cerr << "couldn't run " << word2vec << std::endl;
+                return 1;
+            }
+            seconds = elapsed(start);
+            remove(vectors_file.c_str());
+            addTraining("word2vec", skip_gram, *it, seconds);
+        }
+    }
+    remove(corpus_file.c_str());
+
+    ofstream outfile(output_file);
+    check_is_open(outfile, output_file);
+    outfile << "{" << std::endl;
+    outfile << "  \"simd\": \"" << simd::kernels.name << "\"," << std::endl;
+    outfile << "  \"hardware_threads\": " << thread::hardware_concurrency() << "," << std::endl;
+    outfile << "  \"corpus\": {\"words\": " << corpus_words << ", \"vocabulary\": " << vocabulary
+            << ", \"seed\": " << seed << "}," << std::endl;
+    for (int part = 0; part < 2; ++part) {
+        const vector<string>& results = part == 0 ? micro : training;
+        outfile << "  \"" << (part == 0 ? "micro" : "training") << "\": [" << std::endl;
+        for (size_t i = 0; i < results.size(); ++i) {
+            outfile << "    {" << results[i] << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+        }
+        outfile << "  ]" << (part == 0 ? "," : "") << std::endl;
+    }
+    outfile << "}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * Accuracy and speed of the quantized embeddings (float16 and int8), compared with float32.
+ *
+ * usage: quantization MODEL QUESTIONS [POLICY] [QUERIES] [N]
+ *
+ * MODEL is saved in each precision (next to MODEL, with a .float16 or .int8 extension), and each copy
+ * is loaded in inference mode. For each precision, this reports the file size, the accuracy on the analogy
+ * questions of QUESTIONS (e.g. word2vec/questions-words.txt), the recall of the N closest words of QUERIES
+ * words (spread over the vocabulary) compared with float32, the mean absolute error on the similarities of
+ * these words with their float32 neighbors, and the latency of closest().
+ */
+#include "../multivec/monolingual.hpp"
+#include <set>
+#include <sys/stat.h>
+
+static double elapsed(high_resolution_clock::time_point start) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+static double fileSize(const string& filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " MODEL QUESTIONS [POLICY] [QUERIES] [N]" << std::endl;
+        return 1;
+    }
+    string model_file(argv[1]);
+    string questions_file(argv[2]);
+    int policy = argc > 3 ? atoi(argv[3]) : 0;
+    int n_queries = argc > 4 ? atoi(argv[4]) : 1000;
+    int n = argc > 5 ? atoi(argv[5]) : 10;
+
+    Config config;
+    MonolingualModel reference(&config);
+    reference.load(model_file, true, policy);
+    config.threads = 1; // latency of a single query
+
+    auto words = reference.getWords();
+    vector<string> queries;
+    for (int i = 0; i < n_queries && !words.empty(); ++i) {
+        queries.push_back(words[static_cast<size_t>(i) * words.size() / n_queries].first);
+    }
+
+    vector<vector<pair<string, float>>> exact;
+    for (auto it = queries.begin(); it != queries.end(); ++it) {
+        exact.push_back(reference.closest(*it, n, policy));
+    }
+
+    std::cout << std::setw(10) << "precision" << std::setw(10) << "MB" << std::setw(12) << "analogy %"
+              << std::setw(12) << "recall@" + std::to_string(n) << std::setw(12) << "sim error"
+              << std::setw(12) << "ms/query" << std::endl;
+
+    Precision precisions[] = {Precision::float32, Precision::float16, Precision::int8};
+    for (Precision precision : precisions) {
+        string filename = model_file;
+        if (precision != Precision::float32) {
+            Config save_config;
+            MonolingualModel model(&save_config);
+            model.load(model_file);
+            filename = model_file + "." + precisionName(precision);
+            model.save(filename, precision);
+        }
+
+        Config quantized_config;
+        quantized_config.threads = 1;
+        MonolingualModel model(&quantized_config);
+        model.load(filename, true, policy);
+
+        std::ostringstream report; // per-topic accuracies, not displayed
+        float accuracy = model.analogicalReasoning(questions_file, 0, policy, report);
+
+        long long found = 0, total = 0, pairs = 0;
+        double error = 0;
+        auto start = high_resolution_clock::now();
+        for (size_t q = 0; q < queries.size(); ++q) {
+            auto res = model.closest(queries[q], n, policy);
+            set<string> neighbors;
+            for (auto it = res.begin(); it != res.end(); ++it) neighbors.insert(it->first);
+            for (auto it = exact[q].begin(); it != exact[q].end(); ++it) found += neighbors.count(it->first);
+            total += exact[q].size();
+        }
+        double time = elapsed(start);
+
+        for (size_t q = 0; q < queries.size(); ++q) {
+            for (auto it = exact[q].begin(); it != exact[q].end(); ++it, ++pairs) {
+                error += fabs(model.similarity(queries[q], it->first, policy) - it->second);
+            }
+        }
+
+        std::cout << std::setw(10) << precisionName(precision) << std::setw(10) << std::setprecision(4) << fileSize(filename) / (1 << 20)
+                  << std::setw(12) << accuracy << std::setw(12) << (total == 0 ? 1.0 : static_cast<double>(found) / total)
+                  << std::setw(12) << (pairs == 0 ? 0.0 : error / pairs)
+                  << std::setw(12) << 1000 * time / max<size_t>(1, queries.size()) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * Speed and accuracy of the sigmoid lookup table (sigmoid_table option), compared with the exact sigmoid.
+ *
+ * usage: sigmoid [TRAIN QUESTIONS [THREADS] [ITERATIONS]]
+ *
+ * The microbenchmark evaluates both versions (clipped to 0 or 1 beyond MAX_EXP, like in training) on
+ * random values of [-MAX_EXP, MAX_EXP], and reports their latency and the largest difference between them.
+ * If TRAIN is given, a CBOW and a skip-gram model are trained on TRAIN with each version, and their training
+ * time and accuracy on the analogy questions of QUESTIONS (e.g. word2vec/questions-words.txt) are reported.
+ */
+#include "../multivec/monolingual.hpp"
+
+static double elapsed(high_resolution_clock::time_point start) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    if (argc == 2) {
+        std::cerr << "usage: " << argv[0] << " [TRAIN QUESTIONS [THREADS] [ITERATIONS]]" << std::endl;
+        return 1;
+    }
+
+    const int n = 10000000;
+    vector<float> values(n);
+    multivec::Random rand(1);
+    for (int i = 0; i < n; ++i) {
+        values[i] = (2 * rand.randf() - 1) * MAX_EXP;
+    }
+
+    SigmoidTable table;
+    auto exact = [](float x) -> float { return x >= MAX_EXP ? 1 : x <= -MAX_EXP ? 0 : sigmoid(x); }; // as in training
+    float sum = 0, max_error = 0;
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+        sum += exact(values[i]);
+    }
+    double exact_time = elapsed(start);
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+        sum += table(values[i]);
+    }
+    double table_time = elapsed(start);
+
+    for (int i = 0; i < n; ++i) {
+        max_error = max(max_error, fabs(table(values[i]) - exact(values[i])));
+    }
+
+    std::cout << "exact: " << 1e9 * exact_time / n << " ns, table: " << 1e9 * table_time / n
+              << " ns, max error: " << max_error << " (checksum " << sum << ")" << std::endl;
+
+    if (argc < 3) return 0;
+    string train_file(argv[1]);
+    string questions_file(argv[2]);
+    int threads = argc > 3 ? atoi(argv[3]) : 4;
+    int iterations = argc > 4 ? atoi(argv[4]) : 5;
+
+    std::cout << std::setw(10) << "model" << std::setw(10) << "sigmoid" << std::setw(12) << "time (s)"
+              << std::setw(12) << "analogy %" << std::endl;
+
+    for (int skip_gram = 0; skip_gram < 2; ++skip_gram) {
+        for (int use_table = 0; use_table < 2; ++use_table) {
+            Config config;
+            config.threads = threads;
+            config.iterations = iterations;
+            config.skip_gram = skip_gram;
+            config.sigmoid_table = use_table;
+            MonolingualModel model(&config);
+
+            std::ostringstream log; // training progress and per-topic accuracies, not displayed
+            std::streambuf* cout_buffer = std::cout.rdbuf(log.rdbuf());
+            start = high_resolution_clock::now();
+            model.train(train_file);
+            double time = elapsed(start);
+            std::cout.rdbuf(cout_buffer);
+
+            float accuracy = model.analogicalReasoning(questions_file, 0, 0, log);
+            std::cout << std::setw(10) << (skip_gram ? "skip-gram" : "CBOW") << std::setw(10)
+                      << (use_table ? "table" : "exact") << std::setw(12) << std::setprecision(4) << time
+                      << std::setw(12) << accuracy << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -1,7 +1,10 @@
+import json
 import numpy as np
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.pair cimport pair
+from libc.string cimport memcpy
+from cpython.buffer cimport PyBUF_WRITABLE
 
 
 cdef extern from "vec.hpp":
@@ -11,6 +14,13 @@ cdef extern from "vec.hpp":
         const float* data()
         int size()
 
+    cdef cppclass Mat:
+        Mat()
+        const float* data()
+        size_t rows()
+        size_t cols()
+        size_t stride()
+
 
 cdef extern from "utils.hpp":
     cdef cppclass Config:
@@ -27,10 +37,38 @@ cdef extern from "utils.hpp":
         int skip_gram
         int negative
         int sent_vector
+        long long unigram_table_size
+        int seed
+        long long max_vocab_size
+        bint shared_negatives
+        bint sigmoid_table
+        string checkpoint
+        long long checkpoint_words
+        bint grow_vocab
+        string sent_vector_file
+        bint doc_ids
+        bint pin_threads
+        bint numa_interleave
+        string metrics_file
+        float metrics_interval
 
     cdef cppclass BilingualConfig(Config):
         BilingualConfig()
         float beta
+        int reader_threads
+        string line_index
+
+
+cdef extern from "quantized.hpp":
+    cdef cppclass Precision:
+        pass
+
+    Precision parsePrecision(const string&) except +
+
+
+cdef extern from "metrics.hpp":
+    cdef cppclass TrainingMetrics:
+        string json()
 
 
 cdef extern from "monolingual.hpp":
@@ -38,32 +76,47 @@ cdef extern from "monolingual.hpp":
         MonolingualModelCpp(Config*) except +
         Vec wordVec(const string&, int) except +
         Vec sentVec(const string&) except +
-        void train(const string&, bool) except +
-        void load(const string&) except +
-        void save(const string&) except +
+        Mat wordVecBatch(const vector[string]&, int) except +
+        Mat sentVecBatch(const vector[string]&) except + nogil
+        const Mat& getEmbeddings(int) except +
+        void train(const string&, bint) except + nogil
+        void resume(const string&, const string&) except + nogil
+        const TrainingMetrics& getMetrics()
+        void load(const string&, bint, int) except +
+        void save(const string&, Precision) except +
         void saveVectors(const string&, int) except +
         void saveVectorsBin(const string&, int) except +
-        void saveSentVectors(const string&) except +
+        void saveSentVectors(const string&, bint) except +
+        void loadVectors(const string&) except +
         float similarity(const string&, const string&, int) except +
         float distance(const string&, const string&, int) except +
+        vector[float] similarityBatch(const vector[string]&, const vector[string]&, int) except +
         float similarityNgrams(const string&, const string&, int) except +
         float similaritySentence(const string&, const string&, int) except +
         float similaritySentenceSyntax(const string&, const string&, const string&, const string&,
                                        const vector[float]&, const vector[float]&, float, int) except +
         float softWER(const string&, const string&, int) except +
-        vector[pair[string, float]] closest(const Vec&, int, int) except +
+        vector[float] softWERBatch(const vector[string]&, const vector[string]&, int) except + nogil
+        vector[pair[string, float]] closest(const Vec&, int, int, int) except +
         vector[pair[string, float]] closest(const string&, const vector[string]&, int) except +
-        vector[pair[string, float]] closest(const string&, int, int) except +
+        vector[pair[string, float]] closest(const string&, int, int, int) except +
+        vector[vector[pair[string, float]]] closestBatch(const vector[string]&, int, int, int) except + nogil
+        void buildIndex(int, int) except +
+        float analogicalReasoning(const string&, int, int) except +
+        bint hasIndex()
         vector[pair[string, int]] getWords() except +
+        vector[string] getWordsByIndex() except +
         Config* config
 
 
 cdef extern from "bilingual.hpp":
     cdef cppclass BilingualModelCpp "BilingualModel":
         BilingualModelCpp(BilingualConfig*) except +
-        void train(const string&, const string&, bool) except +
-        void load(const string&) except +
-        void save(const string&) except +
+        void train(const string&, const string&, bint) except + nogil
+        void resume(const string&, const string&, const string&) except + nogil
+        const TrainingMetrics& getMetrics()
+        void load(const string&, bint, int) except +
+        void save(const string&, Precision) except +
         float similarity(const string&, const string&, int) except +
         float distance(const string&, const string&, int) except +
         float similarityNgrams(const string&, const string&, int) except +
@@ -77,14 +130,55 @@ cdef extern from "bilingual.hpp":
         BilingualConfig* config
 
 
+cdef mat_to_array(const Mat& m):
+    # copy of a matrix into a new (rows, cols) float32 array (the rows of a Mat may be padded)
+    cdef size_t i
+    arr = np.empty((m.rows(), m.cols()), dtype=np.float32)
+    cdef float[:, ::1] view = arr
+    for i in range(m.rows()):
+        memcpy(&view[i, 0], m.data() + i * m.stride(), m.cols() * sizeof(float))
+    return arr
+
+
+cdef class EmbeddingBuffer:
+    """
+    Read-only buffer over the embeddings of a model, without copy (see `MonolingualModel.get_embeddings`).
+    It keeps a reference to the model, but becomes invalid if the model is trained or loaded again.
+    """
+    cdef object owner
+    cdef const float* data
+    cdef Py_ssize_t shape[2]
+    cdef Py_ssize_t strides[2]
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError('the embeddings are read-only')
+        buffer.buf = <void*> self.data
+        buffer.obj = self
+        buffer.len = self.shape[0] * self.strides[0]
+        buffer.readonly = 1
+        buffer.itemsize = sizeof(float)
+        buffer.format = 'f'
+        buffer.ndim = 2
+        buffer.shape = self.shape
+        buffer.strides = self.strides
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+
 cdef class MonolingualModel:
     """
-    MonolingualModel(name=None, **kwargs)
+    MonolingualModel(name=None, inference=False, policy=0, **kwargs)
     
     Parameters
     ----------
     name : path to an existing model. This model and its parameters
         (including vocabulary and configuration) will be loaded.
+    inference : only keep the embeddings used by `policy`, for querying (see `MonolingualModel.load`)
+    policy : embedding policy of the inference mode (see `MonolingualModel.word_vec`)
     kwargs : overwrite configuration of the model (see attributes)
     
     Attributes
@@ -103,6 +197,30 @@ cdef class MonolingualModel:
         0 to disable negative sampling) (default: 5)
     sent_vector : include sentence vectors in training. This is an implementation of
         batch paragraph vector (default: False)
+    unigram_table_size : size of the table used to draw negative samples, or 0 to
+        use the alias method, which needs much less memory (default: 0)
+    seed : random seed; training is deterministic for a given seed with a single thread (default: 1)
+    max_vocab_size : when counting words, rare words are pruned whenever the vocabulary gets larger
+        than this, to bound memory usage (default: 0, no limit)
+    shared_negatives : in skip-gram, draw one set of negative samples per window, and update the whole
+        window at once, which scales better with many threads (default: False)
+    sigmoid_table : during training, read the sigmoid from a precomputed table instead of
+        computing an exponential, like word2vec (default: False)
+    checkpoint : path where the model and its training state are saved during training, to
+        resume it if it is interrupted (see `resume`) (default: '', no checkpoints)
+    checkpoint_words : number of words trained between two checkpoints (default: 0, one per epoch)
+    grow_vocab : when training an existing model (initialize=False), add the new words of the training
+        file(s) to the vocabulary, and keep the embeddings of the existing words (default: False)
+    pin_threads : pin the training threads to CPUs spread over the NUMA nodes, and give each node
+        its own copy of the negative sampler and Huffman codes (default: False)
+    numa_interleave : interleave the pages of the weight matrices over the NUMA nodes (default: False)
+    metrics_file : during training, append the metrics (see `metrics`) to this file as JSON lines
+        (default: '', none)
+    metrics_interval : seconds between two lines of `metrics_file` (default: 10)
+    sent_vector_file : train the sentence vectors in this memory-mapped file instead of in memory, for
+        corpora whose sentence vectors don't fit in memory (default: '', in memory)
+    doc_ids : the first token of each line is a document ID, and the lines with the same ID share
+        a sentence vector (default: False)
     
     Examples
     --------
@@ -131,9 +249,9 @@ cdef class MonolingualModel:
         self.alloc = False
         return self
     
-    def __init__(self, name=None, **kwargs):
+    def __init__(self, name=None, inference=False, policy=0, **kwargs):
         if name is not None:
-            self.model.load(name)
+            self.model.load(name, inference, policy)
         
         # overwrites previous configuration
         for key, value in kwargs.items():
@@ -175,6 +293,58 @@ cdef class MonolingualModel:
         cdef float* data = vec.data()
         return np.array([data[i] for i in range(vec.size())])
 
+    def word_vec_batch(self, words, policy=0):
+        """
+        word_vec_batch(words, policy=0)
+
+        Return the vectors of `words` (see `MonolingualModel.word_vec`), as a (len(words), dimension)
+        float32 array. The rows of out-of-vocabulary words are zero.
+        """
+        return mat_to_array(self.model.wordVecBatch(words, policy))
+
+    def sent_vec_batch(self, sequences):
+        """
+        sent_vec_batch(sequences)
+
+        Perform paragraph vector inference on each sequence of `sequences` (see `MonolingualModel.sent_vec`),
+        in parallel (`threads` option). Return a (len(sequences), dimension) float32 array, whose rows are
+        zero for the sequences that are empty or only contain OOV words.
+        The GIL is released during inference.
+        """
+        cdef vector[string] sequences_cpp = sequences
+        cdef Mat res
+        with nogil:
+            res = self.model.sentVecBatch(sequences_cpp)
+        return mat_to_array(res)
+
+    def get_embeddings(self, policy=0):
+        """
+        get_embeddings(policy=0)
+
+        Return a read-only (vocabulary size, dimension) float32 memoryview of the word embeddings, without
+        copy: row i is the vector of word i of `MonolingualModel.get_words_by_index`. Use `np.asarray` to get
+        an array. Only the input weights (policy 0) and the output weights (policy 3) can be viewed.
+
+        The view becomes invalid if the model is trained or loaded again.
+        """
+        cdef const Mat* m = &self.model.getEmbeddings(policy)
+        cdef EmbeddingBuffer buffer = EmbeddingBuffer()
+        buffer.owner = self
+        buffer.data = m.data()
+        buffer.shape[0] = m.rows()
+        buffer.shape[1] = m.cols()
+        buffer.strides[0] = m.stride() * sizeof(float)
+        buffer.strides[1] = sizeof(float)
+        return memoryview(buffer)
+
+    def get_words_by_index(self):
+        """
+        get_words_by_index()
+
+        Return the words of the vocabulary, in the order of the rows of `MonolingualModel.get_embeddings`.
+        """
+        return list(self.model.getWordsByIndex())
+
     def train(self, name, initialize=True):
         """
         train(name, initialize=True)
@@ -186,31 +356,67 @@ cdef class MonolingualModel:
         Initialize will create a new vocabulary from training file, and initialize the model's
         weight to random values.
         Set this value to False to continue training of an existing model (learning rate will
-        be reset to its initial value, i.e. self.learning_rate)
+        be reset to its initial value, i.e. self.learning_rate). Its vocabulary stays the same,
+        unless `grow_vocab` is set.
+        """
+        cdef string filename = name
+        cdef bint init = initialize
+        with nogil:
+            self.model.train(filename, init)
+
+    def resume(self, name, checkpoint):
+        """
+        resume(name, checkpoint)
+
+        Continue the training on file `name` which was interrupted after saving `checkpoint`, where
+        it was interrupted (same learning rate and position in the file). The model must be loaded
+        from `checkpoint` first.
+        """
+        cdef string filename = name
+        cdef string checkpoint_filename = checkpoint
+        with nogil:
+            self.model.resume(filename, checkpoint_filename)
+
+    def metrics(self):
+        """
+        metrics()
+
+        Return the metrics of the current or last training, as a dict: words, words per second, sentences,
+        sentences skipped because no word was left after subsampling, negative sampling and hierarchical
+        softmax updates, seconds spent in each phase (vocab, chunkify, training, save), and the counts of
+        each training thread. It can be called from another Python thread while `train` is running.
         """
-        self.model.train(name, initialize)
+        return json.loads(self.model.getMetrics().json())
         
-    def load(self, name):
+    def load(self, name, inference=False, policy=0):
         """
-        load(name)
+        load(name, inference=False, policy=0)
 
         Load model from disk (path `name`). This model must have been saved with `MonolingualModel.save`.
         This function cannot load files in the word2vec format.
 
         The entire model, including configuration and vocabulary is loaded, and the existing
         parameters are overwritten.
+
+        With `inference=True`, only the word embeddings for the given `policy` are kept (see
+        `MonolingualModel.word_vec`), along with a normalized copy for fast similarity queries.
+        Such a model uses less memory, but can only be queried with this policy, and cannot
+        be trained or saved.
         """
-        self.model.load(name)
+        self.model.load(name, inference, policy)
 
-    def save(self, name):
+    def save(self, name, precision='float32'):
         """
-        save(name)
+        save(name, precision='float32')
 
         Save entire model to disk (path `name`). This saves the entire model, including configuration and 
         vocabulary into a binary format, specific to MultiVec. Those models can then be loaded
         from disk using `MonolingualModel.load`.
+
+        With `precision='float16'` or `'int8'`, the weights are quantized: the file is 2 or 4 times smaller,
+        and once loaded with `inference=True`, similarity queries use the quantized embeddings directly.
         """
-        self.model.save(name)
+        self.model.save(name, parsePrecision(precision))
 
     def save_vectors(self, name, policy=0):
         """
@@ -234,13 +440,37 @@ cdef class MonolingualModel:
         """
         self.model.saveVectorsBin(name, policy)
 
-    def save_sent_vectors(self, name):
-        self.model.saveSentVectors(name)
+    def save_sent_vectors(self, name, binary=False):
+        """
+        save_sent_vectors(name, binary=False)
+
+        Save the sentence vectors of the training file to disk (path `name`), one line per
+        sentence, or in the word2vec format with the document IDs when `doc_ids` is set.
+        """
+        self.model.saveSentVectors(name, binary)
+
+    def load_vectors(self, name):
+        """
+        load_vectors(name)
+
+        Replace the model with the word vectors of file `name`, in the word2vec text or binary format
+        (e.g. written by `MonolingualModel.save_vectors`, or by word2vec). The model can then be queried
+        and saved, but not trained.
+        """
+        self.model.loadVectors(name)
     
     def similarity(self, word1, word2, policy=0):
         return self.model.similarity(word1, word2, policy)
     def distance(self, word1, word2, policy=0):
         return self.model.distance(word1, word2, policy)
+    def similarity_batch(self, words1, words2, policy=0):
+        """
+        similarity_batch(words1, words2, policy=0)
+
+        Cosine similarity of each pair (words1[i], words2[i]), as a float32 array. The similarity
+        is zero when one of the words is out of vocabulary.
+        """
+        return np.array(self.model.similarityBatch(words1, words2, policy), dtype=np.float32)
             
     def similarity_ngrams(self, seq1, seq2, policy=0):
         return self.model.similarityNgrams(seq1, seq2, policy)
@@ -250,14 +480,68 @@ cdef class MonolingualModel:
         return self.model.similaritySentenceSyntax(seq1, seq2, tags1, tags2, idf1, idf2, alpha, policy)
     def soft_word_error_rate(self, seq1, seq2, policy=0):
         return self.model.softWER(seq1, seq2, policy)
+    def soft_word_error_rate_batch(self, hyps, refs, policy=0):
+        """
+        soft_word_error_rate_batch(hyps, refs, policy=0)
+
+        Soft word error rate of each pair (hyps[i], refs[i]), computed in parallel (`threads` option).
+        """
+        cdef vector[string] hyps_cpp = hyps
+        cdef vector[string] refs_cpp = refs
+        cdef int policy_cpp = policy
+        cdef vector[float] res
+        with nogil:
+            res = self.model.softWERBatch(hyps_cpp, refs_cpp, policy_cpp)
+        return list(res)
     
-    def closest(self, word, n=10, policy=0):
-        cdef vector[pair[string, float]] res = self.model.closest(<const string&> word, <int> n, <int> policy)
+    def closest(self, word, n=10, policy=0, probes=0):
+        """
+        closest(word, n=10, policy=0, probes=0)
+
+        Return the `n` closest words to `word`, with their cosine similarity. With `probes` > 0, the search
+        is approximate, and uses the index built by `MonolingualModel.build_index`: only `probes` lists
+        of the index are scanned (more probes give a better recall, but are slower).
+        """
+        cdef vector[pair[string, float]] res = self.model.closest(<const string&> word, <int> n, <int> policy,
+                                                                  <int> probes)
         return list(res)
-    def closest_to_vec(self, vec, n=10, policy=0):
+    def closest_to_vec(self, vec, n=10, policy=0, probes=0):
         cdef Vec vec_cpp = Vec(<vector[float]> vec)
-        res = self.model.closest(<const Vec&> vec_cpp, <int> n, <int> policy)
+        res = self.model.closest(<const Vec&> vec_cpp, <int> n, <int> policy, <int> probes)
         return list(res)
+    def closest_batch(self, words, n=10, policy=0, probes=0):
+        """
+        closest_batch(words, n=10, policy=0, probes=0)
+
+        Same as `MonolingualModel.closest` for each word of `words`, with all the queries in a single
+        parallel search (`threads` option), without the GIL. Raise RuntimeError if a word is out of vocabulary.
+        """
+        cdef vector[string] words_cpp = words
+        cdef int n_cpp = n, policy_cpp = policy, probes_cpp = probes
+        cdef vector[vector[pair[string, float]]] res
+        with nogil:
+            res = self.model.closestBatch(words_cpp, n_cpp, policy_cpp, probes_cpp)
+        return [list(neighbors) for neighbors in res]
+    def build_index(self, lists=0, policy=0):
+        """
+        build_index(lists=0, policy=0)
+
+        Build an approximate nearest neighbor index of the word embeddings of `policy`, with `lists` lists
+        (0: square root of the vocabulary size). The index is saved with the model (in a file with the same
+        name and an .ann extension), and loaded with it.
+        """
+        self.model.buildIndex(lists, policy)
+    def has_index(self):
+        return self.model.hasIndex()
+    def analogical_reasoning(self, filename, max_voc=0, policy=0):
+        """
+        analogical_reasoning(filename, max_voc=0, policy=0)
+
+        Evaluate the word embeddings on the analogical reasoning questions of `filename` (e.g.
+        word2vec/questions-words.txt), using only the `max_voc` most frequent words (0: all the words).
+        The accuracy of each topic and the total accuracy are printed, and the total accuracy is returned.
+        """
+        return self.model.analogicalReasoning(filename, max_voc, policy)
     def closest_words(self, word, words, policy=0):
         cdef vector[pair[string, float]] res = self.model.closest(<const string&> word,
                                                                   <const vector[string]&> words,
@@ -306,16 +590,73 @@ cdef class MonolingualModel:
     property sent_vector:
         def __get__(self): return self.config.sent_vector
         def __set__(self, sent_vector): self.config.sent_vector = sent_vector
+    property unigram_table_size:
+        def __get__(self): return self.config.unigram_table_size
+        def __set__(self, unigram_table_size): self.config.unigram_table_size = unigram_table_size
+
+    property seed:
+        def __get__(self): return self.config.seed
+        def __set__(self, seed): self.config.seed = seed
+
+    property max_vocab_size:
+        def __get__(self): return self.config.max_vocab_size
+        def __set__(self, max_vocab_size): self.config.max_vocab_size = max_vocab_size
+
+    property shared_negatives:
+        def __get__(self): return self.config.shared_negatives
+        def __set__(self, shared_negatives): self.config.shared_negatives = shared_negatives
+
+    property sigmoid_table:
+        def __get__(self): return self.config.sigmoid_table
+        def __set__(self, sigmoid_table): self.config.sigmoid_table = sigmoid_table
+
+    property checkpoint:
+        def __get__(self): return self.config.checkpoint
+        def __set__(self, checkpoint): self.config.checkpoint = checkpoint
+
+    property checkpoint_words:
+        def __get__(self): return self.config.checkpoint_words
+        def __set__(self, checkpoint_words): self.config.checkpoint_words = checkpoint_words
+
+    property grow_vocab:
+        def __get__(self): return self.config.grow_vocab
+        def __set__(self, grow_vocab): self.config.grow_vocab = grow_vocab
+
+    property pin_threads:
+        def __get__(self): return self.config.pin_threads
+        def __set__(self, pin_threads): self.config.pin_threads = pin_threads
+
+    property numa_interleave:
+        def __get__(self): return self.config.numa_interleave
+        def __set__(self, numa_interleave): self.config.numa_interleave = numa_interleave
+
+    property metrics_file:
+        def __get__(self): return self.config.metrics_file
+        def __set__(self, metrics_file): self.config.metrics_file = metrics_file
+
+    property metrics_interval:
+        def __get__(self): return self.config.metrics_interval
+        def __set__(self, metrics_interval): self.config.metrics_interval = metrics_interval
+
+    property sent_vector_file:
+        def __get__(self): return self.config.sent_vector_file
+        def __set__(self, sent_vector_file): self.config.sent_vector_file = sent_vector_file
+
+    property doc_ids:
+        def __get__(self): return self.config.doc_ids
+        def __set__(self, doc_ids): self.config.doc_ids = doc_ids
 
 
 cdef class BilingualModel:
     """
-    BilingualModel(name=None, **kwargs)
+    BilingualModel(name=None, inference=False, policy=0, **kwargs)
     
     Parameters
     ----------
     name : path to an existing model. This model and its parameters
         (including vocabulary and configuration) will be loaded.
+    inference : only keep the embeddings used by `policy`, for querying (see `MonolingualModel.load`)
+    policy : embedding policy of the inference mode (see `MonolingualModel.word_vec`)
     kwargs : overwrite configuration of the model (see attributes)
     
     Attributes
@@ -323,6 +664,10 @@ cdef class BilingualModel:
     src_model : source monolingual model
     trg_model : target monolingual model
     beta : weight given to bilingual updates (compared to monolingual updates) (default: 1)
+    reader_threads : number of threads which tokenize and align the sentence pairs ahead of the
+        training threads (default: 0, the training threads read their own sentences)
+    line_index : file where the line offsets of the training files are saved, and reused if the
+        files haven't changed (default: '', not saved)
     learning_rate : initial learning rate, which will decay to zero during training (default: 0.05)
     dimension : dimension of the embeddings (default: 100)
     min_count : minimum count of a word in the training file to be put in the vocabulary (default: 5)
@@ -337,6 +682,24 @@ cdef class BilingualModel:
         0 to disable negative sampling) (default: 5)
     sent_vector : include sentence vectors in training. This is an implementation of
         batch paragraph vector (default: False)
+    unigram_table_size : size of the table used to draw negative samples, or 0 to
+        use the alias method, which needs much less memory (default: 0)
+    seed : random seed; training is deterministic for a given seed with a single thread (default: 1)
+    max_vocab_size : when counting words, rare words are pruned whenever the vocabulary gets larger
+        than this, to bound memory usage (default: 0, no limit)
+    sigmoid_table : during training, read the sigmoid from a precomputed table instead of
+        computing an exponential, like word2vec (default: False)
+    checkpoint : path where the model and its training state are saved during training, to
+        resume it if it is interrupted (see `resume`) (default: '', no checkpoints)
+    checkpoint_words : number of words trained between two checkpoints (default: 0, one per epoch)
+    grow_vocab : when training an existing model (initialize=False), add the new words of the training
+        file(s) to the vocabulary, and keep the embeddings of the existing words (default: False)
+    pin_threads : pin the training threads to CPUs spread over the NUMA nodes, and give each node
+        its own copy of the negative sampler and Huffman codes (default: False)
+    numa_interleave : interleave the pages of the weight matrices over the NUMA nodes (default: False)
+    metrics_file : during training, append the metrics (see `metrics`) to this file as JSON lines
+        (default: '', none)
+    metrics_interval : seconds between two lines of `metrics_file` (default: 10)
     
     Examples
     --------
@@ -350,11 +713,11 @@ cdef class BilingualModel:
     """
     cdef BilingualConfig* config
     cdef BilingualModelCpp* model
-    def __cinit__(self, name=None, **kwargs):
+    def __cinit__(self, name=None, inference=False, policy=0, **kwargs):
         self.config = new BilingualConfig()
         self.model = new BilingualModelCpp(self.config)
         if name is not None:
-            self.model.load(name)
+            self.model.load(name, inference, policy)
     
         # overwrites previous configuration
         for key, value in kwargs.items():
@@ -367,13 +730,43 @@ cdef class BilingualModel:
         del self.config
 
     def train(self, src_name, trg_name, initialize=True):
-        self.model.train(src_name, trg_name, initialize)
+        cdef string src_filename = src_name
+        cdef string trg_filename = trg_name
+        cdef bint init = initialize
+        with nogil:
+            self.model.train(src_filename, trg_filename, init)
+
+    def resume(self, src_name, trg_name, checkpoint):
+        """
+        resume(src_name, trg_name, checkpoint)
+
+        Continue an interrupted training from `checkpoint` (see `MonolingualModel.resume`).
+        """
+        cdef string src_filename = src_name
+        cdef string trg_filename = trg_name
+        cdef string checkpoint_filename = checkpoint
+        with nogil:
+            self.model.resume(src_filename, trg_filename, checkpoint_filename)
+
+    def metrics(self):
+        """
+        metrics()
+
+        Return the metrics of the current or last training (see `MonolingualModel.metrics`). The words and
+        sentences of both sides are counted.
+        """
+        return json.loads(self.model.getMetrics().json())
     
-    def save(self, name):
-        self.model.save(name)
+    def save(self, name, precision='float32'):
+        self.model.save(name, parsePrecision(precision))
     
-    def load(self, name):
-        self.model.load(name)
+    def load(self, name, inference=False, policy=0):
+        """
+        load(name, inference=False, policy=0)
+
+        Load model from disk (path `name`). See `MonolingualModel.load` for the inference mode.
+        """
+        self.model.load(name, inference, policy)
 
     def similarity(self, src_word, trg_word, policy=0):
         return self.model.similarity(src_word, trg_word, policy)
@@ -406,6 +799,14 @@ cdef class BilingualModel:
     property beta:
         def __get__(self): return self.config.beta           
         def __set__(self, beta): self.config.beta = beta
+
+    property reader_threads:
+        def __get__(self): return self.config.reader_threads
+        def __set__(self, reader_threads): self.config.reader_threads = reader_threads
+
+    property line_index:
+        def __get__(self): return self.config.line_index
+        def __set__(self, line_index): self.config.line_index = line_index
     property learning_rate:
         def __get__(self): return self.config.learning_rate
         def __set__(self, learning_rate): self.config.learning_rate = learning_rate
@@ -442,4 +843,47 @@ cdef class BilingualModel:
     property sent_vector:
         def __get__(self): return self.config.sent_vector
         def __set__(self, sent_vector): self.config.sent_vector = sent_vector
+    property unigram_table_size:
+        def __get__(self): return self.config.unigram_table_size
+        def __set__(self, unigram_table_size): self.config.unigram_table_size = unigram_table_size
+
+    property seed:
+        def __get__(self): return self.config.seed
+        def __set__(self, seed): self.config.seed = seed
+
+    property max_vocab_size:
+        def __get__(self): return self.config.max_vocab_size
+        def __set__(self, max_vocab_size): self.config.max_vocab_size = max_vocab_size
+
+    property sigmoid_table:
+        def __get__(self): return self.config.sigmoid_table
+        def __set__(self, sigmoid_table): self.config.sigmoid_table = sigmoid_table
+
+    property checkpoint:
+        def __get__(self): return self.config.checkpoint
+        def __set__(self, checkpoint): self.config.checkpoint = checkpoint
+
+    property checkpoint_words:
+        def __get__(self): return self.config.checkpoint_words
+        def __set__(self, checkpoint_words): self.config.checkpoint_words = checkpoint_words
+
+    property grow_vocab:
+        def __get__(self): return self.config.grow_vocab
+        def __set__(self, grow_vocab): self.config.grow_vocab = grow_vocab
+
+    property pin_threads:
+        def __get__(self): return self.config.pin_threads
+        def __set__(self, pin_threads): self.config.pin_threads = pin_threads
+
+    property numa_interleave:
+        def __get__(self): return self.config.numa_interleave
+        def __set__(self, numa_interleave): self.config.numa_interleave = numa_interleave
+
+    property metrics_file:
+        def __get__(self): return self.config.metrics_file
+        def __set__(self, metrics_file): self.config.metrics_file = metrics_file
+
+    property metrics_interval:
+        def __get__(self): return self.config.metrics_interval
+        def __set__(self, metrics_interval): self.config.metrics_interval = metrics_interval
 
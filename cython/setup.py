@@ -2,7 +2,12 @@ from distutils.core import setup, Extension
 from Cython.Build import cythonize
 import numpy
 
-sources = ["multivec.pyx", "../multivec/monolingual.cpp", "../multivec/bilingual.cpp", "../multivec/distance.cpp"]
+sources = ["multivec.pyx", "../multivec/monolingual.cpp", "../multivec/bilingual.cpp", "../multivec/distance.cpp",
+           "../multivec/simd.cpp", "../multivec/corpus.cpp",
+           "../multivec/mapping.cpp", "../multivec/knn.cpp", "../multivec/ann.cpp",
+           "../multivec/vectors.cpp", "../multivec/quantized.cpp", "../multivec/checkpoint.cpp",
+           "../multivec/numa.cpp", "../multivec/cluster.cpp",
+           "../multivec/metrics.cpp"]
 module = Extension("multivec", sources, undef_macros=['NDEBUG'], language="c++")
 module.extra_compile_args = ['--std=c++11', '-w', '-I../multivec', '-O3']
 module.libraries = ['m']
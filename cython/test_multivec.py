@@ -0,0 +1,65 @@
+"""
+Tests of the Python wrapper: `make test` (after `make`), or `python -m unittest test_multivec` in this directory.
+"""
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+from multivec import MonolingualModel
+
+
+def path(*parts):
+    # the wrapper takes byte strings
+    return os.path.join(*parts).encode()
+
+
+class MonolingualModelTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.mkdtemp()
+        rand = random.Random(1)
+        words = ['w%d' % i for i in range(200)]
+        self.corpus = path(self.tmp, 'corpus.txt')
+        with open(self.corpus, 'w') as f:
+            for _ in range(2000):
+                f.write(' '.join(rand.choice(words) for _ in range(rand.randint(3, 15))) + '\n')
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp)
+
+    def test_load_then_train(self):
+        # a model loaded with inference=False can still be trained and saved
+        model = MonolingualModel(dimension=20, threads=1, iterations=1, min_count=1)
+        model.train(self.corpus)
+        model.save(path(self.tmp, 'model.bin'))
+
+        loaded = MonolingualModel(dimension=20, threads=1, iterations=1, min_count=1)
+        loaded.load(path(self.tmp, 'model.bin'), inference=False)
+        loaded.train(self.corpus, initialize=False)
+        loaded.save(path(self.tmp, 'model2.bin'))
+        self.assertEqual(len(MonolingualModel(path(self.tmp, 'model2.bin')).word_vec(b'w0')), 20)
+
+    def test_load_inference(self):
+        model = MonolingualModel(dimension=20, threads=1, iterations=1, min_count=1)
+        model.train(self.corpus)
+        model.save(path(self.tmp, 'model.bin'))
+
+        loaded = MonolingualModel()
+        loaded.load(path(self.tmp, 'model.bin'), inference=True)
+        self.assertEqual(len(loaded.word_vec(b'w0')), 20)
+        self.assertRaises(RuntimeError, loaded.save, path(self.tmp, 'model2.bin'))
+
+    def test_load_utf8_text_vectors(self):
+        # short vectors: the non-ASCII word of the second line is within 4 * dim bytes of the first word
+        filename = path(self.tmp, 'vectors.txt')
+        with open(filename, 'wb') as f:
+            f.write(u'2 2\nab 1 2\n\u00e9t\u00e9 3 4\n'.encode('utf-8'))
+        model = MonolingualModel()
+        model.load_vectors(filename)
+        self.assertEqual(list(model.word_vec(b'ab')), [1, 2])
+        self.assertEqual(list(model.word_vec(u'\u00e9t\u00e9'.encode('utf-8'))), [3, 4])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,250 @@
+#include "ann.hpp"
+#include "serialization.hpp"
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+namespace {
+
+const double parallel_threshold = 1 << 22; // minimum number of multiply-adds worth spawning threads
+const size_t sample_per_list = 64; // k-means training rows per list
+
+/**
+ * Index file: header, then blocks of list offsets and row ids, and the two matrices (same block
+ * layout as the model format, see serialization.hpp).
+ */
+namespace index_format {
+    const char magic[8] = {'M', 'V', 'E', 'C', '-', 'I', 'V', 'F'};
+    const uint32_t version = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        int32_t policy;
+        uint32_t reserved;
+        uint64_t rows;
+        uint64_t lists;
+    };
+}
+
+int threadCount(double cost, size_t n, int threads) {
+    return cost < parallel_threshold ? 1 : max(1, min<int>(threads, n));
+}
+
+} // namespace
+
+void AnnIndex::clear() {
+    policy_ = -1;
+    centroids = Mat();
+    vectors = Mat();
+    offsets.clear();
+    ids.clear();
+}
+
+void AnnIndex::assign(const Mat& rows, vector<int>& lists, int threads) const {
+    size_t dim = rows.cols();
+    lists.resize(rows.rows());
+    threads = threadCount(static_cast<double>(rows.rows()) * centroids.rows() * dim, rows.rows(), threads);
+
+    size_t n = rows.rows();
+    parallelFor(threads, [&](int t) { // consecutive ranges of rows
+        for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i) {
+            int best = 0;
+            float best_score = -numeric_limits<float>::infinity();
+            for (size_t c = 0; c < centroids.rows(); ++c) {
+                float score = simd::dot(centroids[c].data(), rows[i].data(), dim);
+                if (score > best_score) {
+                    best = c;
+                    best_score = score;
+                }
+            }
+            lists[i] = best;
+        }
+    });
+}
+
+void AnnIndex::build(const Mat& weights, int policy, int lists, unsigned long long seed, int threads, int iterations) {
+    clear();
+    size_t n = weights.rows();
+    size_t dim = weights.cols();
+    if (n == 0) {
+        throw runtime_error("can't build the index of an empty matrix");
+    }
+    if (lists <= 0) {
+        lists = max(1, static_cast<int>(round(sqrt(n))));
+    }
+    lists = min<size_t>(lists, n);
+
+    // random sample of the rows (partial Fisher-Yates shuffle), whose first rows are the initial centroids
+    multivec::Random rand(seed);
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    size_t sample_size = min(n, lists * sample_per_list);
+    for (size_t i = 0; i < sample_size; ++i) {
+        swap(order[i], order[i + rand() % (n - i)]);
+    }
+    Mat sample(sample_size, dim);
+    for (size_t i = 0; i < sample_size; ++i) {
+        sample[i] = weights[order[i]];
+    }
+
+    centroids = Mat(lists, dim);
+    for (int c = 0; c < lists; ++c) {
+        centroids[c] = sample[c];
+    }
+
+    // spherical k-means: the centroids are the normalized means of their rows
+    vector<int> assignment;
+    for (int k = 0; k < iterations; ++k) {
+        assign(sample, assignment, threads);
+
+        Mat sums(lists, dim);
+        vector<int> sizes(lists, 0);
+        for (size_t i = 0; i < sample_size; ++i) {
+            simd::axpy(1.0f, sample[i].data(), sums[assignment[i]].data(), dim);
+            ++sizes[assignment[i]];
+        }
+        for (int c = 0; c < lists; ++c) {
+            if (sizes[c] == 0) { // empty list: start again from a random row
+                sums[c] = sample[rand() % sample_size];
+            }
+            float norm = simd::norm(sums[c].data(), dim);
+            if (norm > 0) simd::scale(1 / norm, sums[c].data(), dim);
+        }
+        centroids = std::move(sums);
+    }
+
+    // group the rows by list
+    assign(weights, assignment, threads);
+    offsets.assign(lists + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        ++offsets[assignment[i] + 1];
+    }
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    vector<int> pos(offsets.begin(), offsets.end() - 1);
+    ids.resize(n);
+    vectors = Mat(n, dim);
+    for (size_t i = 0; i < n; ++i) {
+        int p = pos[assignment[i]]++;
+        ids[p] = i;
+        vectors[p] = weights[i];
+    }
+    policy_ = policy;
+}
+
+vector<vector<Neighbor>> AnnIndex::search(const Mat& queries, int k, int probes, const vector<int>& exclude,
+                                          int threads) const {
+    size_t n = queries.rows();
+    vector<vector<Neighbor>> results(n);
+    if (k <= 0 || empty()) return results;
+    if (queries.cols() != cols()) {
+        throw runtime_error("dimension mismatch");
+    }
+
+    size_t dim = cols();
+    size_t n_probes = min<size_t>(max(probes, 1), lists());
+    double cost = static_cast<double>(n) * (lists() + rows() * n_probes / lists()) * dim;
+    threads = threadCount(cost, n, threads);
+
+    parallelFor(threads, [&](int t) { // consecutive ranges of queries
+        vector<Neighbor> closest_lists;
+        for (size_t q = n * t / threads; q < n * (t + 1) / threads; ++q) {
+            const float* query = queries[q].data();
+
+            closest_lists.clear();
+            for (size_t c = 0; c < lists(); ++c) {
+                pushNeighbor(closest_lists, n_probes, {static_cast<int>(c), simd::dot(centroids[c].data(), query, dim)});
+            }
+
+            vector<Neighbor>& heap = results[q];
+            int skip = exclude.empty() ? -1 : exclude[q];
+            for (auto it = closest_lists.begin(); it != closest_lists.end(); ++it) {
+                for (int p = offsets[it->index]; p < offsets[it->index + 1]; ++p) {
+                    float score = simd::dot(vectors[p].data(), query, dim);
+                    if (heap.size() == static_cast<size_t>(k) && score < heap.front().score) continue; // fast path
+                    if (ids[p] == skip) continue;
+                    pushNeighbor(heap, k, {ids[p], score});
+                }
+            }
+            sort_heap(heap.begin(), heap.end(), betterNeighbor);
+        }
+    });
+
+    return results;
+}
+
+void AnnIndex::save(const string& filename) const {
+    if (empty()) {
+        throw runtime_error("the index is empty");
+    }
+
+    string tmp_filename = filename + ".tmp";
+    ofstream outfile(tmp_filename, ios::binary);
+    check_is_open(outfile, tmp_filename);
+
+    index_format::Header header;
+    memcpy(header.magic, index_format::magic, sizeof(header.magic));
+    header.version = index_format::version;
+    header.byte_order = model_format::byte_order;
+    header.policy = policy_;
+    header.reserved = 0;
+    header.rows = rows();
+    header.lists = lists();
+    ::save(outfile, header);
+
+    saveBlock(outfile, offsets.data(), offsets.size());
+    saveBlock(outfile, ids.data(), ids.size());
+    ::save(outfile, centroids);
+    ::save(outfile, vectors);
+    outfile.close();
+
+    if (!outfile || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("couldn't save index to " + filename);
+    }
+}
+
+/**
+ * @brief Load an index file. The matrices are used directly from a private mapping of the file.
+ */
+void AnnIndex::load(const string& filename) {
+    clear();
+    ModelReader reader(std::make_shared<MappedFile>(filename, true), 0);
+
+    index_format::Header header = reader.read<index_format::Header>();
+    if (memcmp(header.magic, index_format::magic, sizeof(header.magic)) != 0) {
+        throw runtime_error(filename + " is not an index file");
+    }
+    if (header.byte_order != model_format::byte_order) {
+        throw runtime_error("index file has a different byte order");
+    }
+    if (header.version != index_format::version) {
+        throw runtime_error("unsupported index file version");
+    }
+
+    const int* list_offsets = reader.block<int>(header.lists + 1);
+    const int* row_ids = reader.block<int>(header.rows);
+    Mat list_centroids = reader.readMat();
+    Mat list_vectors = reader.readMat();
+
+    bool valid = header.lists > 0 && list_centroids.rows() == header.lists && list_vectors.rows() == header.rows
+        && list_centroids.cols() == list_vectors.cols() && list_offsets[0] == 0
+        && list_offsets[header.lists] == static_cast<int>(header.rows);
+    for (size_t i = 0; valid && i < header.lists; ++i) {
+        valid = list_offsets[i] <= list_offsets[i + 1];
+    }
+    for (size_t i = 0; valid && i < header.rows; ++i) {
+        valid = row_ids[i] >= 0 && row_ids[i] < static_cast<int>(header.rows);
+    }
+    if (!valid) {
+        throw runtime_error("invalid index file");
+    }
+
+    offsets.assign(list_offsets, list_offsets + header.lists + 1);
+    ids.assign(row_ids, row_ids + header.rows);
+    centroids = std::move(list_centroids);
+    vectors = std::move(list_vectors);
+    policy_ = header.policy;
+}
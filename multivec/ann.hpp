@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "knn.hpp"
+
+/**
+ * @brief Approximate nearest neighbor index (inverted file, IVF): the rows of a normalized matrix are
+ * clustered with spherical k-means, and each row is stored in the list of its closest centroid.
+ * A query only scans the `probes` lists whose centroids are the closest to it, instead of the whole
+ * matrix. More probes give a better recall, at the cost of speed (all the lists: exact search).
+ *
+ * The rows are copied into the index, grouped by list, so that each list is scanned sequentially.
+ * The index is saved in its own file (next to the model file), and can be used directly from a
+ * memory mapping of this file.
+ */
+class AnnIndex {
+    int policy_; // policy of the indexed embeddings, -1 when the index is empty
+    Mat centroids; // normalized
+    Mat vectors; // indexed rows, grouped by list
+    std::vector<int> offsets; // list i is rows offsets[i] to offsets[i + 1] of `vectors`
+    std::vector<int> ids; // index in the original matrix of each row of `vectors`
+
+    void assign(const Mat& rows, std::vector<int>& lists, int threads) const; // closest centroid of each row
+
+public:
+    AnnIndex() : policy_(-1) {}
+
+    bool empty() const { return policy_ == -1; }
+    int policy() const { return policy_; }
+    size_t rows() const { return ids.size(); }
+    size_t cols() const { return vectors.cols(); }
+    size_t lists() const { return centroids.rows(); }
+
+    /**
+     * @brief Build the index of `weights` (normalized rows)
+     * @param lists number of lists (0: square root of the number of rows)
+     * @param iterations k-means iterations, on a sample of at most 64 rows per list
+     */
+    void build(const Mat& weights, int policy, int lists = 0, unsigned long long seed = 1, int threads = 1,
+               int iterations = 10);
+    void clear();
+
+    /**
+     * @brief Same as topK on the indexed matrix, but only the rows of the `probes` closest lists of each
+     * query are considered.
+     */
+    std::vector<std::vector<Neighbor>> search(const Mat& queries, int k, int probes,
+                                              const std::vector<int>& exclude = std::vector<int>(),
+                                              int threads = 1) const;
+
+    void save(const std::string& filename) const;
+    void load(const std::string& filename);
+};
@@ -1,43 +1,285 @@
 #include "bilingual.hpp"
 #include "serialization.hpp"
 
+/**
+ * @brief Sentence pairs of a part of a chunk, tokenized, subsampled and aligned by a reader thread
+ * (see PairPipeline). The pairs are concatenated, to reuse the same buffers from one batch to the next.
+ */
+struct PairBatch {
+    static const size_t max_pairs = 1000;
+
+    size_t chunk;
+    vector<int> src_nodes, trg_nodes;
+    vector<int> alignment; // position in the target sentence of each source node (or -1)
+    vector<size_t> src_ends, trg_ends; // end of each sentence in src_nodes (and alignment) and trg_nodes
+    long long words; // for progress estimation
+
+    void clear(size_t chunk_id) {
+        chunk = chunk_id;
+        src_nodes.clear();
+        trg_nodes.clear();
+        alignment.clear();
+        src_ends.clear();
+        trg_ends.clear();
+        words = 0;
+    }
+};
+
+/**
+ * @brief Bounded queue between the reader threads and the training threads: readers claim the chunks from
+ * the scheduler, and fill batches taken from a fixed pool (so they can't get ahead of the training by more
+ * than this pool), which are trained and given back by the training threads.
+ *
+ * A chunk is done when all its batches are trained: `pending` counts the batches of each chunk which aren't
+ * trained yet, plus one while the chunk is being read.
+ */
+struct PairPipeline {
+    ChunkScheduler& scheduler;
+    vector<PairBatch> batches;
+    BlockingQueue<PairBatch*> free_batches;
+    BlockingQueue<PairBatch*> full_batches;
+    unique_ptr<atomic<int>[]> pending;
+    atomic<int> readers; // reader threads still running
+
+    PairPipeline(ChunkScheduler& scheduler, size_t chunks, int readers, size_t capacity) :
+        scheduler(scheduler), batches(capacity), pending(new atomic<int>[chunks]), readers(readers) {
+        for (size_t i = 0; i < chunks; ++i) {
+            pending[i] = 0;
+        }
+        for (auto it = batches.begin(); it != batches.end(); ++it) {
+            free_batches.push(&*it);
+        }
+    }
+
+    void finish(size_t chunk) {
+        if (--pending[chunk] == 0) {
+            scheduler.done();
+        }
+    }
+};
+
 void BilingualModel::train(const string& src_file, const string& trg_file, bool initialize) {
     std::cout << "Training files: " << src_file << ", " << trg_file << std::endl;
+    Corpus src_corpus(src_file); // memory-mapped
+    Corpus trg_corpus(trg_file);
+
+    if (initialize) {
+        src_model.clearInference();
+        trg_model.clearInference();
+    }
+    src_model.checkTrainable();
+    trg_model.checkTrainable();
+    unique_ptr<Cluster> cluster = openCluster(*config); // distributed training: this process trains its shard
+    metrics.reset();
+    auto phase_start = high_resolution_clock::now();
 
     if (initialize) {
         if (config->verbose)
             std::cout << "Creating new model" << std::endl;
 
-        src_model.readVocab(src_file);
-        trg_model.readVocab(trg_file);
+        src_model.readVocab(src_corpus, cluster.get());
+        trg_model.readVocab(trg_corpus, cluster.get());
         src_model.initNet();
         trg_model.initNet();
     } else {
         // TODO: check that initialization is fine
+        if (config->grow_vocab) {
+            src_model.growVocab(src_corpus);
+            trg_model.growVocab(trg_corpus);
+        }
     }
 
+    src_model.initSampler();
+    trg_model.initSampler();
+    metrics.addTime(TrainingMetrics::vocab, phase_start);
+
+    // each call starts a new learning rate schedule (an interrupted training is continued with resume)
     words_processed = 0;
     alpha = config->learning_rate;
 
-    // read files to find out the beginning of each chunk
-    auto src_chunks = src_model.chunkify(src_file, config->threads);
-    auto trg_chunks = trg_model.chunkify(trg_file, config->threads);
+    phase_start = high_resolution_clock::now();
+    vector<Chunk> src_chunks, trg_chunks;
+    long long n_chunks = max(config->threads, 1) * ChunkScheduler::chunks_per_thread;
+    if (cluster)
+        n_chunks = cluster->broadcast(n_chunks); // the processes synchronize at the same tasks
+    chunkify(src_corpus, trg_corpus, static_cast<int>(n_chunks), src_chunks, trg_chunks, cluster.get());
+    metrics.addTime(TrainingMetrics::chunkify, phase_start);
+
+    TrainingState state;
+    trainChunks(src_corpus, trg_corpus, src_chunks, trg_chunks, state, cluster.get());
+}
+
+/**
+ * @brief Continue a training which was interrupted after writing `checkpoint_file` (see
+ * MonolingualModel::resume). The model must be loaded from `checkpoint_file` first.
+ */
+void BilingualModel::resume(const string& src_file, const string& trg_file, const string& checkpoint_file) {
+    std::cout << "Training files: " << src_file << ", " << trg_file << std::endl;
+    Corpus src_corpus(src_file);
+    Corpus trg_corpus(trg_file);
+
+    src_model.checkTrainable();
+    trg_model.checkTrainable();
+    if (src_model.vocab_word_count == 0 || trg_model.vocab_word_count == 0) {
+        throw runtime_error("the model needs to be loaded from the checkpoint before resuming");
+    }
+    if (!config->cluster.empty()) {
+        throw runtime_error("checkpoints can't be resumed by a distributed training");
+    }
+
+    TrainingState state;
+    loadTrainingState(checkpoint_file, state);
+    metrics.reset();
+
+    // same chunks as the interrupted training
+    auto phase_start = high_resolution_clock::now();
+    vector<Chunk> src_chunks, trg_chunks;
+    chunkify(src_corpus, trg_corpus, static_cast<int>(state.chunks), src_chunks, trg_chunks);
+    metrics.addTime(TrainingMetrics::chunkify, phase_start);
+    if (static_cast<long long>(src_corpus.size() + trg_corpus.size()) != state.corpus_size ||
+        src_model.training_words + trg_model.training_words != state.training_words) {
+        throw runtime_error("the checkpoint " + checkpoint_file + " wasn't written when training on " + src_file +
+                            " and " + trg_file);
+    }
+
+    src_model.initSampler();
+    trg_model.initSampler();
+    words_processed = state.words_processed;
+    alpha = state.alpha;
+
+    if (config->verbose)
+        std::cout << "Resuming epoch " << state.task / max(state.chunks, 1LL) + 1 << " at chunk "
+                  << state.task % max(state.chunks, 1LL) << std::endl;
+
+    trainChunks(src_corpus, trg_corpus, src_chunks, trg_chunks, state);
+}
+
+/**
+ * @brief Line offsets of both sides (see ParallelIndex), then `n_chunks` chunks which start at the same
+ * lines on both sides (with a cluster, the chunks of the shard of this process). Also sets the training
+ * stats of both models.
+ */
+void BilingualModel::chunkify(const Corpus& src_corpus, const Corpus& trg_corpus, int n_chunks,
+                              vector<Chunk>& src_chunks, vector<Chunk>& trg_chunks, const Cluster* cluster) {
+    ParallelIndex index;
+    if (!config->line_index.empty() && index.load(config->line_index, src_corpus, trg_corpus)) {
+        if (config->verbose)
+            std::cout << "Line index: " << config->line_index << std::endl;
+    } else {
+        index = ParallelIndex(src_corpus, trg_corpus, config->threads);
+        if (!config->line_index.empty())
+            index.save(config->line_index, src_corpus, trg_corpus);
+    }
+
+    if (cluster)
+        index.chunkify(src_corpus, trg_corpus, n_chunks, src_chunks, trg_chunks, config->threads,
+                       cluster->rank(), cluster->size());
+    else
+        index.chunkify(src_corpus, trg_corpus, n_chunks, src_chunks, trg_chunks, config->threads);
+    src_model.setTrainingStats(src_chunks);
+    trg_model.setTrainingStats(trg_chunks);
+}
+
+/**
+ * @brief Train the chunks of all the epochs from `state.task`, write checkpoints if config->checkpoint
+ * is set, and average the weights over the cluster if there is one (see MonolingualModel::trainChunks).
+ * The training threads come first in `state.threads`, followed by the reader threads.
+ */
+void BilingualModel::trainChunks(const Corpus& src_corpus,
+                                 const Corpus& trg_corpus,
+                                 const vector<Chunk>& src_chunks,
+                                 const vector<Chunk>& trg_chunks,
+                                 TrainingState& state,
+                                 Cluster* cluster) {
+    int n_threads = max(config->threads, 1);
+    int n_readers = max(config->reader_threads, 0);
+    state.chunks = src_chunks.size();
+    words_processed += state.setThreads(n_threads + n_readers, config->seed);
+    state.corpus_size = src_corpus.size() + trg_corpus.size();
+    state.training_words = src_model.training_words + trg_model.training_words;
+    ChunkScheduler scheduler(src_chunks.size(), config->iterations, state.task); // a chunk is a source chunk and its target chunk
+
+    unique_ptr<CheckpointWriter> writer;
+    vector<const mat*> weights = {
+        &src_model.input_weights, &src_model.output_weights, &src_model.output_weights_hs, &src_model.sent_weights,
+        &trg_model.input_weights, &trg_model.output_weights, &trg_model.output_weights_hs, &trg_model.sent_weights
+    };
+    if (!config->checkpoint.empty()) {
+        writer.reset(new CheckpointWriter(config->checkpoint, [this](const string& filename, const Checkpoint& checkpoint) {
+            saveCheckpoint(filename, *this, checkpoint);
+        }));
+        scheduler.setCheckpoints(checkpointInterval(config->checkpoint_words, state.training_words, src_chunks.size()),
+            [&](long long task) {
+                state.task = task;
+                state.words_processed = words_processed;
+                state.alpha = alpha.load(memory_order_relaxed);
+                writer->push(weights, state);
+            });
+    }
+
+    unique_ptr<WeightAverager> averager;
+    if (cluster && cluster->size() > 1) {
+        averager.reset(new WeightAverager(*cluster, {
+            &src_model.input_weights, &src_model.output_weights, &src_model.output_weights_hs,
+            &trg_model.input_weights, &trg_model.output_weights, &trg_model.output_weights_hs
+        }));
+        long long words = cluster->sum(state.training_words) / cluster->size(); // same interval on all the processes
+        scheduler.setSynchronization(checkpointInterval(config->sync_words, words, src_chunks.size()),
+            [&]() { averager->sync(); });
+    }
+
+    ThreadCounters* counters = metrics.startThreads(n_threads); // training threads only
+    unique_ptr<MetricsWriter> metrics_writer;
+    if (!config->metrics_file.empty())
+        metrics_writer.reset(new MetricsWriter(config->metrics_file, config->metrics_interval, metrics));
 
     high_resolution_clock::time_point start = high_resolution_clock::now();
-    if (config->threads == 1) {
-        trainChunk(src_file, trg_file, src_chunks, trg_chunks, 0);
+    if (n_readers > 0) {
+        PairPipeline pipeline(scheduler, src_chunks.size(), n_readers, 2 * (n_threads + n_readers));
+        vector<thread> threads;
+
+        for (int i = 0; i < n_readers; ++i) {
+            threads.push_back(thread([&, i]() {
+                if (config->pin_threads)
+                    numa::pinThread(n_threads + i);
+                readChunks(src_corpus, trg_corpus, src_chunks, trg_chunks, pipeline, state.threads[n_threads + i]);
+            }));
+        }
+        for (int i = 0; i < n_threads; ++i) {
+            threads.push_back(thread([&, i]() {
+                if (config->pin_threads)
+                    numa::pinThread(i);
+                trainBatches(pipeline, state.threads[i], counters[i]);
+            }));
+        }
+
+        for (auto it = threads.begin(); it != threads.end(); ++it) {
+            it->join();
+        }
+    } else if (n_threads == 1) {
+        trainChunk(src_corpus, trg_corpus, src_chunks, trg_chunks, scheduler, state.threads[0], counters[0]);
     } else {
         vector<thread> threads;
 
-        for (int i = 0; i < config->threads; ++i) {
-            threads.push_back(thread(&BilingualModel::trainChunk, this,
-                src_file, trg_file, src_chunks, trg_chunks, i));
+        for (int i = 0; i < n_threads; ++i) {
+            threads.push_back(thread([&, i]() {
+                if (config->pin_threads)
+                    numa::pinThread(i);
+                trainChunk(src_corpus, trg_corpus, src_chunks, trg_chunks, scheduler, state.threads[i], counters[i]);
+            }));
         }
 
         for (auto it = threads.begin(); it != threads.end(); ++it) {
             it->join();
         }
     }
+    if (writer)
+        writer->finish();
+    if (averager)
+        averager->sync();
+    metrics.addTime(TrainingMetrics::training, start);
+    if (metrics_writer)
+        metrics_writer->finish();
     high_resolution_clock::time_point end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start).count();
 
@@ -47,125 +289,250 @@ void BilingualModel::train(const string& src_file, const string& trg_file, bool
     std::cout << "Training time: " << static_cast<float>(duration) / 1000000 << std::endl;
 }
 
-void BilingualModel::trainChunk(const string& src_file,
-                                const string& trg_file,
-                                const vector<long long>& src_chunks,
-                                const vector<long long>& trg_chunks,
-                                int chunk_id) {
-    ifstream src_infile(src_file);
-    ifstream trg_infile(trg_file);
-
-    try {
-        check_is_open(src_infile, src_file);
-        check_is_open(trg_infile, trg_file);
-        check_is_non_empty(src_infile, src_file);
-        check_is_non_empty(trg_infile, trg_file);
-    } catch (...) {
-        throw;
-    }
-    
+/**
+ * @brief Add the words processed by a thread since its last update, and decrease its learning rate (ctx.alpha)
+ */
+void BilingualModel::updateAlpha(TrainingContext& ctx, long long words) {
     float starting_alpha = config->learning_rate;
-    int max_iterations = config->iterations;
     long long training_words = src_model.training_words + trg_model.training_words;
+    long long total_words = config->iterations * training_words;
 
-    for (int k = 0; k < max_iterations; ++k) {
-        int word_count = 0, last_count = 0;
+    long long processed = words_processed.fetch_add(words) + words;
+    ctx.alpha = starting_alpha * (1 - static_cast<float>(processed) / total_words);
+    ctx.alpha = std::max(ctx.alpha, starting_alpha * 0.0001f);
+    alpha.store(ctx.alpha, memory_order_relaxed); // for the checkpoints
 
-        src_infile.clear();
-        trg_infile.clear();
-        src_infile.seekg(src_chunks[chunk_id], src_infile.beg);
-        trg_infile.seekg(trg_chunks[chunk_id], trg_infile.beg);
+    if (config->verbose) {
+        printf("\rAlpha: %f  Progress: %.2f%%", ctx.alpha, 100.0 * processed / total_words);
+        fflush(stdout);
+    }
+}
 
-        string src_sent, trg_sent;
-        while (getline(src_infile, src_sent) && getline(trg_infile, trg_sent)) {
-            word_count += trainSentence(src_sent, trg_sent);
+void BilingualModel::trainChunk(const Corpus& src_corpus,
+                                const Corpus& trg_corpus,
+                                const vector<Chunk>& src_chunks,
+                                const vector<Chunk>& trg_chunks,
+                                ChunkScheduler& scheduler,
+                                ThreadState& thread_state,
+                                ThreadCounters& counters) {
+    // random generator and buffers of this thread, reused from one sentence pair to the next
+    TrainingContext ctx(config->dimension, thread_state.rand_state);
+    ctx.alpha = alpha.load(memory_order_relaxed); // until the first update
+    vector<int> src_nodes, trg_nodes, alignment;
+
+    int epoch, current_epoch = thread_state.epoch;
+    size_t chunk_id;
+    int word_count = static_cast<int>(thread_state.pending_words), last_count = 0;
+    while (scheduler.next(epoch, chunk_id)) {
+        if (epoch != current_epoch) {
+            words_processed.fetch_add(word_count - last_count);
+            word_count = last_count = 0;
+            current_epoch = epoch;
+        }
+
+        // sentences are tokenized directly from the mapped files
+        const char* src_end = src_corpus.data() + src_chunks[chunk_id].end;
+        const char* trg_end = trg_corpus.data() + trg_chunks[chunk_id].end;
+        const char* src_sent = src_corpus.data() + src_chunks[chunk_id].begin;
+        const char* trg_sent = trg_corpus.data() + trg_chunks[chunk_id].begin;
+
+        while (src_sent < src_end && trg_sent < trg_end) {
+            const char* src_eol = Corpus::lineEnd(src_sent, src_end);
+            const char* trg_eol = Corpus::lineEnd(trg_sent, trg_end);
+            int words = prepareSentence(ctx.rand, src_sent, src_eol, trg_sent, trg_eol, src_nodes, trg_nodes, alignment);
+            trainSentence(ctx, src_nodes, trg_nodes, alignment);
+            word_count += words;
+            ctx.counts.words += words;
+            src_sent = src_eol + 1;
+            trg_sent = trg_eol + 1;
 
             // update learning rate
             if (word_count - last_count > 10000) {
-                words_processed += word_count - last_count; // asynchronous update
+                updateAlpha(ctx, word_count - last_count);
                 last_count = word_count;
+                counters.publish(ctx.counts);
+            }
+        }
+
+        // before the chunk is done, so that a checkpoint taken after it sees this state
+        thread_state.rand_state = ctx.rand.state();
+        thread_state.pending_words = word_count - last_count;
+        thread_state.epoch = current_epoch;
+        counters.publish(ctx.counts);
+        scheduler.done();
+    }
+
+    words_processed.fetch_add(word_count - last_count);
+}
 
-                alpha = starting_alpha * (1 - static_cast<float>(words_processed) / (max_iterations * training_words));
-                alpha = std::max(alpha, starting_alpha * 0.0001f);
+void BilingualModel::readChunks(const Corpus& src_corpus,
+                                const Corpus& trg_corpus,
+                                const vector<Chunk>& src_chunks,
+                                const vector<Chunk>& trg_chunks,
+                                PairPipeline& pipeline,
+                                ThreadState& thread_state) {
+    // subsampling uses its own random generators (the training threads use the first seeds)
+    multivec::Random rand(thread_state.rand_state);
+    vector<int> src_nodes, trg_nodes, alignment;
+
+    int epoch;
+    size_t chunk_id;
+    while (pipeline.scheduler.next(epoch, chunk_id)) {
+        pipeline.pending[chunk_id] = 1; // until it is read
+
+        const char* src_end = src_corpus.data() + src_chunks[chunk_id].end;
+        const char* trg_end = trg_corpus.data() + trg_chunks[chunk_id].end;
+        const char* src_sent = src_corpus.data() + src_chunks[chunk_id].begin;
+        const char* trg_sent = trg_corpus.data() + trg_chunks[chunk_id].begin;
+        PairBatch* batch = nullptr;
+
+        while (src_sent < src_end && trg_sent < trg_end) {
+            if (batch == nullptr) {
+                pipeline.free_batches.pop(batch);
+                batch->clear(chunk_id);
+            }
 
-                if (config->verbose) {
-                    printf("\rAlpha: %f  Progress: %.2f%%", alpha, 100.0 * words_processed /
-                                    (max_iterations * training_words));
-                    fflush(stdout);
-                }
+            const char* src_eol = Corpus::lineEnd(src_sent, src_end);
+            const char* trg_eol = Corpus::lineEnd(trg_sent, trg_end);
+            batch->words += prepareSentence(rand, src_sent, src_eol, trg_sent, trg_eol, src_nodes, trg_nodes, alignment);
+            batch->src_nodes.insert(batch->src_nodes.end(), src_nodes.begin(), src_nodes.end());
+            batch->trg_nodes.insert(batch->trg_nodes.end(), trg_nodes.begin(), trg_nodes.end());
+            batch->alignment.insert(batch->alignment.end(), alignment.begin(), alignment.end());
+            batch->src_ends.push_back(batch->src_nodes.size());
+            batch->trg_ends.push_back(batch->trg_nodes.size());
+            src_sent = src_eol + 1;
+            trg_sent = trg_eol + 1;
+
+            if (batch->src_ends.size() == PairBatch::max_pairs) {
+                ++pipeline.pending[chunk_id];
+                pipeline.full_batches.push(batch);
+                batch = nullptr;
             }
+        }
 
-            // stop when reaching the end of a chunk
-            if (chunk_id < src_chunks.size() - 1 && src_infile.tellg() >= src_chunks[chunk_id + 1])
-                break;
+        if (batch != nullptr) {
+            ++pipeline.pending[chunk_id];
+            pipeline.full_batches.push(batch);
         }
+        thread_state.rand_state = rand.state(); // for the checkpoints
+        pipeline.finish(chunk_id);
+    }
 
-        words_processed += word_count - last_count;
+    if (--pipeline.readers == 0) {
+        pipeline.full_batches.close();
     }
 }
 
-vector<int> BilingualModel::uniformAlignment(const vector<HuffmanNode>& src_nodes,
-                                             const vector<HuffmanNode>& trg_nodes) {
-    vector<int> alignment; // index = position in src_nodes, value = position in trg_nodes (or -1)
+void BilingualModel::trainBatches(PairPipeline& pipeline, ThreadState& thread_state, ThreadCounters& counters) {
+    TrainingContext ctx(config->dimension, thread_state.rand_state);
+    ctx.alpha = alpha.load(memory_order_relaxed); // until the first update
+    vector<int> src_nodes, trg_nodes, alignment;
+
+    PairBatch* batch;
+    while (pipeline.full_batches.pop(batch)) {
+        size_t src_begin = 0, trg_begin = 0;
+        for (size_t i = 0; i < batch->src_ends.size(); ++i) {
+            size_t src_end = batch->src_ends[i], trg_end = batch->trg_ends[i];
+            src_nodes.assign(batch->src_nodes.begin() + src_begin, batch->src_nodes.begin() + src_end);
+            trg_nodes.assign(batch->trg_nodes.begin() + trg_begin, batch->trg_nodes.begin() + trg_end);
+            alignment.assign(batch->alignment.begin() + src_begin, batch->alignment.begin() + src_end);
+            trainSentence(ctx, src_nodes, trg_nodes, alignment);
+            src_begin = src_end;
+            trg_begin = trg_end;
+        }
 
-    vector<int> trg_mapping; // maps positions in trg_sent to positions in trg_nodes (or -1)
-    int k = 0;
-    for (auto it = trg_nodes.begin(); it != trg_nodes.end(); ++it) {
-        trg_mapping.push_back(*it == HuffmanNode::UNK ? -1 : k++);
+        updateAlpha(ctx, batch->words);
+        ctx.counts.words += batch->words;
+        counters.publish(ctx.counts);
+        thread_state.rand_state = ctx.rand.state(); // for the checkpoints
+        size_t chunk_id = batch->chunk;
+        pipeline.free_batches.push(batch);
+        pipeline.finish(chunk_id);
     }
+}
 
-    for (int i = 0; i < src_nodes.size(); ++i) {
-        int j = i * trg_nodes.size() / src_nodes.size();
+/**
+ * @brief Uniform alignment of the words of a sentence pair: source word i is aligned with target word
+ * i * |target| / |source|. `src_nodes` and `trg_nodes` still contain their OOV and discarded words (-1).
+ *
+ * @param alignment for each source word which isn't -1, position of its target word among the target
+ * words which aren't -1 (or -1 if that word is -1)
+ */
+void BilingualModel::uniformAlignment(const vector<int>& src_nodes, const vector<int>& trg_nodes,
+                                      vector<int>& alignment) {
+    alignment.clear();
+
+    size_t j = 0;
+    int k = 0; // target words before position j which aren't -1
+    for (size_t i = 0; i < src_nodes.size(); ++i) {
+        size_t trg_pos = i * trg_nodes.size() / src_nodes.size();
+        for (; j < trg_pos; ++j) {
+            if (trg_nodes[j] != -1) ++k;
+        }
 
-        if (src_nodes[i] != HuffmanNode::UNK) {
-            alignment.push_back(trg_mapping[j]);
+        if (src_nodes[i] != -1) {
+            alignment.push_back(trg_nodes[trg_pos] == -1 ? -1 : k);
         }
     }
-
-    return alignment;
 }
 
-int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent) {
-    auto src_nodes = src_model.getNodes(src_sent);  // same size as src_sent, OOV words are replaced by <UNK>
-    auto trg_nodes = trg_model.getNodes(trg_sent);
+/**
+ * @brief Tokenize, subsample and align a sentence pair. `src_nodes` and `trg_nodes` are set to the indices
+ * of the remaining words (both are empty if one of the sentences is empty).
+ * @return number of words of the pair in the vocabulary, for progress estimation
+ */
+int BilingualModel::prepareSentence(multivec::Random& rand,
+                                    const char* src_begin, const char* src_end,
+                                    const char* trg_begin, const char* trg_end,
+                                    vector<int>& src_nodes, vector<int>& trg_nodes, vector<int>& alignment) {
+    src_model.getIndices(src_begin, src_end, src_nodes);  // same size as the source sentence, OOV words are replaced by -1
+    trg_model.getIndices(trg_begin, trg_end, trg_nodes);
 
     // counts the number of words that are in the vocabulary
     int words = 0;
-    words += src_nodes.size() - count(src_nodes.begin(), src_nodes.end(), HuffmanNode::UNK);
-    words += trg_nodes.size() - count(trg_nodes.begin(), trg_nodes.end(), HuffmanNode::UNK);
+    words += src_nodes.size() - count(src_nodes.begin(), src_nodes.end(), -1);
+    words += trg_nodes.size() - count(trg_nodes.begin(), trg_nodes.end(), -1);
 
     if (config->subsampling > 0) {
-        src_model.subsample(src_nodes); // puts <UNK> tokens in place of the discarded tokens
-        trg_model.subsample(trg_nodes);
+        src_model.subsample(src_nodes, rand); // puts -1 in place of the discarded tokens
+        trg_model.subsample(trg_nodes, rand);
     }
 
     if (src_nodes.empty() || trg_nodes.empty()) {
+        src_nodes.clear();
+        trg_nodes.clear();
+        alignment.clear();
         return words;
     }
 
-    // The <UNK> tokens are necessary to perform the alignment (the nodes vector should have the same size
+    // The -1 tokens are necessary to perform the alignment (the nodes vector should have the same size
     // as the original sentence)
-    auto alignment = uniformAlignment(src_nodes, trg_nodes);
+    uniformAlignment(src_nodes, trg_nodes, alignment);
+
+    // remove OOV and discarded words
+    src_nodes.erase(std::remove(src_nodes.begin(), src_nodes.end(), -1), src_nodes.end());
+    trg_nodes.erase(std::remove(trg_nodes.begin(), trg_nodes.end(), -1), trg_nodes.end());
+
+    return words;
+}
 
-    // remove <UNK> tokens
-    src_nodes.erase(
-        std::remove(src_nodes.begin(), src_nodes.end(), HuffmanNode::UNK),
-        src_nodes.end());
-    trg_nodes.erase(
-        std::remove(trg_nodes.begin(), trg_nodes.end(), HuffmanNode::UNK),
-        trg_nodes.end());
+void BilingualModel::trainSentence(TrainingContext& ctx, const vector<int>& src_nodes, const vector<int>& trg_nodes,
+                                   const vector<int>& alignment) {
+    ++ctx.counts.sentences;
+    if (src_nodes.empty() && trg_nodes.empty())
+        ++ctx.counts.skipped_sentences; // nothing left after subsampling
 
     // Monolingual training
     for (int src_pos = 0; src_pos < src_nodes.size(); ++src_pos) {
-        trainWord(src_model, src_model, src_nodes, src_nodes, src_pos, src_pos, alpha);
+        trainWord(ctx, src_model, src_model, src_nodes, src_nodes, src_pos, src_pos, ctx.alpha);
     }
 
     for (int trg_pos = 0; trg_pos < trg_nodes.size(); ++trg_pos) {
-        trainWord(trg_model, trg_model, trg_nodes, trg_nodes, trg_pos, trg_pos, alpha);
+        trainWord(ctx, trg_model, trg_model, trg_nodes, trg_nodes, trg_pos, trg_pos, ctx.alpha);
     }
 
     if (config->beta == 0)
-        return words;
+        return;
 
     // Bilingual training
     for (int src_pos = 0; src_pos < src_nodes.size(); ++src_pos) {
@@ -173,27 +540,25 @@ int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent
         int trg_pos = alignment[src_pos];
 
         if (trg_pos != -1) { // target word isn't OOV
-            trainWord(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha * config->beta);
-            trainWord(trg_model, src_model, trg_nodes, src_nodes, trg_pos, src_pos, alpha * config->beta);
+            trainWord(ctx, src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, ctx.alpha * config->beta);
+            trainWord(ctx, trg_model, src_model, trg_nodes, src_nodes, trg_pos, src_pos, ctx.alpha * config->beta);
         }
     }
-
-    return words; // returns the number of words processed (for progress estimation)
 }
 
-void BilingualModel::trainWord(MonolingualModel& src_model, MonolingualModel& trg_model,
-                               const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
+void BilingualModel::trainWord(TrainingContext& ctx, MonolingualModel& src_model, MonolingualModel& trg_model,
+                               const vector<int>& src_nodes, const vector<int>& trg_nodes,
                                int src_pos, int trg_pos, float alpha) {
 
     if (config->skip_gram) {
-        return trainWordSkipGram(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
+        return trainWordSkipGram(ctx, src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
     } else {
-        return trainWordCBOW(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
+        return trainWordCBOW(ctx, src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
     }
 }
 
-void BilingualModel::trainWordCBOW(MonolingualModel& src_model, MonolingualModel& trg_model,
-                                   const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
+void BilingualModel::trainWordCBOW(TrainingContext& ctx, MonolingualModel& src_model, MonolingualModel& trg_model,
+                                   const vector<int>& src_nodes, const vector<int>& trg_nodes,
                                    int src_pos, int trg_pos, float alpha) {
     // Trains the model by predicting a source node from its aligned context in the target sentence.
     // This function can be used in the reverse direction just by reversing the arguments. Likewise,
@@ -201,88 +566,112 @@ void BilingualModel::trainWordCBOW(MonolingualModel& src_model, MonolingualModel
 
     // 'src_pos' is the position in the source sentence of the current node to predict
     // 'trg_pos' is the position of the corresponding node in the target sentence
-    int dimension = config->dimension;
-    vec hidden(dimension, 0);
-    HuffmanNode cur_node = src_nodes[src_pos];
+    const simd::Kernels& kernels = ctx.kernels;
+    size_t d = config->dimension;
+    vec& hidden = ctx.hidden;
+    hidden.fill(0);
+    int cur_node = src_nodes[src_pos];
 
-    int this_window_size = 1 + multivec::rand() % config->window_size;
+    int this_window_size = 1 + ctx.rand() % config->window_size;
     int count = 0;
 
     for (int pos = trg_pos - this_window_size; pos <= trg_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= trg_nodes.size() || pos == trg_pos) continue;
-        hidden += trg_model.input_weights[trg_nodes[pos].index];
+        kernels.axpy(1.0f, trg_model.input_weights[trg_nodes[pos]].data(), hidden.data(), d);
         ++count;
     }
 
     if (count == 0) return;
-    hidden /= count;
+    kernels.scale(1.0f / count, hidden.data(), d);
 
-    vec error(dimension, 0); // compute error & update output weights
+    vec& error = ctx.error; // compute error & update output weights
+    error.fill(0);
     if (config->hierarchical_softmax) {
-        error += src_model.hierarchicalUpdate(cur_node, hidden, alpha);
+        src_model.hierarchicalUpdate(ctx, cur_node, hidden, alpha);
     }
     if (config->negative > 0) {
-        error += src_model.negSamplingUpdate(cur_node, hidden, alpha);
+        src_model.negSamplingUpdate(ctx, cur_node, hidden, alpha);
     }
 
     // Update input weights
     for (int pos = trg_pos - this_window_size; pos <= trg_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= trg_nodes.size() || pos == trg_pos) continue;
-        trg_model.input_weights[trg_nodes[pos].index] += error;
+        kernels.axpy(1.0f, error.data(), trg_model.input_weights[trg_nodes[pos]].data(), d);
     }
 }
 
-void BilingualModel::trainWordSkipGram(MonolingualModel& src_model, MonolingualModel& trg_model,
-                                       const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
+void BilingualModel::trainWordSkipGram(TrainingContext& ctx, MonolingualModel& src_model, MonolingualModel& trg_model,
+                                       const vector<int>& src_nodes, const vector<int>& trg_nodes,
                                        int src_pos, int trg_pos, float alpha) {
-    HuffmanNode input_word = src_nodes[src_pos];
+    int input_word = src_nodes[src_pos];
 
-    int this_window_size = 1 + multivec::rand() % config->window_size;
+    int this_window_size = 1 + ctx.rand() % config->window_size;
 
     for (int pos = trg_pos - this_window_size; pos <= trg_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= trg_nodes.size() || pos == trg_pos) continue;
-        HuffmanNode output_word = trg_nodes[pos];
+        int output_word = trg_nodes[pos];
 
-        vec error(config->dimension, 0);
+        ctx.error.fill(0);
         if (config->hierarchical_softmax) {
-            error += trg_model.hierarchicalUpdate(output_word, src_model.input_weights[input_word.index], alpha);
+            trg_model.hierarchicalUpdate(ctx, output_word, src_model.input_weights[input_word], alpha);
         }
         if (config->negative > 0) {
-            error += trg_model.negSamplingUpdate(output_word, src_model.input_weights[input_word.index], alpha);
+            trg_model.negSamplingUpdate(ctx, output_word, src_model.input_weights[input_word], alpha);
         }
 
-        src_model.input_weights[input_word.index] += error;
+        ctx.kernels.axpy(1.0f, ctx.error.data(), src_model.input_weights[input_word].data(), config->dimension);
     }
 }
 
-void BilingualModel::load(const string& filename) {
+/**
+ * @brief Load a model saved in any format. In inference mode, only the embeddings for `policy`
+ * are kept (see MonolingualModel::load).
+ */
+void BilingualModel::load(const string& filename, bool inference, int policy) {
     if (config->verbose)
         std::cout << "Loading model" << std::endl;
 
-    ifstream infile(filename);
+    src_model.clearInference();
+    trg_model.clearInference();
+    ::load(filename, *this);
+    src_model.indexVocab();
+    trg_model.indexVocab();
 
-    try {
-        check_is_open(infile, filename);
-    } catch (...) {
-        throw;
+    if (inference) {
+        src_model.initInference(policy);
+        trg_model.initInference(policy);
+    } else {
+        src_model.dequantizeWeights();
+        trg_model.dequantizeWeights();
     }
-
-    ::load(infile, *this);
-    src_model.initUnigramTable();
-    trg_model.initUnigramTable();
 }
 
-void BilingualModel::save(const string& filename) const {
+/**
+ * @brief Save the model in the current format. The model is written to a temporary file which then
+ * replaces `filename`, so that a model can be saved to the file it was mapped from.
+ */
+void BilingualModel::save(const string& filename, Precision precision) const {
+    src_model.checkTrainable();
+    trg_model.checkTrainable();
+    auto start = high_resolution_clock::now();
+
     if (config->verbose)
         std::cout << "Saving model" << std::endl;
 
-    ofstream outfile(filename);
+    string tmp_filename = filename + ".tmp";
+    ofstream outfile(tmp_filename, ios::binary);
 
     try {
-        check_is_open(outfile, filename);
+        check_is_open(outfile, tmp_filename);
     } catch (...) {
         throw;
     }
 
-    ::save(outfile, *this);
+    ::save(outfile, *this, precision);
+    outfile.close();
+
+    if (!outfile || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("couldn't save model to " + filename);
+    }
+    metrics.addTime(TrainingMetrics::save, start);
 }
@@ -3,39 +3,69 @@
 
 using namespace std;
 
+struct PairPipeline;
+
 class BilingualModel
 {
-    friend void save(ofstream& outfile, const BilingualModel& model);
-    friend void load(ifstream& infile, BilingualModel& model);
+    friend void save(ofstream& outfile, const BilingualModel& model, Precision precision);
+    friend void load(const string& filename, BilingualModel& model);
+    friend void loadLegacy(ifstream& infile, BilingualModel& model);
+    friend void saveCheckpoint(const string& filename, const BilingualModel& model, const Checkpoint& checkpoint);
 
 private:
     // Configuration of the model (monolingual models have the same configuration)
     BilingualConfig* const config;
 
-    long long words_processed; // number of words processed so far
-    float alpha;
+    std::atomic<long long> words_processed; // number of words processed so far, by all the threads
+    std::atomic<float> alpha; // last learning rate of the training threads (each one uses its own, see TrainingContext)
+    mutable TrainingMetrics metrics; // of the current or last training, including its save time
+
+    void chunkify(const Corpus& src_corpus, const Corpus& trg_corpus, int n_chunks,
+                  vector<Chunk>& src_chunks, vector<Chunk>& trg_chunks, const Cluster* cluster = nullptr);
+    void trainChunks(const Corpus& src_corpus,
+                     const Corpus& trg_corpus,
+                     const vector<Chunk>& src_chunks,
+                     const vector<Chunk>& trg_chunks,
+                     TrainingState& state,
+                     Cluster* cluster = nullptr);
+    void trainChunk(const Corpus& src_corpus,
+                    const Corpus& trg_corpus,
+                    const vector<Chunk>& src_chunks,
+                    const vector<Chunk>& trg_chunks,
+                    ChunkScheduler& scheduler,
+                    ThreadState& thread_state,
+                    ThreadCounters& counters);
+
+    // pipelined training (reader_threads > 0): readers fill batches of sentence pairs, which are trained by trainBatches
+    void readChunks(const Corpus& src_corpus,
+                    const Corpus& trg_corpus,
+                    const vector<Chunk>& src_chunks,
+                    const vector<Chunk>& trg_chunks,
+                    PairPipeline& pipeline,
+                    ThreadState& thread_state);
+    void trainBatches(PairPipeline& pipeline, ThreadState& thread_state, ThreadCounters& counters);
 
-    void trainChunk(const string& src_file,
-                    const string& trg_file,
-                    const vector<long long>& src_chunks,
-                    const vector<long long>& trg_chunks,
-                    int thread_id);
+    void updateAlpha(TrainingContext& ctx, long long words);
 
     // TODO: unsupervised alignment (GIZA)
-    vector<int> uniformAlignment(const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes);
+    void uniformAlignment(const vector<int>& src_nodes, const vector<int>& trg_nodes, vector<int>& alignment);
 
-    int trainSentence(const string& trg_sent, const string& src_sent);
+    int prepareSentence(multivec::Random& rand, const char* src_begin, const char* src_end,
+        const char* trg_begin, const char* trg_end, vector<int>& src_nodes, vector<int>& trg_nodes,
+        vector<int>& alignment);
+    void trainSentence(TrainingContext& ctx, const vector<int>& src_nodes, const vector<int>& trg_nodes,
+        const vector<int>& alignment);
 
-    void trainWord(MonolingualModel& src_params, MonolingualModel& trg_params,
-        const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
+    void trainWord(TrainingContext& ctx, MonolingualModel& src_params, MonolingualModel& trg_params,
+        const vector<int>& src_nodes, const vector<int>& trg_nodes,
         int src_pos, int trg_pos, float alpha);
 
-    void trainWordCBOW(MonolingualModel&, MonolingualModel&,
-        const vector<HuffmanNode>&, const vector<HuffmanNode>&,
+    void trainWordCBOW(TrainingContext&, MonolingualModel&, MonolingualModel&,
+        const vector<int>&, const vector<int>&,
         int, int, float);
 
-    void trainWordSkipGram(MonolingualModel&, MonolingualModel&,
-        const vector<HuffmanNode>&, const vector<HuffmanNode>&,
+    void trainWordSkipGram(TrainingContext&, MonolingualModel&, MonolingualModel&,
+        const vector<int>&, const vector<int>&,
         int, int, float);
 
 public:
@@ -47,8 +77,12 @@ public:
     BilingualModel(BilingualConfig* config) : config(config), src_model(config), trg_model(config) {}
 
     void train(const string& src_file, const string& trg_file, bool initialize = true);
-    void load(const string& filename);
-    void save(const string& filename) const;
+    // continues the training interrupted after writing this checkpoint (the model must be loaded from it first)
+    void resume(const string& src_file, const string& trg_file, const string& checkpoint_file);
+    void load(const string& filename, bool inference = false, int policy = 0); // loads the entire model, or only what `policy` needs
+    void save(const string& filename, Precision precision = Precision::float32) const;
+    // metrics of the current or last training (thread-safe, can be read while another thread is training)
+    const TrainingMetrics& getMetrics() const { return metrics; }
 
     float similarity(const string& src_word, const string& trg_word, int policy = 0) const; // cosine similarity
     float distance(const string& src_word, const string& trg_word, int policy = 0) const; // 1 - cosine similarity
@@ -0,0 +1,94 @@
+#include "checkpoint.hpp"
+#include <cstdio>
+
+using namespace std;
+
+namespace {
+
+// copy of `src` into `dst`, reusing the memory of `dst` when it has the same shape
+void copyInto(const mat& src, mat& dst) {
+    if (dst.rows() == src.rows() && dst.cols() == src.cols() && dst.stride() == src.stride()) {
+        if (src.rows() > 0) memcpy(dst.data(), src.data(), sizeof(float) * src.rows() * src.stride());
+    } else {
+        dst = src;
+    }
+}
+
+}
+
+long long TrainingState::setThreads(size_t n, int seed) {
+    int epoch = chunks == 0 ? 0 : static_cast<int>(task / chunks);
+    for (size_t i = threads.size(); i < n; ++i) {
+        threads.push_back(ThreadState(multivec::Random::seed(seed, i), epoch));
+    }
+
+    long long pending_words = 0;
+    for (size_t i = n; i < threads.size(); ++i) {
+        pending_words += threads[i].pending_words;
+    }
+    threads.resize(n);
+    return pending_words;
+}
+
+CheckpointWriter::CheckpointWriter(const string& filename, WriteFunction write) :
+    filename(filename), write(write), finished(false) {
+    free_buffers.push(&buffers[0]);
+    free_buffers.push(&buffers[1]);
+    writer = thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    if (!finished) {
+        full_buffers.close();
+        writer.join();
+    }
+}
+
+void CheckpointWriter::push(const vector<const mat*>& weights, const TrainingState& state) {
+    Checkpoint* checkpoint;
+    free_buffers.pop(checkpoint);
+
+    checkpoint->weights.resize(weights.size());
+    for (size_t i = 0; i < weights.size(); ++i) {
+        copyInto(*weights[i], checkpoint->weights[i]);
+    }
+    checkpoint->state = state;
+    full_buffers.push(checkpoint);
+}
+
+void CheckpointWriter::finish() {
+    if (finished) return;
+    full_buffers.close();
+    writer.join();
+    finished = true;
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void CheckpointWriter::run() {
+    string tmp_filename = filename + ".tmp";
+
+    Checkpoint* checkpoint;
+    while (full_buffers.pop(checkpoint)) {
+        if (!error) { // after an error, the following checkpoints are dropped
+            try {
+                write(tmp_filename, *checkpoint);
+                if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+                    throw runtime_error("couldn't write checkpoint " + filename);
+                }
+            } catch (...) {
+                error = current_exception();
+            }
+        }
+        free_buffers.push(checkpoint);
+    }
+}
+
+long long checkpointInterval(long long words, long long training_words, long long chunks) {
+    if (words <= 0 || training_words <= 0) {
+        return max(chunks, 1LL);
+    }
+    return max(static_cast<long long>(static_cast<double>(words) * chunks / training_words), 1LL);
+}
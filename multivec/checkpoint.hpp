@@ -0,0 +1,90 @@
+#pragma once
+#include <functional>
+#include <exception>
+#include "utils.hpp"
+
+/**
+ * @brief Part of the training state owned by a training thread (or a reader thread of the bilingual
+ * pipeline). Threads publish it before claiming each chunk, so that it is up to date when a checkpoint
+ * is taken.
+ */
+struct ThreadState {
+    unsigned long long rand_state;
+    long long pending_words; // words trained since this thread last added them to words_processed
+    int epoch; // epoch of the last chunk of this thread
+
+    ThreadState(unsigned long long rand_state = 1, int epoch = 0) :
+        rand_state(rand_state), pending_words(0), epoch(epoch) {}
+};
+
+/**
+ * @brief Position in the learning rate schedule and in the training file, at a chunk boundary: all the
+ * tasks of the ChunkScheduler before `task` are done, and none of the following tasks has started.
+ */
+struct TrainingState {
+    long long task; // next task (epoch * chunks + chunk)
+    long long chunks; // number of chunks of the training file
+    long long corpus_size; // size in bytes of the training file(s), and their number of words, to check
+    long long training_words; // that training is resumed on the same files
+    long long words_processed;
+    float alpha;
+    vector<ThreadState> threads;
+
+    TrainingState() : task(0), chunks(0), corpus_size(0), training_words(0), words_processed(0), alpha(0) {}
+
+    /**
+     * @brief Keep the state of the first `n` threads, and add threads which start with their own seed
+     * (derived from `seed`) at the current epoch
+     * @return words pending in the threads which were removed
+     */
+    long long setThreads(size_t n, int seed);
+};
+
+/**
+ * @brief Copy of the weights and training state, saved by a CheckpointWriter
+ */
+struct Checkpoint {
+    vector<mat> weights;
+    TrainingState state;
+};
+
+/**
+ * @brief Writes checkpoints on a background thread, with double buffering: push() copies the weights into
+ * a free buffer and returns, while the previous checkpoint may still be written. Training only waits if
+ * both buffers are busy, i.e. if checkpoints are taken faster than they can be written.
+ *
+ * Each checkpoint is written to a temporary file, which then replaces `filename`, so that an interrupted
+ * write doesn't destroy the previous checkpoint.
+ */
+class CheckpointWriter {
+public:
+    typedef std::function<void(const string& filename, const Checkpoint& checkpoint)> WriteFunction;
+
+    CheckpointWriter(const string& filename, WriteFunction write);
+    ~CheckpointWriter();
+
+    void push(const vector<const mat*>& weights, const TrainingState& state);
+
+    /**
+     * @brief Wait until the pushed checkpoints are written, and rethrow the first error of the writer thread
+     */
+    void finish();
+
+private:
+    string filename;
+    WriteFunction write;
+    Checkpoint buffers[2];
+    BlockingQueue<Checkpoint*> free_buffers;
+    BlockingQueue<Checkpoint*> full_buffers;
+    exception_ptr error;
+    thread writer;
+    bool finished;
+
+    void run();
+};
+
+/**
+ * @brief Number of tasks of a ChunkScheduler between two checkpoints, for a checkpoint every `words` words
+ * (at least one chunk, and one epoch if `words` is 0)
+ */
+long long checkpointInterval(long long words, long long training_words, long long chunks);
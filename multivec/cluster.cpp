@@ -0,0 +1,297 @@
+#include "cluster.hpp"
+#include <stdexcept>
+#include <cstdint>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+
+namespace {
+
+const int connect_timeout = 600; // seconds during which the other processes try to connect to process 0
+
+void writeAll(int socket, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (n <= 0) throw runtime_error("cluster: connection lost");
+        data += n;
+        size -= n;
+    }
+}
+
+void readAll(int socket, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::recv(socket, data, size, 0);
+        if (n <= 0) throw runtime_error("cluster: connection lost");
+        data += n;
+        size -= n;
+    }
+}
+
+int openSocket(const string& host, const string& port, bool listening) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo* addresses;
+    if (getaddrinfo(listening ? nullptr : host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        throw runtime_error("cluster: unknown address " + host + ":" + port);
+    }
+
+    int s = -1;
+    for (addrinfo* a = addresses; a != nullptr && s == -1; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s == -1) continue;
+        int yes = 1;
+        bool ok;
+        if (listening) {
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            ok = bind(s, a->ai_addr, a->ai_addrlen) == 0 && listen(s, SOMAXCONN) == 0;
+        } else {
+            ok = connect(s, a->ai_addr, a->ai_addrlen) == 0;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        }
+        if (!ok) {
+            close(s);
+            s = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return s;
+}
+
+}
+
+Cluster::Cluster(const string& address, int rank, int size) : rank_(rank), size_(size) {
+    if (size < 1 || rank < 0 || rank >= size) {
+        throw runtime_error("cluster: invalid rank " + to_string(rank) + " for " + to_string(size) + " processes");
+    }
+    size_t colon = address.rfind(':');
+    if (colon == string::npos) {
+        throw runtime_error("cluster: invalid address " + address + " (expected host:port)");
+    }
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+    if (size == 1) return;
+
+    if (rank == 0) {
+        int server = openSocket(host, port, true);
+        if (server == -1) throw runtime_error("cluster: couldn't listen on port " + port);
+
+        sockets.assign(size, -1);
+        for (int i = 1; i < size; ++i) { // the processes identify themselves by their rank
+            int s = accept(server, nullptr, nullptr);
+            int32_t peer = -1;
+            if (s != -1) readAll(s, reinterpret_cast<char*>(&peer), sizeof(peer));
+            if (peer <= 0 || peer >= size || sockets[peer] != -1) {
+                if (s != -1) close(s);
+                close(server);
+                throw runtime_error("cluster: unexpected connection on port " + port);
+            }
+            int yes = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            sockets[peer] = s;
+        }
+        close(server);
+    } else {
+        int s = -1;
+        for (int attempt = 0; s == -1 && attempt < connect_timeout * 10; ++attempt) { // process 0 may start later
+            s = openSocket(host, port, false);
+            if (s == -1) usleep(100000);
+        }
+        if (s == -1) throw runtime_error("cluster: couldn't connect to " + address);
+
+        int32_t id = rank;
+        writeAll(s, reinterpret_cast<const char*>(&id), sizeof(id));
+        sockets.assign(1, s);
+    }
+}
+
+Cluster::~Cluster() {
+    for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+        if (*it != -1) close(*it);
+    }
+}
+
+void Cluster::send(int socket, const string& data) {
+    uint64_t size = data.size();
+    writeAll(socket, reinterpret_cast<const char*>(&size), sizeof(size));
+    writeAll(socket, data.data(), data.size());
+}
+
+void Cluster::receive(int socket, string& data) {
+    uint64_t size;
+    readAll(socket, reinterpret_cast<char*>(&size), sizeof(size));
+    data.resize(size);
+    if (size > 0) readAll(socket, &data[0], size);
+}
+
+vector<string> Cluster::gather(const string& data) {
+    if (rank_ != 0) {
+        send(sockets[0], data);
+        return vector<string>();
+    }
+
+    vector<string> all(size_);
+    all[0] = data;
+    for (int i = 1; i < size_; ++i) {
+        receive(sockets[i], all[i]);
+    }
+    return all;
+}
+
+void Cluster::broadcast(string& data) {
+    if (rank_ != 0) {
+        receive(sockets[0], data);
+        return;
+    }
+    for (int i = 1; i < size_; ++i) {
+        send(sockets[i], data);
+    }
+}
+
+long long Cluster::broadcast(long long value) {
+    string data;
+    appendValue(data, value);
+    broadcast(data);
+    const char* p = data.data();
+    return readValue<long long>(p);
+}
+
+long long Cluster::sum(long long value) {
+    string data;
+    appendValue(data, value);
+    vector<string> all = gather(data);
+
+    if (rank_ == 0) {
+        long long total = 0;
+        for (auto it = all.begin(); it != all.end(); ++it) {
+            const char* p = it->data();
+            total += readValue<long long>(p);
+        }
+        data.clear();
+        appendValue(data, total);
+    }
+    broadcast(data);
+    const char* p = data.data();
+    return readValue<long long>(p);
+}
+
+unique_ptr<Cluster> openCluster(const Config& config) {
+    if (config.cluster.empty()) {
+        return unique_ptr<Cluster>();
+    }
+    // each process trains its own lines: their sentence vectors and checkpoints would need to be merged
+    if (config.sent_vector || !config.checkpoint.empty() || config.grow_vocab) {
+        throw runtime_error("distributed training doesn't support sentence vectors, checkpoints or growing the vocabulary");
+    }
+    return unique_ptr<Cluster>(new Cluster(config.cluster, config.cluster_rank, config.cluster_size));
+}
+
+WeightAverager::WeightAverager(Cluster& cluster, const vector<mat*>& weights) : cluster(cluster), weights(weights) {
+    string data; // all the rows of process 0
+    if (cluster.rank() == 0) {
+        for (auto it = weights.begin(); it != weights.end(); ++it) {
+            for (size_t row = 0; row < (*it)->rows(); ++row) {
+                data.append(reinterpret_cast<const char*>((**it)[row].data()), sizeof(float) * (*it)->cols());
+            }
+        }
+    }
+    cluster.broadcast(data);
+
+    const char* p = data.data();
+    for (auto it = weights.begin(); it != weights.end(); ++it) {
+        mat& w = **it;
+        if (cluster.rank() != 0) {
+            for (size_t row = 0; row < w.rows(); ++row) {
+                memcpy(w[row].data(), p, sizeof(float) * w.cols());
+                p += sizeof(float) * w.cols();
+            }
+        }
+        synced.push_back(w);
+    }
+}
+
+void WeightAverager::sync() {
+    // rows which changed since the last synchronization: row number, then difference with the copy
+    string diffs;
+    for (size_t m = 0; m < weights.size(); ++m) {
+        mat& w = *weights[m];
+        const mat& s = synced[m];
+        size_t count_pos = diffs.size();
+        appendValue(diffs, uint64_t(0));
+
+        uint64_t count = 0;
+        for (size_t row = 0; row < w.rows(); ++row) {
+            if (memcmp(w[row].data(), s[row].data(), sizeof(float) * w.cols()) == 0) continue;
+            appendValue(diffs, int32_t(row));
+            for (size_t col = 0; col < w.cols(); ++col) {
+                appendValue(diffs, w[row][col] - s[row][col]);
+            }
+            ++count;
+        }
+        memcpy(&diffs[count_pos], &count, sizeof(count));
+    }
+
+    vector<string> all = cluster.gather(diffs);
+    string average; // same format, with the average difference
+    if (cluster.rank() == 0) {
+        if (sums.empty()) {
+            for (size_t m = 0; m < weights.size(); ++m) {
+                sums.push_back(mat(weights[m]->rows(), weights[m]->cols()));
+                changed.push_back(vector<char>(weights[m]->rows(), 0));
+            }
+        }
+
+        for (auto it = all.begin(); it != all.end(); ++it) {
+            const char* p = it->data();
+            for (size_t m = 0; m < weights.size(); ++m) {
+                uint64_t count = readValue<uint64_t>(p);
+                for (uint64_t i = 0; i < count; ++i) {
+                    int row = readValue<int32_t>(p);
+                    changed[m][row] = 1;
+                    for (size_t col = 0; col < sums[m].cols(); ++col) {
+                        sums[m][row][col] += readValue<float>(p);
+                    }
+                }
+            }
+        }
+        all.clear();
+
+        float scale = 1.0f / cluster.size();
+        for (size_t m = 0; m < weights.size(); ++m) {
+            size_t count_pos = average.size();
+            appendValue(average, uint64_t(0));
+            uint64_t count = 0;
+            for (size_t row = 0; row < sums[m].rows(); ++row) {
+                if (!changed[m][row]) continue;
+                appendValue(average, int32_t(row));
+                for (size_t col = 0; col < sums[m].cols(); ++col) {
+                    appendValue(average, sums[m][row][col] * scale);
+                }
+                sums[m][row].fill(0);
+                changed[m][row] = 0;
+                ++count;
+            }
+            memcpy(&average[count_pos], &count, sizeof(count));
+        }
+    }
+    cluster.broadcast(average);
+
+    const char* p = average.data();
+    for (size_t m = 0; m < weights.size(); ++m) {
+        mat& w = *weights[m];
+        mat& s = synced[m];
+        uint64_t count = readValue<uint64_t>(p);
+        for (uint64_t i = 0; i < count; ++i) {
+            int row = readValue<int32_t>(p);
+            for (size_t col = 0; col < w.cols(); ++col) {
+                s[row][col] += readValue<float>(p);
+            }
+            memcpy(w[row].data(), s[row].data(), sizeof(float) * w.cols());
+        }
+    }
+}
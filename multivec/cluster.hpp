@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include "utils.hpp"
+
+// raw values in the messages of a Cluster (all the processes are expected to have the same byte order)
+template <typename T>
+inline void appendValue(string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline T readValue(const char*& p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+/**
+ * @brief Group of training processes (e.g. one per machine), which train the same model on their own shard of
+ * the corpus (see Config::cluster). Process 0 is the coordinator: the other processes connect to it over TCP,
+ * and the collective operations go through it. All the processes must call the same collective operations,
+ * in the same order.
+ */
+class Cluster {
+    int rank_;
+    int size_;
+    vector<int> sockets; // process 0: socket of each other process (by rank, -1 for itself); other processes: socket to process 0
+
+    Cluster(const Cluster&); // not copyable
+    Cluster& operator=(const Cluster&);
+
+    static void send(int socket, const string& data);
+    static void receive(int socket, string& data);
+
+public:
+    /**
+     * @param address host:port where process 0 listens (its host is only used by the other processes)
+     * @param rank number of this process, in [0, size)
+     */
+    Cluster(const string& address, int rank, int size);
+    ~Cluster();
+
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+
+    /**
+     * @brief Data of every process (by rank) on process 0, and nothing on the other processes
+     */
+    vector<string> gather(const string& data);
+
+    void broadcast(string& data); // data of process 0 on every process
+    long long broadcast(long long value); // `value` of process 0 on every process
+    long long sum(long long value); // sum of `value` over all the processes, on every process
+};
+
+/**
+ * @brief Cluster of a distributed training (see Config::cluster), or nullptr when training on a single process
+ */
+unique_ptr<Cluster> openCluster(const Config& config);
+
+/**
+ * @brief Periodic averaging of weight matrices over a Cluster. Each process keeps a copy of its matrices as they
+ * were after the last synchronization, and only sends the rows which changed since then (their difference with
+ * the copy). Process 0 adds up these differences, and every process replaces each of these rows with its copy
+ * plus the average difference, so that all the processes have the same weights again.
+ *
+ * All the processes must have the same vocabulary. The weights of process 0 are copied to the other processes
+ * when the WeightAverager is created, and then they are only read and written by sync().
+ */
+class WeightAverager {
+    Cluster& cluster;
+    vector<mat*> weights;
+    vector<mat> synced; // copy of the weights after the last synchronization
+    vector<mat> sums; // process 0: sum of the differences of each row (only reset for the rows which changed)
+    vector<vector<char>> changed; // process 0: rows of `sums` which changed
+
+public:
+    WeightAverager(Cluster& cluster, const vector<mat*>& weights);
+
+    void sync();
+};
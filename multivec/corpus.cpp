@@ -0,0 +1,273 @@
+#include "corpus.hpp"
+#include <stdexcept>
+#include <thread>
+#include <cctype>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Count the lines and words of a chunk (same tokenization as forEachToken)
+ */
+void countChunk(const char* data, Chunk& chunk) {
+    long long lines = 0, words = 0;
+    bool in_word = false;
+    for (const char* p = data + chunk.begin; p != data + chunk.end; ++p) {
+        if (*p == '\n') ++lines;
+        bool space = isspace(static_cast<unsigned char>(*p));
+        if (!space && !in_word) ++words;
+        in_word = !space;
+    }
+    if (chunk.end > chunk.begin && data[chunk.end - 1] != '\n') ++lines; // last line without newline
+
+    chunk.lines = lines;
+    chunk.words = words;
+}
+
+/**
+ * @brief Count the lines and words of all the chunks, each thread counting a contiguous range of chunks
+ */
+void countChunks(const char* data, vector<Chunk>& chunks, int n_threads) {
+    size_t n = chunks.size();
+    n_threads = static_cast<int>(min<size_t>(max(n_threads, 1), max<size_t>(n, 1)));
+    auto count = [&](int t) {
+        for (size_t i = n * t / n_threads; i < n * (t + 1) / n_threads; ++i) {
+            countChunk(data, chunks[i]);
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < n_threads; ++t) {
+        threads.push_back(thread(count, t));
+    }
+    count(0);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+
+    long long first_line = 0;
+    for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+        it->first_line = first_line;
+        first_line += it->lines;
+    }
+}
+
+} // namespace
+
+Corpus::Corpus(const string& filename) : filename(filename), file(filename), data_(file.data()), size_(file.size()) {
+    if (size_ == 0) {
+        throw runtime_error("training file " + filename + " is empty");
+    }
+    file.adviseSequential(); // each thread reads its chunk sequentially
+}
+
+long long Corpus::lineStart(long long pos) const {
+    if (pos <= 0) return 0;
+    if (pos >= static_cast<long long>(size_)) return size_;
+    if (data_[pos - 1] == '\n') return pos;
+    const char* eol = lineEnd(data_ + pos, data_ + size_);
+    return eol == data_ + size_ ? size_ : eol - data_ + 1;
+}
+
+vector<Chunk> Corpus::chunkify(int n_chunks, int threads, int shard, int shards) const {
+    long long total = static_cast<long long>(n_chunks) * shards; // chunks of all the shards
+    auto boundary = [&](long long k) -> long long {
+        return k >= total ? size_ : lineStart(static_cast<long long>(size_ / total * k));
+    };
+
+    vector<Chunk> chunks(n_chunks);
+    for (int i = 0; i < n_chunks; ++i) {
+        chunks[i].begin = boundary(static_cast<long long>(shard) * n_chunks + i);
+        chunks[i].end = boundary(static_cast<long long>(shard) * n_chunks + i + 1);
+    }
+
+    countChunks(data_, chunks, threads);
+    return chunks;
+}
+
+vector<long long> Corpus::lineOffsets(int threads) const {
+    threads = max(threads, 1);
+    vector<long long> bounds(threads + 1, size_);
+    for (int t = 0; t < threads; ++t) {
+        bounds[t] = lineStart(static_cast<long long>(size_ / threads * t));
+    }
+
+    // lines starting in each byte range
+    vector<vector<long long>> parts(threads);
+    auto find = [&](int t) {
+        vector<long long>& offsets = parts[t];
+        const char* end = data_ + bounds[t + 1];
+        for (const char* p = data_ + bounds[t]; p < end; p = lineEnd(p, end) + 1) {
+            offsets.push_back(p - data_);
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.push_back(thread(find, t));
+    }
+    find(0);
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+
+    vector<long long> offsets;
+    for (auto it = parts.begin(); it != parts.end(); ++it) {
+        offsets.insert(offsets.end(), it->begin(), it->end());
+    }
+    offsets.push_back(size_);
+    return offsets;
+}
+
+namespace {
+
+const char index_magic[4] = {'M', 'V', 'P', 'I'};
+const uint32_t index_version = 1;
+
+long long modificationTime(const string& filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        throw runtime_error("couldn't stat file " + filename);
+    }
+    return static_cast<long long>(st.st_mtime);
+}
+
+/**
+ * @brief Identifies the version of the corpus the index was built for
+ */
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    long long src_size, src_time;
+    long long trg_size, trg_time;
+    long long pairs;
+
+    IndexHeader() {}
+
+    IndexHeader(const Corpus& src, const Corpus& trg, size_t pairs) :
+        version(index_version), src_size(src.size()), src_time(modificationTime(src.name())),
+        trg_size(trg.size()), trg_time(modificationTime(trg.name())), pairs(pairs) {
+        memcpy(magic, index_magic, sizeof(magic));
+    }
+
+    bool matches(const IndexHeader& other) const {
+        return memcmp(magic, other.magic, sizeof(magic)) == 0 && version == other.version &&
+               src_size == other.src_size && src_time == other.src_time &&
+               trg_size == other.trg_size && trg_time == other.trg_time;
+    }
+};
+
+} // namespace
+
+ParallelIndex::ParallelIndex(const Corpus& src, const Corpus& trg, int threads) :
+    src_offsets(src.lineOffsets(threads)), trg_offsets(trg.lineOffsets(threads)) {
+    // ignore the extra lines of the longest file
+    size_t pairs = min(src_offsets.size(), trg_offsets.size()) - 1;
+    src_offsets.resize(pairs + 1);
+    trg_offsets.resize(pairs + 1);
+}
+
+void ParallelIndex::chunkify(const Corpus& src, const Corpus& trg, int n_chunks, vector<Chunk>& src_chunks,
+                             vector<Chunk>& trg_chunks, int threads, int shard, int shards) const {
+    src_chunks.assign(n_chunks, Chunk());
+    trg_chunks.assign(n_chunks, Chunk());
+    if (pairs() == 0) return;
+
+    long long size = src_offsets.back();
+    long long total = static_cast<long long>(n_chunks) * shards;
+    vector<size_t> first_lines(n_chunks + 1, pairs());
+    for (int i = 0; i <= n_chunks; ++i) {
+        long long k = static_cast<long long>(shard) * n_chunks + i;
+        if (k >= total) break;
+        long long pos = size / total * k;
+        first_lines[i] = lower_bound(src_offsets.begin(), src_offsets.end() - 1, pos) - src_offsets.begin();
+    }
+
+    for (int i = 0; i < n_chunks; ++i) {
+        src_chunks[i].begin = src_offsets[first_lines[i]];
+        src_chunks[i].end = src_offsets[first_lines[i + 1]];
+        trg_chunks[i].begin = trg_offsets[first_lines[i]];
+        trg_chunks[i].end = trg_offsets[first_lines[i + 1]];
+    }
+
+    countChunks(src.data(), src_chunks, threads);
+    countChunks(trg.data(), trg_chunks, threads);
+}
+
+void ParallelIndex::save(const string& filename, const Corpus& src, const Corpus& trg) const {
+    IndexHeader header(src, trg, pairs());
+    ofstream outfile(filename, ios::binary);
+    if (!outfile.is_open()) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(reinterpret_cast<const char*>(src_offsets.data()), sizeof(long long) * src_offsets.size());
+    outfile.write(reinterpret_cast<const char*>(trg_offsets.data()), sizeof(long long) * trg_offsets.size());
+    if (!outfile) {
+        throw runtime_error("couldn't save index to " + filename);
+    }
+}
+
+bool ParallelIndex::load(const string& filename, const Corpus& src, const Corpus& trg) {
+    ifstream infile(filename, ios::binary);
+    IndexHeader header;
+    if (!infile.is_open() || !infile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !header.matches(IndexHeader(src, trg, 0)) || header.pairs < 0) {
+        return false;
+    }
+
+    vector<long long> src_offsets(header.pairs + 1), trg_offsets(header.pairs + 1);
+    infile.read(reinterpret_cast<char*>(src_offsets.data()), sizeof(long long) * src_offsets.size());
+    infile.read(reinterpret_cast<char*>(trg_offsets.data()), sizeof(long long) * trg_offsets.size());
+    if (!infile || src_offsets.back() > header.src_size || trg_offsets.back() > header.trg_size) {
+        return false;
+    }
+
+    this->src_offsets.swap(src_offsets);
+    this->trg_offsets.swap(trg_offsets);
+    return true;
+}
+
+bool ChunkScheduler::next(int& epoch, size_t& chunk) {
+    long long task = next_.fetch_add(1);
+    if (chunks_ == 0 || task >= chunks_ * epochs_) {
+        return false;
+    }
+    epoch = static_cast<int>(task / chunks_);
+    chunk = static_cast<size_t>(task % chunks_);
+
+    long long barrier = epoch * chunks_; // tasks of the previous epochs
+    if (interval_ > 0) {
+        barrier = max(barrier, task / interval_ * interval_); // tasks before the last checkpoint
+    }
+    if (sync_interval_ > 0) {
+        barrier = max(barrier, task / sync_interval_ * sync_interval_); // tasks before the last synchronization
+    }
+    if (released_ < barrier) {
+        unique_lock<mutex> lock(mutex_);
+        epoch_done_.wait(lock, [&]() { return released_ >= barrier; });
+    }
+    return true;
+}
+
+void ChunkScheduler::done() {
+    long long tasks = ++done_;
+    bool checkpoint = interval_ > 0 && tasks % interval_ == 0 && tasks < chunks_ * epochs_;
+    bool sync = sync_interval_ > 0 && tasks % sync_interval_ == 0 && tasks < chunks_ * epochs_;
+    if (tasks % chunks_ == 0 || checkpoint || sync) { // last chunk of an epoch, checkpoint or synchronization
+        lock_guard<mutex> lock(mutex_);
+        if (sync) {
+            sync_();
+        }
+        if (checkpoint) {
+            checkpoint_(tasks); // the other threads are waiting for the barrier, or for the end of training
+        }
+        released_ = tasks;
+        epoch_done_.notify_all();
+    }
+}
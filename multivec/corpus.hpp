@@ -0,0 +1,167 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "mapping.hpp"
+
+/**
+ * @brief Range of lines of a corpus, trained as one unit of work (see ChunkScheduler).
+ */
+struct Chunk {
+    long long begin; // byte offset of the first line
+    long long end; // byte offset after the last line
+    long long first_line; // line number of the first line (used as sentence id)
+    long long lines;
+    long long words;
+
+    Chunk() : begin(0), end(0), first_line(0), lines(0), words(0) {}
+};
+
+/**
+ * @brief Read-only, memory-mapped text file (one sentence per line). Threads tokenize their
+ * lines directly from the mapped pages, without copying them into strings.
+ */
+class Corpus {
+    std::string filename;
+    MappedFile file;
+    const char* data_;
+    size_t size_;
+
+public:
+    explicit Corpus(const std::string& filename);
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& name() const { return filename; }
+
+    /**
+     * @brief End of the line starting at `p` (position of its newline character, or `end`)
+     */
+    static const char* lineEnd(const char* p, const char* end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        return eol == nullptr ? end : eol;
+    }
+
+    long long lineStart(long long pos) const; // offset of the first line starting at or after `pos`
+
+    /**
+     * @brief Divide the corpus into `n_chunks` chunks of roughly the same size in bytes, whose
+     * boundaries are snapped to the beginning of a line. Lines and words are counted in parallel
+     * (by `threads` threads).
+     *
+     * With several shards (e.g. one per process of a distributed training), the corpus is divided into
+     * `shards` * `n_chunks` chunks, and only the chunks of `shard` are returned and counted (their line
+     * numbers start at 0).
+     */
+    std::vector<Chunk> chunkify(int n_chunks, int threads = 1, int shard = 0, int shards = 1) const;
+
+    /**
+     * @brief Byte offset of the beginning of each line, followed by the size of the file (number of
+     * lines + 1 values). The lines are found in parallel (by `threads` threads).
+     */
+    std::vector<long long> lineOffsets(int threads = 1) const;
+};
+
+/**
+ * @brief Line offsets of both sides of a parallel corpus (line i of the source file is aligned with line i
+ * of the target file), found in one pass over each file. Both sides are chunked at the same line numbers,
+ * so that the target chunks can't drift from their source chunks. If one file has more lines, its extra
+ * lines are ignored.
+ *
+ * The index can be saved, and it is loaded back only if the files still have the same size and
+ * modification time.
+ */
+class ParallelIndex {
+    std::vector<long long> src_offsets; // pairs() + 1 values: beginning of each line, then end of the last line
+    std::vector<long long> trg_offsets;
+
+public:
+    ParallelIndex() {}
+    ParallelIndex(const Corpus& src, const Corpus& trg, int threads = 1);
+
+    size_t pairs() const { return src_offsets.empty() ? 0 : src_offsets.size() - 1; }
+
+    /**
+     * @brief Divide both sides into `n_chunks` chunks at the same line numbers, with roughly the same
+     * number of source bytes in each chunk. Lines and words are counted in parallel. Shards are the same
+     * as in Corpus::chunkify.
+     */
+    void chunkify(const Corpus& src, const Corpus& trg, int n_chunks, std::vector<Chunk>& src_chunks,
+                  std::vector<Chunk>& trg_chunks, int threads = 1, int shard = 0, int shards = 1) const;
+
+    void save(const std::string& filename, const Corpus& src, const Corpus& trg) const;
+
+    /**
+     * @return false if there is no index in `filename`, or if it was built for other files (or versions of them)
+     */
+    bool load(const std::string& filename, const Corpus& src, const Corpus& trg);
+};
+
+/**
+ * @brief Hands out chunks to the training threads, for a number of epochs. There are many more chunks than
+ * threads, and each thread claims the next chunk (one atomic increment) when it is done with the previous
+ * one, so that threads whose lines are shorter don't sit idle while the others finish a fixed share.
+ *
+ * Epochs are separated by a barrier: the chunks of epoch k + 1 are claimed as soon as all the chunks of
+ * epoch k have been claimed, but they are only returned once all the chunks of epoch k are done (threads
+ * wait for at most the duration of a chunk).
+ *
+ * Checkpoints (see setCheckpoints) are taken at the same kind of barrier, every `interval` tasks: once all the
+ * tasks before the barrier are done, and before any of the following tasks is returned. The weights of a
+ * distributed training are synchronized at such barriers too (see setSynchronization).
+ */
+class ChunkScheduler {
+    const long long chunks_;
+    const int epochs_;
+    std::atomic<long long> next_; // next task (epoch * chunks + chunk)
+    std::atomic<long long> done_; // number of finished tasks
+    std::atomic<long long> released_; // last barrier reached (tasks after it can be returned)
+    std::mutex mutex_;
+    std::condition_variable epoch_done_;
+    long long interval_; // tasks between two checkpoints (0: no checkpoints)
+    std::function<void(long long)> checkpoint_;
+    long long sync_interval_; // tasks between two synchronizations (0: none)
+    std::function<void()> sync_;
+
+public:
+    static const int chunks_per_thread = 16; // number of chunks of the corpus for each training thread
+
+    /**
+     * @param start first task (epoch * chunks + chunk), to resume an interrupted training
+     */
+    ChunkScheduler(size_t chunks, int epochs, long long start = 0) :
+        chunks_(chunks), epochs_(epochs), next_(start), done_(start), released_(start), interval_(0),
+        sync_interval_(0) {}
+
+    /**
+     * @brief Call `checkpoint` with the number of finished tasks every `interval` tasks (except after the
+     * last task), while no thread is training a chunk. Must be called before the first call to next().
+     */
+    void setCheckpoints(long long interval, std::function<void(long long)> checkpoint) {
+        interval_ = interval;
+        checkpoint_ = checkpoint;
+    }
+
+    /**
+     * @brief Call `sync` every `interval` tasks (except after the last task), while no thread is training a
+     * chunk, before the checkpoint if there is one at the same barrier. Must be called before the first call
+     * to next().
+     */
+    void setSynchronization(long long interval, std::function<void()> sync) {
+        sync_interval_ = interval;
+        sync_ = sync;
+    }
+
+    /**
+     * @brief Claim the next chunk, waiting for the end of the previous epoch if needed. Each chunk returned
+     * by this method must be marked with done() when it is trained.
+     * @return false when all the chunks of all the epochs have been claimed
+     */
+    bool next(int& epoch, size_t& chunk);
+
+    void done();
+};
@@ -15,6 +15,14 @@ float MonolingualModel::similarity(const string& word1, const string& word2, int
         return 0.0;
     } else if (it1->second.index == it2->second.index) {
         return 1.0;
+    } else if (inference_policy != -1 && !unit_quantized.empty()) {
+        checkPolicy(policy);
+        vec v1(unit_quantized.cols());
+        unit_quantized.row(it1->second.index, v1.data());
+        return unit_quantized.dot(it2->second.index, v1.data());
+    } else if (inference_policy != -1) {
+        checkPolicy(policy);
+        return unit_embeddings[it1->second.index].dot(unit_embeddings[it2->second.index]);
     } else {
         vec v1 = wordVec(it1->second.index, policy);
         vec v2 = wordVec(it2->second.index, policy);
@@ -26,48 +34,158 @@ float MonolingualModel::distance(const string& word1, const string& word2, int p
     return 1 - similarity(word1, word2, policy);
 }
 
+vector<float> MonolingualModel::similarityBatch(const vector<string>& words1, const vector<string>& words2, int policy) const {
+    if (words1.size() != words2.size()) {
+        throw runtime_error("both lists should have the same size");
+    }
+    vector<float> res(words1.size());
+    for (size_t i = 0; i < words1.size(); ++i) {
+        res[i] = similarity(words1[i], words2[i], policy);
+    }
+    return res;
+}
+
+
+/**
+ * @brief Cosine similarity between word `index` and vector `v` of norm `v_norm`. In inference mode,
+ * only needs a dot product with the normalized embedding of this word.
+ */
+float MonolingualModel::cosine(int index, const vec& v, float v_norm, int policy) const {
+    if (inference_policy != -1 && !unit_quantized.empty()) {
+        return unit_quantized.dot(index, v.data()) / v_norm;
+    } else if (inference_policy != -1) {
+        return unit_embeddings[index].dot(v) / v_norm;
+    } else {
+        vec v2 = wordVec(index, policy);
+        return v2.dot(v) / (v2.norm() * v_norm);
+    }
+}
 
 static bool comp(const pair<string, float>& p1, const pair<string, float>& p2) {
     return p1.second > p2.second;
 }
 
 /**
- * @brief Return an ordered list of the `n` closest words to `word` according to cosine similarity.
+ * @brief Normalized embeddings of all the words for the given policy. In inference mode, those are
+ * precomputed (but dequantized into `storage` with a quantized model). Otherwise, they are computed into
+ * `storage` (the weights may change between calls).
  */
-vector<pair<string, float>> MonolingualModel::closest(const string& word, int n, int policy) const {
-    vector<pair<string, float>> res;
-    auto it = vocabulary.find(word);
+const mat& MonolingualModel::unitWeights(int policy, mat& storage) const {
+    if (inference_policy != -1 && !unit_quantized.empty()) {
+        checkPolicy(policy);
+        storage = unit_quantized.dequantize();
+        return storage;
+    } else if (inference_policy != -1) {
+        checkPolicy(policy);
+        return unit_embeddings;
+    }
 
-    if (it == vocabulary.end()) {
-        throw runtime_error("OOV word");
+    size_t v = vocabulary.size();
+    storage = mat(v, v == 0 ? 0 : wordVec(0, policy).size());
+    for (size_t i = 0; i < v; ++i) {
+        if (policy == 0 || config->negative == 0) {
+            storage[i] = input_weights[i];
+        } else {
+            storage[i] = wordVec(i, policy);
+        }
+        float norm = storage[i].norm();
+        if (norm > 0) storage[i] /= norm;
     }
+    return storage;
+}
 
-    int index = it->second.index;
-    vec v1 = wordVec(index, policy);
+/**
+ * @brief Build the approximate nearest neighbor index used by closest() when probes > 0. It is saved
+ * with the model (in a separate file, with an .ann extension), and loaded with it.
+ */
+void MonolingualModel::buildIndex(int lists, int policy) {
+    if (config->verbose)
+        std::cout << "Building index" << std::endl;
 
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        if (it->second.index != index) {
-            vec v2 = wordVec(it->second.index, policy);
-            res.push_back({it->second.word, cosineSimilarity(v1, v2)});
+    mat storage;
+    const mat& weights = unitWeights(policy, storage);
+    ann_index.build(weights, policy, lists, config->seed, config->threads);
+
+    if (config->verbose)
+        std::cout << "Index lists: " << ann_index.lists() << std::endl;
+}
+
+/**
+ * @brief Closest words to each row of `queries` (normalized), with the blocked top-k search of knn.hpp
+ * (on the quantized embeddings of a quantized model), or with the approximate index when `probes` > 0.
+ */
+vector<vector<pair<string, float>>> MonolingualModel::closest(const mat& queries, int n, int policy,
+                                                              const vector<int>& exclude, int probes) const {
+    vector<vector<Neighbor>> neighbors;
+    if (probes > 0) {
+        if (ann_index.empty()) {
+            throw runtime_error("no approximate nearest neighbor index (see buildIndex)");
+        } else if (ann_index.policy() != policy) {
+            throw runtime_error("the index was built for another policy");
         }
+        neighbors = ann_index.search(queries, n, probes, exclude, config->threads);
+    } else if (inference_policy != -1 && !unit_quantized.empty()) {
+        checkPolicy(policy);
+        neighbors = topK(unit_quantized, queries, n, exclude, config->threads);
+    } else {
+        mat storage;
+        const mat& weights = unitWeights(policy, storage);
+        neighbors = topK(weights, queries, n, exclude, config->threads);
     }
 
-    std::partial_sort(res.begin(), res.begin() + n, res.end(), comp);
-    if (res.size() > n) res.resize(n);
+    vector<vector<pair<string, float>>> res(neighbors.size());
+    for (size_t q = 0; q < neighbors.size(); ++q) {
+        for (auto it = neighbors[q].begin(); it != neighbors[q].end(); ++it) {
+            res[q].push_back({*words_by_index[it->index], it->score});
+        }
+    }
     return res;
 }
 
-vector<pair<string, float>> MonolingualModel::closest(const vec& v, int n, int policy) const {
-    vector<pair<string, float>> res;
+/**
+ * @brief Return an ordered list of the `n` closest words to `word` according to cosine similarity.
+ */
+vector<pair<string, float>> MonolingualModel::closest(const string& word, int n, int policy, int probes) const {
+    return closestBatch(vector<string>(1, word), n, policy, probes)[0];
+}
 
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        vec v2 = wordVec(it->second.index, policy);
-        res.push_back({it->second.word, cosineSimilarity(v, v2)});
+/**
+ * @brief Same as closest, for a batch of words. This is much faster than calling closest for each word,
+ * as the vocabulary is only scanned once (and the normalized weights only computed once).
+ */
+vector<vector<pair<string, float>>> MonolingualModel::closestBatch(const vector<string>& words, int n, int policy,
+                                                                   int probes) const {
+    vector<int> indices;
+    for (auto it = words.begin(); it != words.end(); ++it) {
+        auto node_it = vocabulary.find(*it);
+        if (node_it == vocabulary.end()) {
+            throw runtime_error("OOV word");
+        }
+        indices.push_back(node_it->second.index);
     }
 
-    std::partial_sort(res.begin(), res.begin() + n, res.end(), comp);
-    if (res.size() > n) res.resize(n);
-    return res;
+    mat queries;
+    if (!indices.empty()) {
+        vec v = wordVec(indices[0], policy);
+        queries = mat(indices.size(), v.size());
+        for (size_t q = 0; q < indices.size(); ++q) {
+            queries[q] = wordVec(indices[q], policy);
+            float norm = queries[q].norm();
+            if (norm > 0) queries[q] /= norm;
+        }
+    }
+
+    return closest(queries, n, policy, indices, probes); // the query words are excluded from their results
+}
+
+vector<pair<string, float>> MonolingualModel::closest(const vec& v, int n, int policy, int probes) const {
+    checkPolicy(policy);
+    mat queries(1, v.size());
+    queries[0] = v;
+    float norm = v.norm();
+    if (norm > 0) queries[0] /= norm;
+
+    return closest(queries, n, policy, vector<int>(), probes)[0];
 }
 
 /**
@@ -83,12 +201,12 @@ vector<pair<string, float>> MonolingualModel::closest(const string& word, const
 
     int index = it->second.index;
     vec v1 = wordVec(index, policy);
+    float norm = v1.norm();
 
     for (auto it = words.begin(); it != words.end(); ++it) {
         auto node_it = vocabulary.find(*it);
         if (node_it != vocabulary.end()) {
-            vec v2 = wordVec(node_it->second.index, policy);
-            res.push_back({node_it->second.word, cosineSimilarity(v1, v2)});
+            res.push_back({node_it->second.word, cosine(node_it->second.index, v1, norm, policy)});
         }
     }
 
@@ -96,22 +214,174 @@ vector<pair<string, float>> MonolingualModel::closest(const string& word, const
     return res;
 }
 
+namespace {
+
+struct Question {
+    int words[4]; // a is to b what c is to d
+    int topic;
+};
+
+const size_t analogy_block_size = 128; // candidate words multiplied with all the questions of a thread at once
+
+float percent(int n, int total) {
+    return total == 0 ? 0.0 : 100.0 * n / total;
+}
+
+} // namespace
+
+/**
+ * @brief Evaluate the word embeddings on analogical reasoning questions (e.g. word2vec/questions-words.txt):
+ * lines "a b c d", grouped by topics (lines starting with ':'). The answer to a question is the word whose
+ * normalized embedding is the closest to b - a + c, except a, b and c. Prints the accuracy of each topic
+ * and the total accuracy to `output`, like compute-accuracy.
+ *
+ * The questions are encoded into word indices once, and then answered all together: each thread takes an
+ * equal share of the questions, and goes through the candidate words block by block (a block stays in cache
+ * while it is multiplied with all the thread's questions).
+ *
+ * @param max_voc only use the `max_voc` most frequent words (0: all the words). Questions with rarer words
+ * are skipped.
+ * @return total accuracy (in %)
+ */
+float MonolingualModel::analogicalReasoning(const string& filename, int max_voc, int policy, ostream& output) const {
+    ifstream infile(filename);
+    check_is_open(infile, filename);
+
+    // candidate answers: the most frequent words (rows of the normalized weights, which aren't copied)
+    vector<int> candidates(vocabulary.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        candidates[i] = i;
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [this](int i, int j) {
+        return word_counts[i] > word_counts[j];
+    });
+    if (max_voc > 0 && static_cast<size_t>(max_voc) < candidates.size()) {
+        candidates.resize(max_voc);
+    }
+    vector<bool> is_candidate(vocabulary.size(), false);
+    for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+        is_candidate[*it] = true;
+    }
+
+    vector<string> topics;
+    vector<int> topic_questions; // including the skipped questions
+    vector<Question> questions;
+    string line;
+    while (getline(infile, line)) {
+        if (line.empty()) continue;
+        if (line[0] == ':' || topics.empty()) {
+            topics.push_back(line[0] == ':' ? (line.size() > 2 ? line.substr(2) : "") : "");
+            topic_questions.push_back(0);
+            if (line[0] == ':') continue;
+        }
+
+        ++topic_questions.back();
+        auto words = split(lower(line));
+        Question question;
+        question.topic = topics.size() - 1;
+        bool known = words.size() == 4;
+        for (size_t k = 0; known && k < 4; ++k) {
+            auto it = vocabulary.find(words[k]);
+            known = it != vocabulary.end() && is_candidate[it->second.index];
+            if (known) question.words[k] = it->second.index;
+        }
+        if (known) questions.push_back(question);
+    }
+
+    // with a quantized model, the candidates are scored on the quantized embeddings
+    bool quantized = inference_policy != -1 && !unit_quantized.empty();
+    mat storage;
+    const mat& weights = quantized ? storage : unitWeights(policy, storage);
+    size_t dim = quantized ? unit_quantized.cols() : weights.cols();
+    if (quantized) checkPolicy(policy);
+
+    mat queries(questions.size(), dim);
+    vec v0(dim), v1(dim), v2(dim);
+    for (size_t q = 0; q < questions.size(); ++q) {
+        const int* w = questions[q].words;
+        if (quantized) {
+            unit_quantized.row(w[0], v0.data());
+            unit_quantized.row(w[1], v1.data());
+            unit_quantized.row(w[2], v2.data());
+            queries[q] = v1 - v0 + v2;
+        } else {
+            queries[q] = weights[w[1]] - weights[w[0]] + weights[w[2]];
+        }
+    }
+
+    vector<int> answers(questions.size(), -1);
+    auto answer = [&](size_t begin, size_t end) {
+        vector<float> best(end - begin, -numeric_limits<float>::infinity());
+        for (size_t block = 0; block < candidates.size(); block += analogy_block_size) {
+            size_t block_end = min(block + analogy_block_size, candidates.size());
+
+            for (size_t q = begin; q < end; ++q) {
+                const float* query = queries[q].data();
+                const int* w = questions[q].words;
+                for (size_t i = block; i < block_end; ++i) {
+                    int c = candidates[i];
+                    float score = quantized ? unit_quantized.dot(c, query) : simd::dot(weights[c].data(), query, dim);
+                    if (score <= best[q - begin] || c == w[0] || c == w[1] || c == w[2]) continue;
+                    best[q - begin] = score;
+                    answers[q] = c;
+                }
+            }
+        }
+    };
+
+    int n_threads = max(1, min<int>(config->threads, questions.size()));
+    vector<thread> threads;
+    for (int t = 1; t < n_threads; ++t) {
+        threads.push_back(thread(answer, questions.size() * t / n_threads, questions.size() * (t + 1) / n_threads));
+    }
+    answer(0, questions.size() / n_threads);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+
+    vector<int> topic_correct(topics.size(), 0), topic_total(topics.size(), 0);
+    for (size_t q = 0; q < questions.size(); ++q) {
+        ++topic_total[questions[q].topic];
+        if (answers[q] == questions[q].words[3]) ++topic_correct[questions[q].topic];
+    }
+
+    int correct = 0, total = 0, n_questions = 0;
+    int gram_correct = 0, gram_total = 0;
+    for (size_t t = 0; t < topics.size(); ++t) {
+        correct += topic_correct[t];
+        total += topic_total[t];
+        n_questions += topic_questions[t];
+        if (topics[t].find("gram") == 0) {
+            gram_correct += topic_correct[t];
+            gram_total += topic_total[t];
+        }
+        output << topics[t] << ":\n\taccuracy: " << std::setprecision(3) << percent(topic_correct[t], topic_total[t]) << "%\n";
+    }
+
+    output << "Total accuracy: " << std::setprecision(3) << percent(correct, total) << "%\n";
+    output << "Syntactic accuracy: " << std::setprecision(3) << percent(gram_correct, gram_total) << "%, "
+           << "Semantic accuracy: " << std::setprecision(3) << percent(correct - gram_correct, total - gram_total) << "%\n";
+    output << "Questions seen: " << total << "/" << n_questions << ", "
+           << std::setprecision(3) << percent(total, n_questions) << "%" << std::endl;
+    return percent(correct, total);
+}
+
 float MonolingualModel::similarityNgrams(const string& seq1, const string& seq2, int policy) const {
     auto words1 = split(seq1);
     auto words2 = split(seq2);
 
-    if (words2.size() != words2.size()) {
+    if (words1.size() != words2.size()) {
         throw runtime_error("input sequences don't have the same size");
     }
 
     float res = 0;
     int n = 0;
     for (size_t i = 0; i < words1.size(); ++i) {
-        try {
-            res += similarity(words1[i], words2[i], policy);
-            n += 1;
+        if (vocabulary.find(words1[i]) == vocabulary.end() || vocabulary.find(words2[i]) == vocabulary.end()) {
+            continue; // OOV pairs are ignored
         }
-        catch (runtime_error) {}
+        res += similarity(words1[i], words2[i], policy);
+        n += 1;
     }
 
     if (n == 0) {
@@ -126,7 +396,7 @@ void normalizeWeights(mat& weights) {
         return;
     }
 
-    int dim = weights[0].size();
+    int dim = weights.cols();
 
     vec min_values = weights[0];
     vec max_values = weights[0];
@@ -147,6 +417,15 @@ void normalizeWeights(mat& weights) {
 }
 
 void MonolingualModel::normalizeWeights() {
+    ann_index.clear(); // built from the old weights
+    if (inference_policy != -1 && !unit_quantized.empty()) {
+        throw runtime_error("the embeddings of this model are quantized");
+    } else if (inference_policy != -1) {
+        ::normalizeWeights(embeddings);
+        initUnitEmbeddings();
+        return;
+    }
+
     ::normalizeWeights(input_weights);
     ::normalizeWeights(output_weights);
     ::normalizeWeights(output_weights_hs);
@@ -154,24 +433,19 @@ void MonolingualModel::normalizeWeights() {
 }
 
 float MonolingualModel::similaritySentence(const string& seq1, const string& seq2, int policy) const {
-    auto words1 = split(seq1);
-    auto words2 = split(seq2);
+    vector<int> words1, words2;
+    getIndices(seq1, words1);
+    getIndices(seq2, words2);
     
     vec vec1(config->dimension);
     vec vec2(config->dimension);
     
     for (auto it = words1.begin(); it != words1.end(); ++it) {
-        try {
-            vec1 += wordVec(*it, policy);
-        }
-        catch (runtime_error) {}
+        if (*it != -1) vec1 += wordVec(*it, policy); // OOV words are ignored
     }
     
     for (auto it = words2.begin(); it != words2.end(); ++it) {
-        try {
-            vec2 += wordVec(*it, policy);
-        }
-        catch (runtime_error) {}
+        if (*it != -1) vec2 += wordVec(*it, policy);
     }
     
     float length = vec1.norm() * vec2.norm();
@@ -232,8 +506,9 @@ const static std::map<std::string, float> syntax_weights = {
 */
 float MonolingualModel::similaritySentenceSyntax(const string& seq1, const string& seq2, const string& tags1, const string& tags2,
                                                  const vector<float>& idf1, const vector<float>& idf2, float alpha, int policy) const {
-    auto words1 = split(seq1);
-    auto words2 = split(seq2);
+    vector<int> words1, words2;
+    getIndices(seq1, words1);
+    getIndices(seq2, words2);
     auto pos_tags1 = split(tags1);
     auto pos_tags2 = split(tags2);
     
@@ -241,17 +516,13 @@ float MonolingualModel::similaritySentenceSyntax(const string& seq1, const strin
     vec vec2(config->dimension);
     
     for (size_t i = 0; i < words1.size() && i < pos_tags1.size() && i < idf1.size(); ++i) {
-        try {
-            vec1 += wordVec(words1[i], policy) * pow(syntax_weights.at(pos_tags1[i]), 1 - alpha) * pow(idf1[i], alpha);
-        }
-        catch (runtime_error) {}
+        if (words1[i] == -1) continue; // OOV words are ignored
+        vec1 += wordVec(words1[i], policy) * pow(syntax_weights.at(pos_tags1[i]), 1 - alpha) * pow(idf1[i], alpha);
     }
     
     for (size_t i = 0; i < words2.size() && i < pos_tags2.size() && i < idf2.size(); ++i) {
-        try {
-            vec2 += wordVec(words2[i], policy) * pow(syntax_weights.at(pos_tags2[i]), 1 - alpha) * pow(idf2[i], alpha);
-        }
-        catch (runtime_error) {}
+        if (words2[i] == -1) continue;
+        vec2 += wordVec(words2[i], policy) * pow(syntax_weights.at(pos_tags2[i]), 1 - alpha) * pow(idf2[i], alpha);
     }
     
     float length = vec1.norm() * vec2.norm();
@@ -263,31 +534,131 @@ float MonolingualModel::similaritySentenceSyntax(const string& seq1, const strin
     }
 }
 
+/**
+ * @brief Normalized embeddings of the given words (nullptr for OOV words), which point into
+ * `storage` unless they are precomputed (inference mode, without quantization). Returns their dimension.
+ */
+size_t MonolingualModel::unitVectors(const vector<int>& indices, int policy, vector<float>& storage,
+                                     vector<const float*>& units) const {
+    units.assign(indices.size(), nullptr);
+    if (inference_policy != -1 && unit_quantized.empty()) {
+        checkPolicy(policy);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] != -1) units[i] = unit_embeddings[indices[i]].data();
+        }
+        return unit_embeddings.cols();
+    }
+
+    size_t dim = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] == -1) continue;
+        vec v = wordVec(indices[i], policy);
+        if (dim == 0) {
+            dim = v.size();
+            storage.resize(indices.size() * dim);
+        }
+        float norm = v.norm();
+        float* unit = storage.data() + i * dim;
+        for (size_t c = 0; c < dim; ++c) {
+            unit[c] = norm > 0 ? v[c] / norm : 0;
+        }
+    }
+    for (size_t i = 0; i < indices.size(); ++i) { // storage may have moved
+        if (indices[i] != -1) units[i] = storage.data() + i * dim;
+    }
+    return dim;
+}
+
+/**
+ * @brief Soft Word Error Rate: edit distance between `hyp` and `ref`, where the cost of substituting
+ * a word by another is their cosine distance (1 if one of them is OOV), divided by the length of `ref`.
+ */
 float MonolingualModel::softWER(const string& hyp, const string& ref, int policy) const {
-    auto s1 = split(hyp);
-    auto s2 = split(ref);
-	const size_t len1 = s1.size(), len2 = s2.size();
-	vector<vector<float>> d(len1 + 1, vector<float>(len2 + 1));
-
-	d[0][0] = 0;
-	for (size_t i = 1; i <= len1; ++i) d[i][0] = i;
-	for (size_t i = 1; i <= len2; ++i) d[0][i] = i;
-
-	for (size_t i = 1; i <= len1; ++i) {
-		for (size_t j = 1; j <= len2; ++j) {
-		    // uses distance between word embeddings as a substitution cost
-		    // FIXME: distances tend to be well below 1, even for very different words.
-		    // This is rather unbalanced with deletion and insertion costs, which remain at 1.
-		    // Also, distance can (but will rarely) be greater than 1.
-            float sub_cost = distance(s1[i - 1], s2[j - 1], policy);
-            
-            d[i][j] = min({ d[i - 1][j] + 1,  // deletion
-                            d[i][j - 1] + 1,  // insertion
-                            d[i - 1][j - 1] + sub_cost });  // substitution
+    ScoringContext ctx;
+    return softWER(ctx, hyp, ref, policy);
+}
+
+/**
+ * @brief softWER with the buffers of `ctx`. The words of each sentence are looked up and normalized
+ * once, and all the substitution costs are computed at once (product of the two sentence matrices),
+ * before the dynamic programming, which only keeps one row of the distance matrix.
+ */
+float MonolingualModel::softWER(ScoringContext& ctx, const string& hyp, const string& ref, int policy) const {
+    getIndices(hyp, ctx.words1);
+    getIndices(ref, ctx.words2);
+    const size_t len1 = ctx.words1.size(), len2 = ctx.words2.size();
+    size_t dim = max(unitVectors(ctx.words1, policy, ctx.storage1, ctx.units1),
+                     unitVectors(ctx.words2, policy, ctx.storage2, ctx.units2));
+
+    // uses distance between word embeddings as a substitution cost
+    // FIXME: distances tend to be well below 1, even for very different words.
+    // This is rather unbalanced with deletion and insertion costs, which remain at 1.
+    // Also, distance can (but will rarely) be greater than 1.
+    ctx.costs.resize(len1 * len2);
+    for (size_t i = 0; i < len1; ++i) {
+        float* costs = ctx.costs.data() + i * len2;
+        for (size_t j = 0; j < len2; ++j) {
+            int w1 = ctx.words1[i], w2 = ctx.words2[j];
+            if (w1 == -1 || w2 == -1) {
+                costs[j] = 1;  // same as distance() for OOV words
+            } else if (w1 == w2) {
+                costs[j] = 0;
+            } else {
+                costs[j] = 1 - simd::dot(ctx.units1[i], ctx.units2[j], dim);
+            }
         }
     }
-    
-	return d[len1][len2] / len2;
+
+    vector<float>& d = ctx.row; // d[j]: distance between the first i words of hyp and the first j words of ref
+    d.resize(len2 + 1);
+    for (size_t j = 0; j <= len2; ++j) d[j] = j;
+
+    for (size_t i = 1; i <= len1; ++i) {
+        const float* costs = ctx.costs.data() + (i - 1) * len2;
+        float diagonal = d[0]; // d[i - 1][j - 1]
+        d[0] = i;
+        for (size_t j = 1; j <= len2; ++j) {
+            float value = min({ d[j] + 1,  // deletion
+                                d[j - 1] + 1,  // insertion
+                                diagonal + costs[j - 1] });  // substitution
+            diagonal = d[j];
+            d[j] = value;
+        }
+    }
+
+    return d[len2] / len2;
+}
+
+/**
+ * @brief softWER of each pair (hyps[i], refs[i]). The pairs are distributed dynamically among the
+ * threads, which each reuse their own buffers.
+ */
+vector<float> MonolingualModel::softWERBatch(const vector<string>& hyps, const vector<string>& refs, int policy) const {
+    if (hyps.size() != refs.size()) {
+        throw runtime_error("there should be as many hypotheses as references");
+    }
+
+    vector<float> scores(hyps.size());
+    atomic<size_t> next(0);
+    int n_threads = max(1, min<int>(config->threads, hyps.size() / 16));
+    vector<string> errors(n_threads);
+
+    parallelFor(n_threads, [&](int t) {
+        ScoringContext ctx;
+        try {
+            for (size_t i; (i = next++) < hyps.size(); ) {
+                scores[i] = softWER(ctx, hyps[i], refs[i], policy);
+            }
+        } catch (runtime_error& e) {
+            errors[t] = e.what();
+            next = hyps.size();
+        }
+    });
+
+    for (auto it = errors.begin(); it != errors.end(); ++it) {
+        if (!it->empty()) throw runtime_error(*it);
+    }
+    return scores;
 }
 
 
@@ -309,6 +680,10 @@ float BilingualModel::similarity(const string& src_word, const string& trg_word,
 
     if (it1 == src_model.vocabulary.end() || it2 == trg_model.vocabulary.end()) {
         return 0.0;
+    } else if (src_model.inference_policy != -1 && src_model.unit_quantized.empty()
+               && trg_model.unit_quantized.empty()) {
+        src_model.checkPolicy(policy);
+        return src_model.unit_embeddings[it1->second.index].dot(trg_model.unit_embeddings[it2->second.index]);
     } else {
         vec v1 = src_model.wordVec(it1->second.index, policy);
         vec v2 = trg_model.wordVec(it2->second.index, policy);
@@ -352,18 +727,19 @@ float BilingualModel::similarityNgrams(const string& src_seq, const string& trg_
     auto src_words = split(src_seq);
     auto trg_words = split(trg_seq);
 
-    if (trg_words.size() != trg_words.size()) {
+    if (src_words.size() != trg_words.size()) {
         throw runtime_error("input sequences don't have the same size");
     }
 
     float res = 0;
     int n = 0;
     for (size_t i = 0; i < src_words.size(); ++i) {
-        try {
-            res += similarity(src_words[i], trg_words[i], policy);
-            n += 1;
+        if (src_model.vocabulary.find(src_words[i]) == src_model.vocabulary.end() ||
+            trg_model.vocabulary.find(trg_words[i]) == trg_model.vocabulary.end()) {
+            continue; // OOV pairs are ignored
         }
-        catch (runtime_error) {}
+        res += similarity(src_words[i], trg_words[i], policy);
+        n += 1;
     }
 
     if (n == 0) {
@@ -374,24 +750,19 @@ float BilingualModel::similarityNgrams(const string& src_seq, const string& trg_
 }
 
 float BilingualModel::similaritySentence(const string& src_seq, const string& trg_seq, int policy) const {
-    auto src_words = split(src_seq);
-    auto trg_words = split(trg_seq);
+    vector<int> src_words, trg_words;
+    src_model.getIndices(src_seq, src_words);
+    trg_model.getIndices(trg_seq, trg_words);
     
     vec src_vec(config->dimension);
     vec trg_vec(config->dimension);
     
     for (auto it = src_words.begin(); it != src_words.end(); ++it) {
-        try {
-            src_vec += src_model.wordVec(*it, policy);
-        }
-        catch (runtime_error) {}
+        if (*it != -1) src_vec += src_model.wordVec(*it, policy); // OOV words are ignored
     }
     
     for (auto it = trg_words.begin(); it != trg_words.end(); ++it) {
-        try {
-            trg_vec += trg_model.wordVec(*it, policy);
-        }
-        catch (runtime_error) {}
+        if (*it != -1) trg_vec += trg_model.wordVec(*it, policy);
     }
     
     float length = src_vec.norm() * trg_vec.norm();
@@ -417,8 +788,9 @@ float BilingualModel::similaritySentence(const string& src_seq, const string& tr
 */
 float BilingualModel::similaritySentenceSyntax(const string& src_seq, const string& trg_seq, const string& src_tags, const string& trg_tags,
                                                const vector<float>& src_idf, const vector<float>& trg_idf, float alpha, int policy) const {    
-    auto src_words = split(src_seq);
-    auto trg_words = split(trg_seq);
+    vector<int> src_words, trg_words;
+    src_model.getIndices(src_seq, src_words);
+    trg_model.getIndices(trg_seq, trg_words);
     auto src_pos_tags = split(src_tags);
     auto trg_pos_tags = split(trg_tags);
     
@@ -426,16 +798,12 @@ float BilingualModel::similaritySentenceSyntax(const string& src_seq, const stri
     vec trg_vec(config->dimension);
     
     for (size_t i = 0; i < src_words.size() && i < src_pos_tags.size() && i < src_idf.size(); ++i) {
-        try {
-            src_vec += src_model.wordVec(src_words[i], policy) * pow(syntax_weights.at(src_pos_tags[i]), 1 - alpha) * pow(src_idf[i], alpha);
-        }
-        catch (runtime_error) {}
+        if (src_words[i] == -1) continue; // OOV words are ignored
+        src_vec += src_model.wordVec(src_words[i], policy) * pow(syntax_weights.at(src_pos_tags[i]), 1 - alpha) * pow(src_idf[i], alpha);
     }
     for (size_t i = 0; i < trg_words.size() && i < trg_pos_tags.size() && i < trg_idf.size(); ++i) {
-        try {
-            trg_vec += trg_model.wordVec(trg_words[i], policy) * pow(syntax_weights.at(trg_pos_tags[i]), 1 - alpha) * pow(trg_idf[i], alpha);
-        }
-        catch (runtime_error) {}
+        if (trg_words[i] == -1) continue;
+        trg_vec += trg_model.wordVec(trg_words[i], policy) * pow(syntax_weights.at(trg_pos_tags[i]), 1 - alpha) * pow(trg_idf[i], alpha);
     }
     
     float length = src_vec.norm() * trg_vec.norm();
@@ -0,0 +1,96 @@
+#include "knn.hpp"
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const size_t block_size = 128; // rows of `weights` multiplied with all the queries at once
+const double parallel_threshold = 1 << 22; // minimum number of multiply-adds worth spawning threads
+
+// rows of a Mat, with the same interface as QuantizedMat
+struct DenseRows {
+    const Mat& m;
+    size_t rows() const { return m.rows(); }
+    size_t cols() const { return m.cols(); }
+    bool empty() const { return m.empty(); }
+    float dot(size_t i, const float* x) const { return simd::dot(m[i].data(), x, m.cols()); }
+};
+
+template<typename Rows>
+void searchRows(const Rows& weights, const Mat& queries, size_t k, const vector<int>& exclude,
+                size_t begin, size_t end, vector<vector<Neighbor>>& heaps) {
+    for (size_t block = begin; block < end; block += block_size) {
+        size_t block_end = min(block + block_size, end);
+
+        for (size_t q = 0; q < queries.rows(); ++q) {
+            const float* query = queries[q].data();
+            vector<Neighbor>& heap = heaps[q];
+            int skip = exclude.empty() ? -1 : exclude[q];
+
+            for (size_t i = block; i < block_end; ++i) {
+                float score = weights.dot(i, query);
+                if (heap.size() == k && score < heap.front().score) continue; // fast path
+                if (static_cast<int>(i) == skip) continue;
+                pushNeighbor(heap, k, {static_cast<int>(i), score});
+            }
+        }
+    }
+}
+
+template<typename Rows>
+vector<vector<Neighbor>> search(const Rows& weights, const Mat& queries, int k, const vector<int>& exclude, int threads) {
+    size_t n = queries.rows();
+    vector<vector<Neighbor>> results(n);
+    if (k <= 0 || weights.empty()) return results;
+    if (queries.cols() != weights.cols()) {
+        throw runtime_error("dimension mismatch");
+    }
+
+    double cost = static_cast<double>(weights.rows()) * n * weights.cols();
+    threads = cost < parallel_threshold ? 1 : max(1, min<int>(threads, (weights.rows() + block_size - 1) / block_size));
+
+    if (threads == 1) {
+        searchRows(weights, queries, k, exclude, 0, weights.rows(), results);
+    } else {
+        // each thread searches a range of rows (a whole number of blocks) with its own heaps
+        vector<vector<vector<Neighbor>>> heaps(threads, vector<vector<Neighbor>>(n));
+        size_t blocks = (weights.rows() + block_size - 1) / block_size;
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            size_t begin = min(weights.rows(), blocks * t / threads * block_size);
+            size_t end = min(weights.rows(), blocks * (t + 1) / threads * block_size);
+            workers.push_back(thread(searchRows<Rows>, std::cref(weights), std::cref(queries), k, std::cref(exclude),
+                                     begin, end, std::ref(heaps[t])));
+        }
+        for (auto it = workers.begin(); it != workers.end(); ++it) {
+            it->join();
+        }
+
+        for (int t = 0; t < threads; ++t) {
+            for (size_t q = 0; q < n; ++q) {
+                for (auto it = heaps[t][q].begin(); it != heaps[t][q].end(); ++it) {
+                    pushNeighbor(results[q], k, *it);
+                }
+            }
+        }
+    }
+
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        sort_heap(it->begin(), it->end(), betterNeighbor);
+    }
+    return results;
+}
+
+} // namespace
+
+vector<vector<Neighbor>> topK(const Mat& weights, const Mat& queries, int k, const vector<int>& exclude, int threads) {
+    return search(DenseRows{weights}, queries, k, exclude, threads);
+}
+
+vector<vector<Neighbor>> topK(const QuantizedMat& weights, const Mat& queries, int k, const vector<int>& exclude,
+                              int threads) {
+    return search(weights, queries, k, exclude, threads);
+}
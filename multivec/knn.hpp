@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "vec.hpp"
+#include "quantized.hpp"
+
+struct Neighbor {
+    int index; // row in the searched matrix
+    float score;
+};
+
+// heap order of the bounded heaps below: the worst neighbor is at the front
+inline bool betterNeighbor(const Neighbor& a, const Neighbor& b) {
+    return a.score > b.score || (a.score == b.score && a.index < b.index);
+}
+
+/**
+ * @brief Add `n` to a heap of at most `k` neighbors, replacing its worst neighbor when it is full.
+ * std::sort_heap(heap.begin(), heap.end(), betterNeighbor) then sorts them from best to worst.
+ */
+inline void pushNeighbor(std::vector<Neighbor>& heap, size_t k, Neighbor n) {
+    if (heap.size() < k) {
+        heap.push_back(n);
+        std::push_heap(heap.begin(), heap.end(), betterNeighbor);
+    } else if (betterNeighbor(n, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), betterNeighbor);
+        heap.back() = n;
+        std::push_heap(heap.begin(), heap.end(), betterNeighbor);
+    }
+}
+
+/**
+ * @brief Exact top-k search: find the `k` rows of `weights` that have the highest dot product with each
+ * row of `queries` (cosine similarity when both matrices are normalized).
+ *
+ * The product weights * queries^T is computed block by block: a block of rows of `weights` stays in cache
+ * while it is multiplied with all the queries, and the best rows for each query are kept in a bounded heap.
+ * With several threads, each thread searches a different range of rows, and their heaps are merged at the end.
+ *
+ * @param exclude row to skip for each query (e.g. the query word itself), or -1 (empty for no exclusion)
+ * @return for each query, its k best rows by decreasing score (ties by increasing index)
+ */
+std::vector<std::vector<Neighbor>> topK(const Mat& weights, const Mat& queries, int k,
+                                        const std::vector<int>& exclude = std::vector<int>(), int threads = 1);
+
+// same search on quantized rows (the queries stay in float)
+std::vector<std::vector<Neighbor>> topK(const QuantizedMat& weights, const Mat& queries, int k,
+                                        const std::vector<int>& exclude = std::vector<int>(), int threads = 1);
@@ -23,12 +23,31 @@ static vector<option_plus> options_plus = {
     {"subsampling",   required_argument, 0, 'j', "subsampling (usually between 1e-03 and 1e-05)"},
     {"sg",            no_argument,       0, 'k', "skip-gram model (default: CBOW)"},
     {"hs",            no_argument,       0, 'l', "hierarchical softmax (default off)"},
+    {"sigmoid-table", no_argument,       0, 'x', "read the sigmoid from a precomputed table during training (faster, as in word2vec)"},
     {"train-src",     required_argument, 0, 'm', "specify source file for training"},
     {"train-trg",     required_argument, 0, 'n', "specify target file for training"},
     {"load",          required_argument, 0, 'o', "load model"},
+    {"checkpoint",    required_argument, 0, 'A', "save the model and training state to this file during training (see --checkpoint-words)"},
+    {"checkpoint-words", required_argument, 0, 'B', "number of words trained between two checkpoints (default: 0, one checkpoint per epoch)"},
+    {"grow-vocab",    no_argument,       0, 'D', "with --load and training files: add their new words to the vocabularies"},
+    {"resume",        required_argument, 0, 'C', "load a checkpoint, and resume its training where it was interrupted (with --train-src and --train-trg on the same files)"},
     {"save",          required_argument, 0, 'p', "save model"},
     {"save-src",      required_argument, 0, 'q', "save source model"},
     {"save-trg",      required_argument, 0, 'r', "save target model"},
+    {"unigram-table", required_argument, 0, 's', "size of the negative sampling table (default: 0, alias sampling)"},
+    {"seed",          required_argument, 0, 't', "random seed (default: 1)"},
+    {"max-vocab",     required_argument, 0, 'u', "prune rare words while counting above this vocabulary size (default: 0, no limit)"},
+    {"precision",     required_argument, 0, 'w', "precision of the matrices of the saved models (float32, float16 or int8, default: float32)"},
+    {"pin-threads",   no_argument,       0, 'E', "pin the threads to CPUs spread over the NUMA nodes, with a copy of the sampler and Huffman codes on each node"},
+    {"numa-interleave", no_argument,     0, 'F', "interleave the weight matrices over the NUMA nodes"},
+    {"cluster",       required_argument, 0, 'G', "distributed training: host:port where process 0 listens (each process trains its shard of the training files)"},
+    {"cluster-rank",  required_argument, 0, 'H', "distributed training: number of this process (process 0 saves the model)"},
+    {"cluster-size",  required_argument, 0, 'I', "distributed training: number of processes"},
+    {"sync-words",    required_argument, 0, 'J', "distributed training: words trained by each process between two weight averagings (default: 0, one per epoch)"},
+    {"metrics",       required_argument, 0, 'K', "append training metrics to this file as JSON lines (words/sec per thread, updates, time of each phase)"},
+    {"metrics-interval", required_argument, 0, 'L', "seconds between two lines of --metrics (default: 10)"},
+    {"reader-threads", required_argument, 0, 'y', "threads which tokenize and align the sentence pairs ahead of the training threads (default: 0)"},
+    {"line-index",    required_argument, 0, 'z', "save the line index of the training files there, and reuse it if they haven't changed"},
     {0, 0, 0, 0, 0}
 };
 
@@ -52,6 +71,7 @@ int main(int argc, char **argv) {
     }
 
     string load_file;
+    string resume_file;
 
     // first pass on parameters to find out if a model file is provided
     while (1) {
@@ -61,6 +81,7 @@ int main(int argc, char **argv) {
 
         switch (opt) {
             case 'o': load_file = string(optarg);           break;
+            case 'C': resume_file = string(optarg);         break;
             default:                                        break;
         }
     }
@@ -69,7 +90,9 @@ int main(int argc, char **argv) {
     BilingualModel model(&config);
 
     // model file needs to be loaded before anything else (otherwise it overwrites the parameters)
-    if (!load_file.empty()) {
+    if (!resume_file.empty()) {
+        model.load(resume_file);
+    } else if (!load_file.empty()) {
         model.load(load_file);
     }
 
@@ -78,6 +101,7 @@ int main(int argc, char **argv) {
     string save_file;
     string save_src_file;
     string save_trg_file;
+    Precision precision = Precision::float32;
 
     optind = 0;  // necessary to parse arguments twice
     while (1) {
@@ -100,17 +124,36 @@ int main(int argc, char **argv) {
             case 'j': config.subsampling = atof(optarg);    break;
             case 'k': config.skip_gram = true;              break;
             case 'l': config.hierarchical_softmax = true;   break;
+            case 'x': config.sigmoid_table = true;          break;
             case 'm': train_src_file = string(optarg);      break;
             case 'n': train_trg_file = string(optarg);      break;
             case 'o':                                       break;
+            case 'A': config.checkpoint = string(optarg);   break;
+            case 'B': config.checkpoint_words = atoll(optarg); break;
+            case 'C':                                       break;
+            case 'D': config.grow_vocab = true;             break;
+            case 'E': config.pin_threads = true;            break;
+            case 'F': config.numa_interleave = true;        break;
+            case 'G': config.cluster = string(optarg);      break;
+            case 'H': config.cluster_rank = atoi(optarg);   break;
+            case 'I': config.cluster_size = atoi(optarg);   break;
+            case 'J': config.sync_words = atoll(optarg);    break;
+            case 'K': config.metrics_file = string(optarg); break;
+            case 'L': config.metrics_interval = atof(optarg); break;
             case 'p': save_file = string(optarg);           break;
             case 'q': save_src_file = string(optarg);       break;
             case 'r': save_trg_file = string(optarg);       break;
+            case 'w': precision = parsePrecision(optarg);   break;
+            case 's': config.unigram_table_size = atoll(optarg); break;
+            case 't': config.seed = atoi(optarg);           break;
+            case 'u': config.max_vocab_size = atoll(optarg); break;
+            case 'y': config.reader_threads = atoi(optarg); break;
+            case 'z': config.line_index = string(optarg);   break;
             default:                                        abort();
         }
     }
 
-    if (load_file.empty() && (train_src_file.empty() || train_trg_file.empty())) {
+    if (load_file.empty() && resume_file.empty() && (train_src_file.empty() || train_trg_file.empty())) {
         print_usage();
         return 0;
     }
@@ -118,18 +161,24 @@ int main(int argc, char **argv) {
     std::cout << "MultiVec-bi" << std::endl;
     config.print();
 
-    if (!train_src_file.empty() && !train_trg_file.empty()) {
+    if (!train_src_file.empty() && !train_trg_file.empty() && !resume_file.empty()) {
+        model.resume(train_src_file, train_trg_file, resume_file);
+    } else if (!train_src_file.empty() && !train_trg_file.empty()) {
         model.train(train_src_file, train_trg_file, load_file.empty());
     }
 
+    if (!config.cluster.empty() && config.cluster_rank != 0) {
+        return 0; // all the processes have the same model, which is saved by process 0
+    }
+
     if(!save_file.empty()) {
-        model.save(save_file);
+        model.save(save_file, precision);
     }
     if(!save_src_file.empty()) {
-        model.src_model.save(save_src_file);
+        model.src_model.save(save_src_file, precision);
     }
     if(!save_trg_file.empty()) {
-        model.trg_model.save(save_trg_file);
+        model.trg_model.save(save_trg_file, precision);
     }
 
     return 0;
@@ -22,15 +22,39 @@ static vector<option_plus> options_plus = {
     {"alpha",             required_argument, 0, 'i', "initial learning rate"},
     {"subsampling",       required_argument, 0, 'j', "subsampling (usually between 1e-03 and 1e-05)"},
     {"sg",                no_argument,       0, 'k', "skip-gram model (default: CBOW)"},
+    {"shared-negatives",  no_argument,       0, 'D', "skip-gram: share the negative samples of each window, and update the window at once (faster with many threads)"},
+    {"sigmoid-table",     no_argument,       0, 'E', "read the sigmoid from a precomputed table during training (faster, as in word2vec)"},
+    {"pin-threads",       no_argument,       0, 'L', "pin the training threads to CPUs spread over the NUMA nodes, with a copy of the sampler and Huffman codes on each node"},
+    {"numa-interleave",   no_argument,       0, 'M', "interleave the weight matrices over the NUMA nodes"},
+    {"cluster",           required_argument, 0, 'N', "distributed training: host:port where process 0 listens (each process trains its shard of the training file)"},
+    {"cluster-rank",      required_argument, 0, 'O', "distributed training: number of this process (process 0 saves the model)"},
+    {"cluster-size",      required_argument, 0, 'P', "distributed training: number of processes"},
+    {"sync-words",        required_argument, 0, 'Q', "distributed training: words trained by each process between two weight averagings (default: 0, one per epoch)"},
+    {"metrics",           required_argument, 0, 'R', "append training metrics to this file as JSON lines (words/sec per thread, updates, time of each phase)"},
+    {"metrics-interval",  required_argument, 0, 'S', "seconds between two lines of --metrics (default: 10)"},
     {"hs",                no_argument,       0, 'l', "hierarchical softmax (default off)"},
     {"sent-vector",       no_argument,       0, 'm', "train sentence vectors"},
+    {"sent-vector-file",  required_argument, 0, 'J', "train the sentence vectors in this file (memory-mapped) instead of in memory"},
+    {"doc-ids",           no_argument,       0, 'K', "the first token of each line is a document ID: train one sentence vector per document"},
     {"train",             required_argument, 0, 'n', "train with given training file"},
     {"load",              required_argument, 0, 'o', "load model"},
+    {"checkpoint",        required_argument, 0, 'F', "save the model and training state to this file during training (see --checkpoint-words)"},
+    {"checkpoint-words",  required_argument, 0, 'G', "number of words trained between two checkpoints (default: 0, one checkpoint per epoch)"},
+    {"grow-vocab",        no_argument,       0, 'I', "with --load and --train: add the new words of the training file to the vocabulary"},
+    {"resume",            required_argument, 0, 'H', "load a checkpoint, and resume its training where it was interrupted (with --train on the same file)"},
+    {"load-vectors",      required_argument, 0, 'A', "load word vectors in the word2vec text or binary format, instead of a model"},
     {"save",              required_argument, 0, 'p', "save model"},
+    {"precision",         required_argument, 0, 'C', "precision of the matrices saved with --save (float32, float16 or int8, default: float32)"},
     {"save-vectors",      required_argument, 0, 'q', "save word vectors"},
     {"save-sent-vectors", required_argument, 0, 'r', "save sentence vectors"},
+    {"save-sent-vectors-bin", required_argument, 0, 'B', "save sentence vectors in binary format"},
     {"save-vectors-bin",  required_argument, 0, 's', "save word vectors in binary format"},
-    {"train-online",      required_argument, 0, 't', "use existing model to train online sentence vectors"},
+    {"train-online",      required_argument, 0, 't', "use existing model to train online sentence vectors (saved with --save-sent-vectors(-bin), default: standard output)"},
+    {"unigram-table",     required_argument, 0, 'u', "size of the negative sampling table (default: 0, alias sampling)"},
+    {"seed",              required_argument, 0, 'w', "random seed (default: 1)"},
+    {"max-vocab",         required_argument, 0, 'x', "prune rare words while counting above this vocabulary size (default: 0, no limit)"},
+    {"index-lists",       required_argument, 0, 'y', "build an approximate nearest neighbor index with this many lists, saved with the model (0: automatic)"},
+    {"analogy",           required_argument, 0, 'z', "evaluate the word embeddings on analogical reasoning questions (e.g. word2vec/questions-words.txt)"},
     {0, 0, 0, 0, 0}
 };
 
@@ -53,6 +77,8 @@ int main(int argc, char **argv) {
     }
 
     string load_file;
+    string load_vectors;
+    string resume_file;
 
     // first pass on parameters to find out if a model file is provided
     while (1) {
@@ -62,6 +88,8 @@ int main(int argc, char **argv) {
 
         switch (opt) {
             case 'o': load_file = string(optarg);           break;
+            case 'A': load_vectors = string(optarg);        break;
+            case 'H': resume_file = string(optarg);         break;
             default:                                        break;
         }
     }
@@ -70,8 +98,12 @@ int main(int argc, char **argv) {
     MonolingualModel model(&config);
 
     // model file needs to be loaded before anything else (otherwise it overwrites the parameters)
-    if (!load_file.empty()) {
+    if (!resume_file.empty()) {
+        model.load(resume_file);
+    } else if (!load_file.empty()) {
         model.load(load_file);
+    } else if (!load_vectors.empty()) {
+        model.loadVectors(load_vectors);
     }
 
     int saving_policy = 0;
@@ -79,8 +111,12 @@ int main(int argc, char **argv) {
     string save_file;
     string save_vectors;
     string save_sent_vectors;
+    string save_sent_vectors_bin;
     string save_vectors_bin;
     string online_train_file;
+    int index_lists = -1;
+    string analogy_file;
+    Precision precision = Precision::float32;
 
     optind = 0;  // necessary to parse arguments twice
     while (1) {
@@ -102,21 +138,45 @@ int main(int argc, char **argv) {
             case 'i': config.learning_rate = atof(optarg); break;
             case 'j': config.subsampling = atof(optarg);    break;
             case 'k': config.skip_gram = true;              break;
+            case 'D': config.shared_negatives = true;       break;
+            case 'E': config.sigmoid_table = true;          break;
+            case 'L': config.pin_threads = true;            break;
+            case 'M': config.numa_interleave = true;        break;
+            case 'N': config.cluster = string(optarg);      break;
+            case 'O': config.cluster_rank = atoi(optarg);   break;
+            case 'P': config.cluster_size = atoi(optarg);   break;
+            case 'Q': config.sync_words = atoll(optarg);    break;
+            case 'R': config.metrics_file = string(optarg); break;
+            case 'S': config.metrics_interval = atof(optarg); break;
             case 'l': config.hierarchical_softmax = true;   break;
             case 'm': config.sent_vector = true;            break;
+            case 'J': config.sent_vector_file = string(optarg); break;
+            case 'K': config.doc_ids = true;                break;
             case 'n': train_file = string(optarg);          break;
             case 'o':                                       break;
+            case 'A':                                       break;
+            case 'F': config.checkpoint = string(optarg);   break;
+            case 'G': config.checkpoint_words = atoll(optarg); break;
+            case 'H':                                       break;
+            case 'I': config.grow_vocab = true;             break;
             case 'p': save_file = string(optarg);           break;
+            case 'C': precision = parsePrecision(optarg);   break;
             case 'q': save_vectors = string(optarg);        break;
             case 'r': save_sent_vectors = string(optarg);   break;
+            case 'B': save_sent_vectors_bin = string(optarg); break;
             case 's': save_vectors_bin = string(optarg);    break;
             case 't': online_train_file = string(optarg);   break;
+            case 'u': config.unigram_table_size = atoll(optarg); break;
+            case 'w': config.seed = atoi(optarg);           break;
+            case 'x': config.max_vocab_size = atoll(optarg); break;
+            case 'y': index_lists = atoi(optarg);           break;
+            case 'z': analogy_file = string(optarg);        break;
             default:                                        abort();
         }
     }
     // TODO: possibility to provide vocabulary file
 
-    if (load_file.empty() && train_file.empty()) {  // one of those actions is required
+    if (load_file.empty() && load_vectors.empty() && resume_file.empty() && train_file.empty()) {  // one of those actions is required
         print_usage();
         return 0;
     }
@@ -124,17 +184,44 @@ int main(int argc, char **argv) {
     std::cout << "MultiVec-mono" << std::endl;
     config.print();
 
-    if (!train_file.empty()) {
-        model.train(train_file, load_file.empty());
+    if (!train_file.empty() && !resume_file.empty()) {
+        model.resume(train_file, resume_file);
+    } else if (!train_file.empty()) {
+        model.train(train_file, load_file.empty() && load_vectors.empty());
+    }
+
+    if (!config.cluster.empty() && config.cluster_rank != 0) {
+        return 0; // all the processes have the same model, which is saved by process 0
     }
 
     if (!online_train_file.empty()) {
-        throw runtime_error("not implemented");  // TODO
+        ifstream infile(online_train_file);
+        check_is_open(infile, online_train_file);
+        bool binary = save_sent_vectors.empty() && !save_sent_vectors_bin.empty();
+        string output_file = binary ? save_sent_vectors_bin : save_sent_vectors;
+
+        if (output_file.empty()) {
+            model.sentVec(infile, std::cout);
+        } else {
+            ofstream outfile(output_file, ios::binary);
+            check_is_open(outfile, output_file);
+            model.sentVec(infile, outfile, binary);
+        }
+        save_sent_vectors.clear(); // those are the online sentence vectors
+        save_sent_vectors_bin.clear();
     }
     
-    // saving methods (TODO: save model periodically/when training is interrupted)
+    if (!analogy_file.empty()) {
+        model.analogicalReasoning(analogy_file, 0, saving_policy);
+    }
+
+    if (index_lists >= 0) {
+        model.buildIndex(index_lists, saving_policy);
+    }
+
+    // saving methods (see --checkpoint to save the model periodically during training)
     if(!save_file.empty()) {
-        model.save(save_file);
+        model.save(save_file, precision);
     }
     if (!save_vectors.empty()) {
         model.saveVectors(save_vectors, saving_policy);
@@ -145,6 +232,9 @@ int main(int argc, char **argv) {
     if (!save_sent_vectors.empty() && config.sent_vector) {
         model.saveSentVectors(save_sent_vectors);
     }
+    if (!save_sent_vectors_bin.empty() && config.sent_vector) {
+        model.saveSentVectors(save_sent_vectors_bin, true);
+    }
 
     return 0;
 }
@@ -0,0 +1,68 @@
+#include "mapping.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& filename, bool writable) : data_(nullptr), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw runtime_error("couldn't open file " + filename);
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) { // mmap doesn't accept empty mappings
+        close(fd);
+        return;
+    }
+
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* addr = mmap(nullptr, size_, prot, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after closing the file
+    if (addr == MAP_FAILED) {
+        throw runtime_error("couldn't map file " + filename);
+    }
+    data_ = static_cast<char*>(addr);
+}
+
+MappedFile::MappedFile(const string& filename, size_t size) : data_(nullptr), size_(size) {
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+
+    // existing contents are kept (up to `size`), new bytes are zeros
+    if (ftruncate(fd, static_cast<off_t>(size_)) == -1) {
+        close(fd);
+        throw runtime_error("couldn't resize file " + filename);
+    }
+
+    if (size_ == 0) {
+        close(fd);
+        return;
+    }
+
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw runtime_error("couldn't map file " + filename);
+    }
+    data_ = static_cast<char*>(addr);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) munmap(data_, size_);
+}
+
+void MappedFile::adviseSequential() const {
+    if (data_ != nullptr) madvise(data_, size_, MADV_SEQUENTIAL);
+}
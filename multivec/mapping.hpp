@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/**
+ * @brief Memory mapping of an entire file, which stays valid as long as this object exists.
+ * An existing file is opened read-only. A writable mapping of it is private (copy-on-write): modified
+ * pages are copied in memory, and the file itself is never modified.
+ *
+ * A file can also be mapped for writing in place (e.g. data which doesn't fit in memory): the mapping
+ * is shared with the file, whose pages are written back and evicted by the system.
+ */
+class MappedFile {
+    char* data_;
+    size_t size_;
+
+    MappedFile(const MappedFile&); // not copyable
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    explicit MappedFile(const std::string& filename, bool writable = false);
+    MappedFile(const std::string& filename, size_t size); // created or resized to `size` bytes, and written in place
+    ~MappedFile();
+
+    char* data() const { return data_; } // nullptr for an empty file
+    size_t size() const { return size_; }
+
+    void adviseSequential() const; // hint that the file will be read sequentially
+};
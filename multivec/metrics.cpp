@@ -0,0 +1,147 @@
+#include "metrics.hpp"
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+TrainingCounts& TrainingCounts::operator+=(const TrainingCounts& counts) {
+    words += counts.words;
+    sentences += counts.sentences;
+    skipped_sentences += counts.skipped_sentences;
+    negative_updates += counts.negative_updates;
+    hs_updates += counts.hs_updates;
+    return *this;
+}
+
+ThreadCounters::ThreadCounters() : words(0), sentences(0), skipped_sentences(0), negative_updates(0), hs_updates(0) {}
+
+void ThreadCounters::publish(const TrainingCounts& counts) {
+    words.store(counts.words, memory_order_relaxed);
+    sentences.store(counts.sentences, memory_order_relaxed);
+    skipped_sentences.store(counts.skipped_sentences, memory_order_relaxed);
+    negative_updates.store(counts.negative_updates, memory_order_relaxed);
+    hs_updates.store(counts.hs_updates, memory_order_relaxed);
+}
+
+TrainingCounts ThreadCounters::load() const {
+    TrainingCounts counts;
+    counts.words = words.load(memory_order_relaxed);
+    counts.sentences = sentences.load(memory_order_relaxed);
+    counts.skipped_sentences = skipped_sentences.load(memory_order_relaxed);
+    counts.negative_updates = negative_updates.load(memory_order_relaxed);
+    counts.hs_updates = hs_updates.load(memory_order_relaxed);
+    return counts;
+}
+
+TrainingMetrics::Threads::Threads(size_t n) : start(high_resolution_clock::now()), n(n), counters(nullptr) {
+    void* ptr = nullptr;
+    if (n > 0 && posix_memalign(&ptr, 64, n * sizeof(ThreadCounters)) != 0) {
+        throw bad_alloc();
+    }
+    counters = static_cast<ThreadCounters*>(ptr);
+    for (size_t i = 0; i < n; ++i) {
+        new (&counters[i]) ThreadCounters();
+    }
+}
+
+TrainingMetrics::Threads::~Threads() {
+    for (size_t i = 0; i < n; ++i) {
+        counters[i].~ThreadCounters();
+    }
+    free(counters);
+}
+
+TrainingMetrics::TrainingMetrics() {
+    reset();
+}
+
+void TrainingMetrics::reset() {
+    atomic_store(&threads, shared_ptr<Threads>());
+    for (int i = 0; i < phases; ++i) {
+        phase_times[i] = 0;
+    }
+}
+
+ThreadCounters* TrainingMetrics::startThreads(size_t n) {
+    shared_ptr<Threads> new_threads = make_shared<Threads>(n);
+    atomic_store(&threads, new_threads);
+    return new_threads->counters;
+}
+
+void TrainingMetrics::addTime(Phase phase, high_resolution_clock::time_point start) {
+    phase_times[phase] += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+}
+
+TrainingMetrics::Snapshot TrainingMetrics::snapshot() const {
+    Snapshot snapshot;
+    for (int i = 0; i < phases; ++i) {
+        snapshot.phase_times[i] = phase_times[i] / 1e6;
+    }
+
+    shared_ptr<Threads> current = atomic_load(&threads);
+    snapshot.time = 0;
+    if (current) {
+        snapshot.time = duration_cast<duration<double>>(high_resolution_clock::now() - current->start).count();
+        for (size_t i = 0; i < current->n; ++i) {
+            snapshot.threads.push_back(current->counters[i].load());
+            snapshot.total += snapshot.threads.back();
+        }
+    }
+    return snapshot;
+}
+
+string TrainingMetrics::Snapshot::json() const {
+    static const char* phase_names[phases] = { "vocab", "chunkify", "training", "save" };
+    double seconds = max(time, 1e-9);
+
+    ostringstream out;
+    auto counts = [&](const TrainingCounts& c) {
+        out << "\"words\": " << c.words << ", \"words_per_sec\": " << c.words / seconds << ", \"sentences\": "
+            << c.sentences << ", \"skipped_sentences\": " << c.skipped_sentences << ", \"negative_updates\": "
+            << c.negative_updates << ", \"hs_updates\": " << c.hs_updates;
+    };
+
+    out << "{\"time\": " << time << ", ";
+    counts(total);
+    out << ", \"phases\": {";
+    for (int i = 0; i < phases; ++i) {
+        out << (i > 0 ? ", \"" : "\"") << phase_names[i] << "\": " << phase_times[i];
+    }
+    out << "}, \"threads\": [";
+    for (size_t i = 0; i < threads.size(); ++i) {
+        out << (i > 0 ? ", {" : "{");
+        counts(threads[i]);
+        out << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+MetricsWriter::MetricsWriter(const string& filename, float interval, const TrainingMetrics& metrics) :
+    outfile(filename, ios::app), interval(interval), metrics(metrics), finished(false) {
+    check_is_open(outfile, filename);
+    writer = thread(&MetricsWriter::run, this);
+}
+
+MetricsWriter::~MetricsWriter() {
+    finish();
+}
+
+void MetricsWriter::finish() {
+    {
+        lock_guard<std::mutex> lock(mutex_);
+        if (finished) return;
+        finished = true;
+    }
+    stop.notify_all();
+    writer.join();
+    outfile << metrics.json() << endl;
+}
+
+void MetricsWriter::run() {
+    unique_lock<std::mutex> lock(mutex_);
+    auto period = duration_cast<high_resolution_clock::duration>(duration<double>(max(interval, 0.001f)));
+    while (!stop.wait_for(lock, period, [this]() { return finished; })) {
+        outfile << metrics.json() << endl;
+    }
+}
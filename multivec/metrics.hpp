@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "utils.hpp"
+
+/**
+ * @brief Training counters of a thread. The training threads keep their own counts in their TrainingContext
+ * (plain increments in the inner loops), and publish them to the TrainingMetrics every few thousand words.
+ */
+struct TrainingCounts {
+    long long words; // words of the vocabulary, before subsampling
+    long long sentences;
+    long long skipped_sentences; // sentences with no word left after subsampling
+    long long negative_updates; // output vectors updated by negative sampling (positive and negative samples)
+    long long hs_updates; // inner nodes updated by hierarchical softmax
+
+    TrainingCounts() : words(0), sentences(0), skipped_sentences(0), negative_updates(0), hs_updates(0) {}
+
+    TrainingCounts& operator+=(const TrainingCounts& counts);
+};
+
+/**
+ * @brief Published counts of a training thread, on its own cache line. Only this thread writes them (relaxed
+ * stores), and they can be read at any time by other threads (e.g. to spot stragglers).
+ */
+class ThreadCounters {
+    std::atomic<long long> words, sentences, skipped_sentences, negative_updates, hs_updates;
+    char padding[64 - 5 * sizeof(std::atomic<long long>)];
+
+public:
+    ThreadCounters();
+
+    void publish(const TrainingCounts& counts);
+    TrainingCounts load() const;
+};
+
+/**
+ * @brief Metrics of the current (or last) training of a model, which can be read during training: time spent
+ * in each phase, training time, and the counts of each training thread.
+ */
+class TrainingMetrics {
+public:
+    enum Phase { vocab, chunkify, training, save, phases };
+
+    struct Snapshot {
+        double time; // seconds since the training threads started (0 before that)
+        double phase_times[phases]; // seconds spent in each phase
+        vector<TrainingCounts> threads;
+        TrainingCounts total;
+
+        string json() const; // on a single line, with words per second of each thread and overall
+    };
+
+    TrainingMetrics();
+
+    void reset(); // new training: phase times set to zero, and no threads
+    /**
+     * @brief Counters of `n` training threads, set to zero (the words per second are counted from now). They
+     * stay valid until the next call to reset or startThreads.
+     */
+    ThreadCounters* startThreads(size_t n);
+    void addTime(Phase phase, high_resolution_clock::time_point start); // time from `start` to now
+
+    Snapshot snapshot() const;
+    string json() const { return snapshot().json(); }
+
+private:
+    struct Threads {
+        high_resolution_clock::time_point start;
+        size_t n;
+        ThreadCounters* counters; // aligned on a cache line
+
+        Threads(size_t n);
+        ~Threads();
+    };
+
+    shared_ptr<Threads> threads; // replaced atomically, and read by snapshot at any time
+    std::atomic<long long> phase_times[phases]; // microseconds
+};
+
+/**
+ * @brief Writes a snapshot of the metrics as a JSON line every `interval` seconds during training (see
+ * Config::metrics_file), from a background thread. The file is appended to, and finish() writes the last line.
+ */
+class MetricsWriter {
+public:
+    MetricsWriter(const string& filename, float interval, const TrainingMetrics& metrics);
+    ~MetricsWriter();
+
+    void finish();
+
+private:
+    ofstream outfile;
+    float interval;
+    const TrainingMetrics& metrics;
+    std::mutex mutex_;
+    std::condition_variable stop;
+    bool finished;
+    thread writer;
+
+    void run();
+};
@@ -3,13 +3,14 @@
 
 const HuffmanNode HuffmanNode::UNK;
 
-void MonolingualModel::addWordToVocab(const string& word) {
+void MonolingualModel::addWordToVocab(const string& word, int count) {
     auto it = vocabulary.find(word);
 
     if (it != vocabulary.end()) {
-        it->second.count++;
+        it->second.count += count;
     } else {
         HuffmanNode node(static_cast<int>(vocabulary.size()), word);
+        node.count = count;
         vocabulary.insert({word, node});
     }
 }
@@ -25,163 +26,493 @@ void MonolingualModel::reduceVocab() {
     }
 }
 
-void MonolingualModel::readVocab(const string& training_file) {
-    ifstream infile(training_file);
+/**
+ * @brief Count the words of the corpus in parallel. Each thread counts the words of one chunk into its own
+ * hash table, whose keys point into the mapped corpus (no string copies). The tables are then merged into
+ * shards (words are distributed by hash among the shards, one thread per shard), so that each word is in
+ * exactly one of the returned tables.
+ *
+ * When `max_vocab_size` is set, a table that grows beyond its share of this limit is pruned on the fly
+ * like in word2vec: words seen at most once are removed, then at most twice the next time, etc. This bounds
+ * the memory usage, at the cost of approximate counts for rare words.
+ */
+vector<WordCounts> MonolingualModel::countWords(const Corpus& corpus, const Cluster* cluster) const {
+    // with a cluster, each process counts the words of its share of the corpus (see gatherVocab)
+    long long begin = 0, size = corpus.size();
+    if (cluster != nullptr) {
+        long long share = static_cast<long long>(corpus.size()) / cluster->size();
+        begin = corpus.lineStart(share * cluster->rank());
+        size = (cluster->rank() + 1 < cluster->size() ? corpus.lineStart(share * (cluster->rank() + 1)) : size) - begin;
+    }
 
-    try {
-        check_is_open(infile, training_file);
-        check_is_non_empty(infile, training_file);
-    } catch (...) {
-        throw;
+    int n_threads = max(config->threads, 1);
+    vector<long long> bounds(n_threads + 1, begin + size);
+    for (int i = 0; i < n_threads; ++i) {
+        bounds[i] = corpus.lineStart(begin + size / n_threads * i);
     }
 
+    size_t max_size = config->max_vocab_size > 0 ? max(config->max_vocab_size / n_threads, 1LL) : 0;
+
+    vector<WordCounts> tables(n_threads);
+    parallelFor(n_threads, [&](int i) {
+        long long min_reduce = 1;
+        WordCounts& table = tables[i];
+        auto add = [&](const char* begin, const char* end) {
+            table.add(begin, static_cast<int>(end - begin));
+            if (max_size > 0 && table.size() > max_size)
+                table.prune(min_reduce++);
+        };
+
+        const char* begin = corpus.data() + bounds[i];
+        const char* end = corpus.data() + bounds[i + 1];
+        if (!config->doc_ids) {
+            forEachToken(begin, end, add);
+            return;
+        }
+        for (const char* line = begin; line < end; ) { // the document IDs aren't words
+            const char* eol = Corpus::lineEnd(line, end);
+            const char* words = line;
+            firstToken(words, eol);
+            forEachToken(words, eol, add);
+            line = eol + 1;
+        }
+    });
+
+    vector<WordCounts> shards(n_threads);
+    parallelFor(n_threads, [&](int s) {
+        long long min_reduce = 1;
+        WordCounts& shard = shards[s];
+        for (auto it = tables.begin(); it != tables.end(); ++it) {
+            it->forEach([&](const WordCounts::Entry& e) {
+                if ((e.hash >> 32) % n_threads != s) return;
+                shard.add(e.word, e.length, e.hash, e.count);
+                if (max_size > 0 && shard.size() > max_size)
+                    shard.prune(min_reduce++);
+            });
+        }
+    });
+    return shards;
+}
+
+/**
+ * @brief Build the vocabulary of the words which appear at least `min_count` times in the corpus
+ * (see countWords), and their Huffman codes. With a cluster, the vocabulary of the whole corpus is built
+ * once, by process 0 (see gatherVocab).
+ */
+void MonolingualModel::readVocab(const Corpus& corpus, Cluster* cluster) {
     vocabulary.clear();
+    vector<WordCounts> shards = countWords(corpus, cluster);
 
-    string word;
-    while (infile >> word) {
-        addWordToVocab(word);
+    size_t distinct_words = 0;
+    if (cluster != nullptr) {
+        gatherVocab(shards, *cluster, distinct_words);
+    } else {
+        for (auto it = shards.begin(); it != shards.end(); ++it) {
+            distinct_words += it->size();
+            it->forEach([&](const WordCounts::Entry& e) {
+                if (e.count >= config->min_count)
+                    addWordToVocab(string(e.word, e.length), static_cast<int>(e.count));
+            });
+            it->clear();
+        }
     }
 
     if (config->verbose)
-        std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
+        std::cout << "Vocabulary size: " << distinct_words << std::endl;
 
     reduceVocab();
 
     if (config->verbose)
         std::cout << "Reduced vocabulary size: " << vocabulary.size() << std::endl;
 
+    indexVocab();
     createBinaryTree();
-    initUnigramTable();
 }
 
-void MonolingualModel::createBinaryTree() {
-    vector<HuffmanNode*> heap;
-    vector<HuffmanNode> parent_nodes;
-    parent_nodes.reserve(vocabulary.size());
+/**
+ * @brief Distributed vocabulary: the word counts of each process are added up by process 0, which keeps the
+ * words which appear at least `min_count` times, and sends them to all the processes. They all insert the same
+ * words in the same order, which gives each word the same index everywhere. Messages are lists of (length,
+ * word, count).
+ */
+void MonolingualModel::gatherVocab(const vector<WordCounts>& shards, Cluster& cluster, size_t& distinct_words) {
+    string counts;
+    for (auto it = shards.begin(); it != shards.end(); ++it) {
+        it->forEach([&](const WordCounts::Entry& e) {
+            appendValue(counts, int32_t(e.length));
+            counts.append(e.word, e.length);
+            appendValue(counts, e.count);
+        });
+    }
 
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        heap.push_back(&it->second);
+    vector<string> all = cluster.gather(counts);
+    counts.clear();
+    if (cluster.rank() == 0) {
+        WordCounts total; // keys point into the messages
+        for (auto it = all.begin(); it != all.end(); ++it) {
+            const char* end = it->data() + it->size();
+            for (const char* p = it->data(); p < end; ) {
+                int length = readValue<int32_t>(p);
+                const char* word = p;
+                p += length;
+                total.add(word, length, hashWord(word, length), readValue<long long>(p));
+            }
+        }
+
+        total.forEach([&](const WordCounts::Entry& e) {
+            if (e.count < config->min_count) return;
+            appendValue(counts, int32_t(e.length));
+            counts.append(e.word, e.length);
+            appendValue(counts, e.count);
+        });
+        appendValue(counts, static_cast<long long>(total.size())); // number of distinct words
+    }
+    all.clear();
+    cluster.broadcast(counts);
+
+    const char* end = counts.data() + counts.size() - sizeof(long long);
+    for (const char* p = counts.data(); p < end; ) {
+        int length = readValue<int32_t>(p);
+        string word(p, length);
+        p += length;
+        addWordToVocab(word, static_cast<int>(readValue<long long>(p)));
     }
+    distinct_words = static_cast<size_t>(readValue<long long>(end));
+}
 
-    std::sort(heap.begin(), heap.end(), HuffmanNode::comp);
+/**
+ * @brief Add the counts of the words of `corpus` to the vocabulary, for continued training on new data
+ * (Config::grow_vocab). Existing words keep their index and weights, and the new words which appear at least
+ * `min_count` times in the corpus are added at the end: one new row per word in each weight matrix (random
+ * input weights, zero output weights), and new Huffman codes (see growBinaryTree).
+ */
+void MonolingualModel::growVocab(const Corpus& corpus) {
+    int old_words = static_cast<int>(vocabulary.size());
+    vector<WordCounts> shards = countWords(corpus);
+
+    for (auto it = shards.begin(); it != shards.end(); ++it) {
+        it->forEach([&](const WordCounts::Entry& e) {
+            string word(e.word, e.length);
+            if (e.count >= config->min_count || vocabulary.find(word) != vocabulary.end())
+                addWordToVocab(word, static_cast<int>(e.count));
+        });
+        it->clear();
+    }
+
+    int v = static_cast<int>(vocabulary.size());
+    if (config->verbose)
+        std::cout << "Vocabulary size: " << v << " (" << v - old_words << " new words)" << std::endl;
+
+    indexVocab();
+    growBinaryTree(old_words);
 
-    for (int i = 0; heap.size() > 1; i++) {
-        HuffmanNode* left = heap.back();
-        heap.pop_back();
+    int d = config->dimension;
+    input_weights.resize(v);
+    multivec::Random rand(multivec::Random::seed(config->seed, -3));
+    for (int row = old_words; row < v; ++row) {
+        for (int col = 0; col < d; ++col) {
+            input_weights[row][col] = (rand.randf() - 0.5f) / d;
+        }
+    }
 
-        HuffmanNode* right = heap.back();
-        heap.pop_back();
+    if (!output_weights.empty())
+        output_weights.resize(v);
+    if (!output_weights_hs.empty())
+        output_weights_hs.resize(v);
+}
 
-        parent_nodes.push_back({i, left, right});
+namespace {
 
-        HuffmanNode* parent = &parent_nodes.back();
-        auto it = lower_bound(heap.begin(), heap.end(), parent, HuffmanNode::comp);
-        heap.insert(it, parent);
+/**
+ * @brief Huffman codes of words with the given counts (indexed by word). Iterative version of word2vec's
+ * algorithm: leaves are sorted by decreasing count, and as inner nodes are created by increasing count,
+ * the two smallest nodes are always at the end of the leaves or at the beginning of the inner nodes.
+ */
+void huffmanCodes(const vector<int>& word_counts, HuffmanCodes& huffman) {
+    int v = static_cast<int>(word_counts.size());
+    huffman.clear();
+    if (v == 0) return;
+
+    // nodes [0, v) are the leaves, nodes [v, 2v - 1) are the inner nodes (inner node i is node v + i)
+    vector<int> leaves(v);
+    for (int i = 0; i < v; ++i) leaves[i] = i;
+    std::sort(leaves.begin(), leaves.end(), [&](int i, int j) {
+        return word_counts[i] > word_counts[j] || (word_counts[i] == word_counts[j] && i < j);
+    });
+
+    vector<long long> count(2 * v - 1, numeric_limits<long long>::max());
+    vector<int> parent(2 * v - 1, -1);
+    vector<char> binary(2 * v - 1, 0);
+    for (int i = 0; i < v; ++i) count[i] = word_counts[leaves[i]];
+
+    int pos1 = v - 1; // next leaf
+    int pos2 = v; // next inner node
+    for (int i = 0; i < v - 1; ++i) {
+        int min1 = (pos1 >= 0 && count[pos1] < count[pos2]) ? pos1-- : pos2++;
+        int min2 = (pos1 >= 0 && count[pos1] < count[pos2]) ? pos1-- : pos2++;
+        count[v + i] = count[min1] + count[min2];
+        parent[min1] = v + i;
+        parent[min2] = v + i;
+        binary[min2] = 1;
+    }
+
+    // parents are created after their children: compute depths top-down
+    vector<int> depth(2 * v - 1, 0);
+    for (int b = 2 * v - 3; b >= 0; --b) {
+        depth[b] = depth[parent[b]] + 1;
     }
 
-    assignCodes(heap.front(), {}, {});
+    vector<int> lengths(v);
+    for (int i = 0; i < v; ++i) lengths[leaves[i]] = depth[i];
+    huffman.reset(lengths);
+
+    // walk from each leaf up to the root, filling its code from the end
+    for (int i = 0; i < v; ++i) {
+        int j = huffman.offsets[leaves[i] + 1];
+        for (int b = i; parent[b] != -1; b = parent[b]) {
+            --j;
+            huffman.parents[j] = parent[b] - v;
+            huffman.setBit(j, binary[b]);
+        }
+    }
+}
+
+}
+
+/**
+ * @brief Build the Huffman tree of the vocabulary from the word counts, and store the code of each
+ * word into `huffman`.
+ */
+void MonolingualModel::createBinaryTree() {
+    huffmanCodes(word_counts, huffman);
+}
+
+/**
+ * @brief Codes of the words added after the first `old_words` words of the vocabulary (see growVocab),
+ * without rebuilding the tree of the existing words: the new words get their own Huffman tree, and a new
+ * root joins it with the existing tree. The existing words keep their inner nodes, with the new root above
+ * them, so that their hierarchical softmax weights stay valid (their codes aren't optimal for the new
+ * counts anymore: training from scratch builds an optimal tree).
+ */
+void MonolingualModel::growBinaryTree(int old_words) {
+    int v = static_cast<int>(word_counts.size());
+    if (old_words == v) return;
+    if (old_words == 0) {
+        createBinaryTree();
+        return;
+    }
+
+    HuffmanCodes old_codes, new_codes;
+    std::swap(old_codes, huffman);
+    huffmanCodes(vector<int>(word_counts.begin() + old_words, word_counts.end()), new_codes);
+
+    vector<int> lengths(v);
+    for (int i = 0; i < v; ++i) {
+        lengths[i] = 1 + (i < old_words ? old_codes.length(i) : new_codes.length(i - old_words));
+    }
+    huffman.reset(lengths);
+
+    // inner nodes: those of the existing tree, then those of the new tree, then the new root (node v - 2,
+    // the root of a tree built from scratch)
+    int root = v - 2;
+    for (int i = 0; i < v; ++i) {
+        bool is_new = i >= old_words;
+        const HuffmanCodes& codes = is_new ? new_codes : old_codes;
+        int word = is_new ? i - old_words : i;
+        int first_node = is_new ? old_words - 1 : 0;
+
+        int j = huffman.offsets[i]; // codes start at the root
+        huffman.parents[j] = root;
+        huffman.setBit(j, is_new);
+        for (int k = codes.offsets[word]; k < codes.offsets[word + 1]; ++k) {
+            ++j;
+            huffman.parents[j] = first_node + codes.parents[k];
+            huffman.setBit(j, codes.bit(k));
+        }
+    }
 }
 
-void MonolingualModel::assignCodes(HuffmanNode* node, vector<int> code, vector<int> parents) const {
-    if (node->is_leaf) {
-        node->code = code;
-        node->parents = parents;
+/**
+ * @brief Build the negative sampling distribution (unigram distribution to the power 0.75,
+ * a weird word2vec tweak). This is only done when training is requested.
+ */
+void MonolingualModel::initSampler() {
+    if (config->negative > 0) {
+        sampler.init(word_counts, config->unigram_table_size);
     } else {
-        parents.push_back(node->index);
-        vector<int> code_left(code);
-        code_left.push_back(0);
-        vector<int> code_right(code);
-        code_right.push_back(1);
+        sampler.clear();
+    }
 
-        assignCodes(node->left, code_left, parents);
-        assignCodes(node->right, code_right, parents);
+    // the training threads of each node read their own copy, allocated on this node
+    node_copies.clear();
+    if (config->pin_threads && numa::nodes() > 1) {
+        node_copies.resize(numa::nodes());
+        vector<thread> threads;
+        for (int node = 0; node < numa::nodes(); ++node) {
+            threads.push_back(thread([this, node]() {
+                numa::pinToNode(node);
+                node_copies[node].sampler = sampler;
+                node_copies[node].huffman = huffman;
+            }));
+        }
+        for (auto it = threads.begin(); it != threads.end(); ++it) {
+            it->join();
+        }
     }
 }
 
-void MonolingualModel::initUnigramTable() {
-    unigram_table.clear();
+/**
+ * @brief Build the sampler used by sentVec if it isn't built yet (e.g. the model was loaded, and not trained).
+ * Inference can be called from several threads at once (e.g. Python threads, without the GIL), hence the lock.
+ */
+void MonolingualModel::initInferenceSampler() {
+    lock_guard<mutex> lock(sampler_mutex);
+    if (config->negative > 0 && sampler.empty())
+        initSampler();
+}
+
+/**
+ * @brief Copy the word counts of the vocabulary into a flat array indexed by word index.
+ * The training procedure only reads from this array. Also maps word indices back to words.
+ */
+void MonolingualModel::indexVocab() {
+    word_counts.assign(vocabulary.size(), 0);
+    words_by_index.assign(vocabulary.size(), nullptr);
     vocab_word_count = 0;
-    
-    float power = 0.75; // weird word2vec tweak ('normal' value would be 1.0)
-    float total_count = 0.0;
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        vocab_word_count += it->second.count;
-        total_count += pow(it->second.count, power);
-    }
 
     for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        float f = pow(it->second.count, power) / total_count;
-
-        int d = static_cast<int>(f * UNIGRAM_TABLE_SIZE);
-        for (int i = 0; i < d; ++i) {
-            unigram_table.push_back(&it->second);
-        }
+        word_counts[it->second.index] = it->second.count;
+        words_by_index[it->second.index] = &it->second.word; // references to map elements stay valid
+        vocab_word_count += it->second.count;
     }
 }
 
-HuffmanNode* MonolingualModel::getRandomHuffmanNode() {
-    auto index = multivec::rand() % unigram_table.size();
-    return unigram_table[index];
+/**
+ * @brief Zero weight matrix of `rows` rows, interleaved over the NUMA nodes if config->numa_interleave is set
+ */
+mat MonolingualModel::newWeights(size_t rows) const {
+    return config->numa_interleave ? numa::interleavedMat(rows, config->dimension) : mat(rows, config->dimension);
 }
 
 void MonolingualModel::initNet() {
     int v = static_cast<int>(vocabulary.size());
     int d = config->dimension;
 
-    input_weights = mat(v, vec(d));
+    input_weights = newWeights(v);
+    multivec::Random rand(multivec::Random::seed(config->seed, -1));
 
     for (size_t row = 0; row < v; ++row) {
         for (size_t col = 0; col < d; ++col) {
-            input_weights[row][col] = (multivec::randf() - 0.5f) / d;
+            input_weights[row][col] = (rand.randf() - 0.5f) / d;
+        }
+    }
+
+    output_weights_hs = newWeights(v);
+    output_weights = newWeights(v);
+}
+
+/**
+ * @brief Give a row of sent_weights to each document ID of the training file (see Config::doc_ids), in order
+ * of first appearance, so that the rows are visited in about the same order as the file. The chunks are
+ * indexed in parallel, and their new IDs are merged in chunk order.
+ */
+void MonolingualModel::indexDocuments(const Corpus& corpus, const vector<Chunk>& chunks) {
+    doc_ids.clear();
+    doc_rows.clear();
+    if (!config->doc_ids) return;
+
+    int n_threads = max(config->threads, 1);
+    vector<vector<string>> new_ids(n_threads); // IDs of each thread's chunks, in order of first appearance
+    parallelFor(n_threads, [&](int i) {
+        unordered_map<string, int> seen;
+        for (size_t c = chunks.size() * i / n_threads; c < chunks.size() * (i + 1) / n_threads; ++c) {
+            const char* end = corpus.data() + chunks[c].end;
+            for (const char* line = corpus.data() + chunks[c].begin; line < end; ) {
+                const char* eol = Corpus::lineEnd(line, end);
+                string id = firstToken(line, eol);
+                if (!id.empty() && seen.insert(make_pair(id, 0)).second)
+                    new_ids[i].push_back(std::move(id));
+                line = eol + 1;
+            }
+        }
+    });
+
+    for (auto it = new_ids.begin(); it != new_ids.end(); ++it) {
+        for (auto id = it->begin(); id != it->end(); ++id) {
+            if (doc_rows.insert(make_pair(*id, static_cast<int>(doc_ids.size()))).second)
+                doc_ids.push_back(std::move(*id));
         }
     }
+}
 
-    output_weights_hs = mat(v, vec(d));
-    output_weights = mat(v, vec(d));
+/**
+ * @brief Row in sent_weights of the line [begin, end), whose first token is a document ID (see Config::doc_ids),
+ * and move `begin` after this ID. -1 if the line has no ID, or if the documents aren't indexed.
+ */
+int MonolingualModel::documentRow(const char*& begin, const char* end) const {
+    auto it = doc_rows.find(firstToken(begin, end));
+    return it == doc_rows.end() ? -1 : it->second;
 }
 
-void MonolingualModel::initSentWeights() {
+/**
+ * @brief Allocate one sentence vector per training line (or per document, see Config::doc_ids), in memory or in
+ * config->sent_vector_file, with random values unless `randomize` is false (the file keeps its current values).
+ */
+void MonolingualModel::initSentWeights(bool randomize) {
     int d = config->dimension;
-    sent_weights = mat(training_lines, vec(d));
+    size_t rows = config->doc_ids ? doc_ids.size() : training_lines;
+
+    if (config->sent_vector_file.empty()) {
+        sent_weights = newWeights(rows);
+    } else {
+        // rows are aligned like in memory, and the file is trained in place
+        size_t stride = mat::paddedSize(d);
+        auto file = std::make_shared<MappedFile>(config->sent_vector_file, rows * stride * sizeof(float));
+        sent_weights = mat(reinterpret_cast<float*>(file->data()), rows, d, stride, file);
+    }
+
+    if (!randomize) return;
+    multivec::Random rand(multivec::Random::seed(config->seed, -2));
 
-    for (size_t row = 0; row < training_lines; ++row) {
+    for (size_t row = 0; row < rows; ++row) {
         for (size_t col = 0; col < d; ++col) {
-            sent_weights[row][col] = (multivec::randf() - 0.5f) / d;
+            sent_weights[row][col] = (rand.randf() - 0.5f) / d;
         }
     }
 }
 
-vector<HuffmanNode> MonolingualModel::getNodes(const string& sentence) const {
-    vector<HuffmanNode> nodes;
-    istringstream iss(sentence);
+/**
+ * @brief Tokenize the sentence [begin, end) in place and write the vocabulary index of each token into
+ * `indices` (same size as the sentence, OOV words get index -1). `indices` is meant to be reused from one
+ * sentence to the next, to avoid allocations.
+ */
+void MonolingualModel::getIndices(const char* begin, const char* end, vector<int>& indices) const {
+    indices.clear();
     string word;
 
-    while (iss >> word) {
+    forEachToken(begin, end, [&](const char* begin, const char* end) {
+        word.assign(begin, end);
         auto it = vocabulary.find(word);
-        HuffmanNode node = HuffmanNode::UNK;
-
-        if (it != vocabulary.end()) {
-            node = it->second;
-        }
-
-        nodes.push_back(node);
-    }
+        indices.push_back(it == vocabulary.end() ? -1 : it->second.index);
+    });
+}
 
-    return nodes;
+void MonolingualModel::getIndices(const string& sentence, vector<int>& indices) const {
+    getIndices(sentence.data(), sentence.data() + sentence.size(), indices);
 }
 
 /**
- * @brief Discard random nodes according to their frequency. The more frequent a word is, the more
- * likely it is to be discarded. Discarded nodes are replaced by UNK token.
+ * @brief Discard random words according to their frequency. The more frequent a word is, the more
+ * likely it is to be discarded. Discarded words are replaced by -1 (like OOV words).
  */
-void MonolingualModel::subsample(vector<HuffmanNode>& nodes) const {
-    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
-        auto node = *it;
-        float f = static_cast<float>(node.count) / vocab_word_count; // frequency of this word
+void MonolingualModel::subsample(vector<int>& indices, multivec::Random& rand) const {
+    for (auto it = indices.begin(); it != indices.end(); ++it) {
+        if (*it == -1) continue;
+        float f = static_cast<float>(word_counts[*it]) / vocab_word_count; // frequency of this word
         float p = 1 - (1 + sqrt(f / config->subsampling)) * config->subsampling / f; // word2vec formula
 
-        if (p >= multivec::randf()) {
-            *it = HuffmanNode::UNK;
+        if (p >= rand.randf()) {
+            *it = -1;
         }
     }
 }
@@ -235,9 +566,38 @@ void MonolingualModel::saveVectors(const string &filename, int policy) const {
     }
 }
 
-void MonolingualModel::saveSentVectors(const string &filename) const {
+namespace {
+
+const size_t sent_vec_block_size = 4096; // lines read, inferred in parallel and written at once
+
+/**
+ * @brief Append `v` to `out`: raw floats in binary mode, otherwise values separated by spaces
+ * (formatted like operator<<), followed by a newline.
+ */
+void formatVector(ConstVecRef v, bool binary, string& out) {
+    if (binary) {
+        out.append(reinterpret_cast<const char*>(v.data()), sizeof(float) * v.size());
+        return;
+    }
+    char buffer[32];
+    for (size_t c = 0; c < v.size(); ++c) {
+        int n = snprintf(buffer, sizeof(buffer), "%g ", v[c]);
+        out.append(buffer, n);
+    }
+    out.push_back('\n');
+}
+
+} // namespace
+
+/**
+ * @brief Save the sentence vectors of the training file, one line per sentence (in binary format:
+ * `dimension` raw floats per sentence, like sentVec). The vectors of documents (see Config::doc_ids) are
+ * saved in the word2vec format instead, with their IDs in place of the words. The vectors are streamed
+ * out in file order, so that a memory-mapped store (see Config::sent_vector_file) is read sequentially.
+ */
+void MonolingualModel::saveSentVectors(const string &filename, bool binary) const {
     if (config->verbose)
-        std::cout << "Saving sentence vectors in text format to " << filename << std::endl;
+        std::cout << "Saving sentence vectors in " << (binary ? "binary" : "text") << " format to " << filename << std::endl;
 
     ofstream outfile(filename, ios::binary | ios::out);
 
@@ -247,49 +607,252 @@ void MonolingualModel::saveSentVectors(const string &filename) const {
         throw;
     }
 
-    for (auto it = sent_weights.begin(); it != sent_weights.end(); ++it) {
-        vec embedding = *it;
-        for (int c = 0; c < config->dimension; ++c) {
-            outfile << embedding[c] << " ";
+    bool ids = !doc_ids.empty() && doc_ids.size() == sent_weights.rows();
+    if (ids)
+        outfile << doc_ids.size() << " " << config->dimension << endl;
+
+    string buffer;
+    for (size_t i = 0; i < sent_weights.rows(); ++i) {
+        if (ids) {
+            buffer.append(doc_ids[i]);
+            buffer.push_back(' ');
+        }
+        formatVector(sent_weights[i], binary, buffer);
+        if (ids && binary)
+            buffer.push_back('\n');
+        if (buffer.size() >= (1 << 20)) {
+            outfile.write(buffer.data(), buffer.size());
+            buffer.clear();
         }
-        outfile << endl;
     }
+    outfile.write(buffer.data(), buffer.size());
 }
 
-void MonolingualModel::load(const string& filename) {
+/**
+ * @brief Load a model saved in any format. Models in the current format are memory-mapped:
+ * their weights are only read from disk when they are accessed.
+ */
+void MonolingualModel::load(const string& filename, bool inference, int policy) {
     if (config->verbose)
         std::cout << "Loading model" << std::endl;
 
-    ifstream infile(filename);
+    clearInference();
+    ann_index.clear();
+    ::load(filename, *this);
+    indexVocab();
+    if (config->verbose)
+        std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
 
-    try {
-        check_is_open(infile, filename);
-    } catch (...) {
-        throw;
+    if (inference)
+        initInference(policy);
+    else
+        dequantizeWeights();
+
+    string index_filename = filename + ".ann";
+    if (ifstream(index_filename)) {
+        if (config->verbose)
+            std::cout << "Loading index" << std::endl;
+        ann_index.load(index_filename);
+        if (ann_index.rows() != vocabulary.size()) {
+            ann_index.clear();
+            throw runtime_error("index file " + index_filename + " doesn't match the model");
+        }
     }
+}
 
-    ::load(infile, *this);
-    initUnigramTable();
-    if (config->verbose)
-        std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
+/**
+ * @brief Switch to inference mode: compute the embeddings of all words for the given policy once,
+ * and release everything else (other weights and Huffman codes, but not the word counts, which are used by
+ * analogicalReasoning). The model can then only be queried with this policy, and can't be trained or saved.
+ *
+ * The embeddings are also stored normalized, so that similarity queries only need dot products.
+ * With a quantized model, only the normalized embeddings are kept, quantized (used directly from the model
+ * file for policies 0 and 3), along with their norms.
+ */
+void MonolingualModel::initInference(int policy) {
+    if (policy < 0 || policy > 3) {
+        throw runtime_error("invalid policy");
+    }
+
+    Precision precision = quantized_weights.empty() ? Precision::float32 : quantized_weights[0].precision();
+    int p = config->negative > 0 ? policy : 0; // same fallback as wordVec
+    if (precision != Precision::float32 && (p == 0 || p == 3)) {
+        unit_quantized = std::move(quantized_weights[p == 0 ? 0 : 1]);
+    } else {
+        dequantizeWeights();
+        if (p == 0) {
+            embeddings = std::move(input_weights);
+        } else if (p == 3) {
+            embeddings = std::move(output_weights);
+        } else {
+            embeddings = mat(input_weights.rows(), p == 1 ? 2 * input_weights.cols() : input_weights.cols());
+            for (size_t i = 0; i < embeddings.rows(); ++i) {
+                embeddings[i] = wordVec(i, policy);
+            }
+        }
+    }
+
+    input_weights = mat();
+    output_weights = mat();
+    output_weights_hs = mat();
+    sent_weights = mat();
+    quantized_weights.clear();
+    huffman.clear();
+    sampler.clear();
+    node_copies.clear();
+
+    if (precision == Precision::float32) {
+        initUnitEmbeddings();
+    } else {
+        if (unit_quantized.empty()) { // policy 1 or 2: combined from the dequantized weights
+            unit_quantized = QuantizedMat(embeddings, precision);
+            embeddings = mat();
+        }
+        embedding_norms = unit_quantized.normalize();
+    }
+    inference_policy = policy;
+}
+
+void MonolingualModel::initUnitEmbeddings() {
+    unit_embeddings = embeddings;
+    for (size_t i = 0; i < unit_embeddings.rows(); ++i) {
+        float norm = unit_embeddings[i].norm();
+        if (norm > 0) unit_embeddings[i] /= norm;
+    }
+}
+
+void MonolingualModel::clearInference() {
+    inference_policy = -1;
+    embeddings = mat();
+    unit_embeddings = mat();
+    unit_quantized = QuantizedMat();
+    vector<float>().swap(embedding_norms);
+}
+
+/**
+ * @brief Replace the matrices of a quantized model file by float matrices, e.g. to train the model again
+ * (their precision is lost).
+ */
+void MonolingualModel::dequantizeWeights() {
+    if (quantized_weights.empty()) return;
+    input_weights = quantized_weights[0].dequantize();
+    output_weights = quantized_weights[1].dequantize();
+    output_weights_hs = quantized_weights[2].dequantize();
+    sent_weights = quantized_weights[3].dequantize();
+    quantized_weights.clear();
+}
+
+void MonolingualModel::checkPolicy(int policy) const {
+    if (inference_policy != -1 && policy != inference_policy) {
+        throw runtime_error("this model was loaded for inference with policy " + std::to_string(inference_policy));
+    }
+}
+
+void MonolingualModel::checkTrainable() const {
+    if (inference_policy != -1) {
+        throw runtime_error("this model was loaded in inference mode");
+    }
 }
 
-void MonolingualModel::save(const string& filename) const {
+/**
+ * @brief Save the model in the current format. The model is written to a temporary file which then
+ * replaces `filename`, so that a model can be saved to the file it was mapped from.
+ *
+ * With `precision` float16 or int8, all the matrices are quantized: the model takes half or a quarter of
+ * the space, and is meant to be loaded in inference mode, for serving (it can still be trained, from
+ * the dequantized weights).
+ */
+void MonolingualModel::save(const string& filename, Precision precision) const {
+    checkTrainable();
+    auto start = high_resolution_clock::now();
+
     if (config->verbose)
         std::cout << "Saving model" << std::endl;
 
-    ofstream outfile(filename);
+    string tmp_filename = filename + ".tmp";
+    ofstream outfile(tmp_filename, ios::binary);
 
     try {
-        check_is_open(outfile, filename);
+        check_is_open(outfile, tmp_filename);
     } catch (...) {
         throw;
     }
 
-    ::save(outfile, *this);
+    ::save(outfile, *this, precision);
+    outfile.close();
+
+    if (!outfile || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("couldn't save model to " + filename);
+    }
+
+    string index_filename = filename + ".ann";
+    if (!ann_index.empty()) {
+        ann_index.save(index_filename);
+    } else {
+        remove(index_filename.c_str()); // index of a previous model
+    }
+    metrics.addTime(TrainingMetrics::save, start);
+}
+
+/**
+ * @brief Replace the model with word embeddings in the word2vec text or binary format (see loadVectors in
+ * vectors.hpp). The vectors become the input weights, and the words get decreasing counts in file order
+ * (those files are usually sorted by frequency). The model can then be queried, evaluated and saved,
+ * but not trained, as it has no output weights.
+ */
+void MonolingualModel::loadVectors(const string& filename) {
+    if (config->verbose)
+        std::cout << "Loading embeddings from " << filename << std::endl;
+
+    WordVectors vectors = ::loadVectors(filename, 0, config->threads);
+    size_t v = vectors.words.size();
+
+    clearInference();
+    ann_index.clear();
+    vocabulary.clear();
+    vocabulary.reserve(v);
+    huffman.clear();
+
+    // duplicate words only keep their first vector
+    vector<int> rows;
+    for (size_t i = 0; i < v; ++i) {
+        HuffmanNode node(static_cast<int>(rows.size()), vectors.words[i]);
+        node.count = v - i;
+        if (vocabulary.insert({node.word, node}).second) rows.push_back(i);
+    }
+    if (rows.size() == v) {
+        input_weights = std::move(vectors.vectors);
+    } else {
+        input_weights = mat(rows.size(), vectors.vectors.cols());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            input_weights[i] = vectors.vectors[rows[i]];
+        }
+    }
+
+    output_weights = mat();
+    output_weights_hs = mat();
+    sent_weights = mat();
+    config->dimension = input_weights.cols();
+    config->negative = 0; // all the policies use the input weights
+    config->hierarchical_softmax = false;
+    indexVocab();
+
+    if (config->verbose)
+        std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
 }
 
 vec MonolingualModel::wordVec(int index, int policy) const {
+    if (inference_policy != -1 && !unit_quantized.empty()) {
+        checkPolicy(policy);
+        vec res(unit_quantized.cols());
+        unit_quantized.row(index, res.data());
+        res *= embedding_norms[index];
+        return res;
+    } else if (inference_policy != -1) {
+        checkPolicy(policy);
+        return embeddings[index];
+    }
+
     if (policy == 1 && config->negative > 0) // concat input and output
     {
         int d = config->dimension;
@@ -333,22 +896,104 @@ vec MonolingualModel::wordVec(const string& word, int policy) const {
     }
 }
 
-void MonolingualModel::sentVec(istream& input) {
-    string line;
-    while(getline(input, line)) {
-        vec embedding(config->dimension, 0);
-        try {
-            embedding = sentVec(line);
-        } catch (runtime_error) {
-            // in case of error (empty sentence, or all words are OOV), print a vector of zeros
-        };
+mat MonolingualModel::wordVecBatch(const vector<string>& words, int policy) const {
+    mat res;
+    for (size_t i = 0; i < words.size(); ++i) {
+        auto it = vocabulary.find(words[i]);
+        if (it == vocabulary.end()) continue;
+        vec v = wordVec(it->second.index, policy);
+        if (res.empty()) res = mat(words.size(), v.size());
+        res[i] = v;
+    }
+    if (res.empty() && !words.empty()) { // only OOV words
+        int dim = inference_policy == -1 ? (policy == 1 && config->negative > 0 ? 2 : 1) * config->dimension
+                : unit_quantized.empty() ? embeddings.cols() : unit_quantized.cols();
+        res = mat(words.size(), dim);
+    }
+    return res;
+}
 
-        for (int c = 0; c < config->dimension; ++c) {
-            std::cout << embedding[c] << " ";
+/**
+ * @brief Embeddings of all the words, as stored in the model (no copy). Only the policies whose embeddings
+ * are stored can be used: the policy of the inference mode, or otherwise input (0) or output (3) weights.
+ * The reference is invalidated when the model is trained, loaded or normalized.
+ */
+const mat& MonolingualModel::getEmbeddings(int policy) const {
+    if (inference_policy != -1) {
+        checkPolicy(policy);
+        if (!unit_quantized.empty()) {
+            throw runtime_error("the embeddings of this model are quantized");
         }
+        return embeddings;
+    } else if (policy == 0 || config->negative == 0) {
+        return input_weights;
+    } else if (policy == 3) {
+        return output_weights;
+    } else {
+        throw runtime_error("the embeddings of this policy aren't stored (see inference mode)");
     }
 }
 
+/**
+ * @brief Paragraph vectors of all the lines of `input`, written in order to `output`, one line per
+ * sentence (a vector of zeros for sentences without any known word). In binary mode, each vector is
+ * written as `dimension` raw floats, without any separator.
+ *
+ * The lines are processed by blocks: each block is inferred in parallel (see sentVecBatch), and then
+ * written with a single call.
+ */
+void MonolingualModel::sentVec(istream& input, ostream& output, bool binary) {
+    checkTrainable();
+    vector<string> lines;
+    mat vectors;
+    string buffer;
+
+    while (input) {
+        lines.clear();
+        string line;
+        while (lines.size() < sent_vec_block_size && getline(input, line)) {
+            lines.push_back(line);
+        }
+        if (lines.empty()) break;
+
+        sentVecBatch(lines, vectors);
+        buffer.clear();
+        for (size_t i = 0; i < vectors.rows(); ++i) {
+            formatVector(vectors[i], binary, buffer);
+        }
+        output.write(buffer.data(), buffer.size());
+    }
+    output.flush();
+}
+
+/**
+ * @brief Paragraph vectors of a batch of sentences (one row each, zeros for the sentences without
+ * any known word). The sentences are distributed dynamically among the threads, which each reuse their
+ * own buffers. The result doesn't depend on the number of threads.
+ */
+mat MonolingualModel::sentVecBatch(const vector<string>& sentences) {
+    checkTrainable();
+    mat vectors;
+    sentVecBatch(sentences, vectors);
+    return vectors;
+}
+
+void MonolingualModel::sentVecBatch(const vector<string>& sentences, mat& vectors) {
+    initInferenceSampler();
+
+    vectors = mat(sentences.size(), config->dimension);
+    atomic<size_t> next(0);
+    int n_threads = max(1, min<int>(config->threads, sentences.size()));
+
+    parallelFor(n_threads, [&](int) {
+        TrainingContext ctx(config->dimension, 0);
+        for (size_t i; (i = next++) < sentences.size(); ) {
+            const string& sentence = sentences[i];
+            sentVec(ctx, sentence.data(), sentence.data() + sentence.size(), vectors[i]);
+        }
+    });
+}
+
 /**
  * @brief Online paragraph vector on a given sentence. The parameters
  * of the model are frozen, while gradient descent is performed on this
@@ -360,55 +1005,71 @@ void MonolingualModel::sentVec(istream& input) {
  * @return sent_vec
  */
 vec MonolingualModel::sentVec(const string& sentence) {
-    int dimension = config->dimension;
+    checkTrainable();
+    initInferenceSampler();
+
+    TrainingContext ctx(config->dimension, 0);
+    vec sent_vec(config->dimension, 0);
+    if (!sentVec(ctx, sentence.data(), sentence.data() + sentence.size(), sent_vec))
+        throw runtime_error("too short sentence, or OOV words");
+
+    return sent_vec;
+}
+
+/**
+ * @brief Paragraph vector of the sentence [begin, end) into `sent_vec` (which must be zero), with the
+ * buffers of `ctx`. The generator is reseeded for each sentence, so that its vector doesn't depend on
+ * which thread computes it. Returns false if the sentence has no known word.
+ */
+bool MonolingualModel::sentVec(TrainingContext& ctx, const char* begin, const char* end, VecRef sent_vec) {
     float alpha = config->learning_rate;  // TODO: decreasing learning rate
 
-    auto nodes = getNodes(sentence);  // no subsampling here
-    nodes.erase(
-        remove(nodes.begin(), nodes.end(), HuffmanNode::UNK),
-        nodes.end()); // remove UNK tokens
+    ctx.rand.setState(multivec::Random::seed(config->seed, 0));
+    vector<int>& nodes = ctx.nodes;
+    getIndices(begin, end, nodes);  // no subsampling here
+    nodes.erase(remove(nodes.begin(), nodes.end(), -1), nodes.end()); // remove OOV words
 
     if (nodes.empty())
-        throw runtime_error("too short sentence, or OOV words");
-
-    vec sent_vec(dimension, 0);
+        return false;
 
     for (int k = 0; k < config->iterations; ++k) {
         for (int word_pos = 0; word_pos < nodes.size(); ++word_pos) {
-            vec hidden(dimension, 0);
-            HuffmanNode cur_node = nodes[word_pos];
+            vec& hidden = ctx.hidden;
+            hidden.fill(0);
+            int cur_node = nodes[word_pos];
 
-            int this_window_size = 1 + multivec::rand() % config->window_size;
+            int this_window_size = 1 + ctx.rand() % config->window_size;
             int count = 0;
 
             for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
                 if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
-                hidden += input_weights[nodes[pos].index];
+                hidden += input_weights[nodes[pos]];
                 ++count;
             }
 
             if (count == 0) continue;
-            hidden = (hidden + sent_vec) / (count + 1); // TODO this or (hidden / count) + sent_vec?
+            hidden += sent_vec;
+            hidden /= count + 1; // TODO this or (hidden / count) + sent_vec?
 
-            vec error(dimension, 0);
+            ctx.error.fill(0);
             if (config->hierarchical_softmax) {
-                error += hierarchicalUpdate(cur_node, hidden, alpha, false);
+                hierarchicalUpdate(ctx, cur_node, hidden, alpha, false);
             }
             if (config->negative > 0) {
-                error += negSamplingUpdate(cur_node, hidden, alpha, false);
+                negSamplingUpdate(ctx, cur_node, hidden, alpha, false);
             }
 
-            sent_vec += error;
+            sent_vec += ctx.error;
         }
     }
 
-    return sent_vec;
+    return true;
 }
 
 
 /**
- * @brief Train model using given text file. Training is performed in parallel (each
- * thread reads one chunk of the file). Learning rate decays to zero.
+ * @brief Train model using given text file. Training is performed in parallel (the file is divided
+ * into many chunks, which are handed out to the threads by a ChunkScheduler). Learning rate decays to zero.
  * Before calling this method, you need to call initialize or load, to initialize
  * the model parameters (vocabulary, unigram table, weights, etc.)
  *
@@ -418,50 +1079,189 @@ vec MonolingualModel::sentVec(const string& sentence) {
  **/
 void MonolingualModel::train(const string& training_file, bool initialize) {
     std::cout << "Training file: " << training_file << std::endl;
+    Corpus corpus(training_file); // memory-mapped
+
+    if (initialize)
+        clearInference(); // training from scratch is fine
+    checkTrainable();
+    unique_ptr<Cluster> cluster = openCluster(*config); // distributed training: this process trains its shard
+    metrics.reset();
+    auto phase_start = high_resolution_clock::now();
 
     if (initialize) {
         if (config->verbose)
             std::cout << "Creating new model" << std::endl;
 
-        // reads vocab and initializes unigram table
-        readVocab(training_file);
+        readVocab(corpus, cluster.get());
         initNet();
     } else if (vocab_word_count == 0) {
         // TODO: check that everything is initialized, and dimension is OK
         throw runtime_error("the model needs to be initialized before training");
+    } else if (output_weights.empty() && output_weights_hs.empty()) {
+        throw runtime_error("the model has no output weights (imported vectors can't be trained)");
+    } else if (config->grow_vocab) {
+        growVocab(corpus);
     }
 
-    // TODO: also serialize training state
+    initSampler();
+    ann_index.clear(); // the weights are going to change
+    metrics.addTime(TrainingMetrics::vocab, phase_start);
+
+    // each call starts a new learning rate schedule (an interrupted training is continued with resume)
     words_processed = 0;
     alpha = config->learning_rate;
 
-    // read file to find out the beginning of each chunk
-    // also counts the number of lines and words
-    auto chunks = chunkify(training_file, config->threads);
+    // split the file into small chunks, and count the number of lines and words
+    phase_start = high_resolution_clock::now();
+    long long n_chunks = max(config->threads, 1) * ChunkScheduler::chunks_per_thread;
+    if (cluster)
+        n_chunks = cluster->broadcast(n_chunks); // the processes synchronize at the same tasks
+    auto chunks = chunkify(corpus, static_cast<int>(n_chunks), cluster.get());
+    metrics.addTime(TrainingMetrics::chunkify, phase_start);
 
     if (config->verbose)
         std::cout << "Number of lines: " << training_lines
                   << ", words: " << training_words << std::endl;
 
-    if (config->sent_vector)
+    if (config->sent_vector) {
         // no incremental training for paragraph vector
+        indexDocuments(corpus, chunks);
         initSentWeights();
+    }
+
+    TrainingState state;
+    trainChunks(corpus, chunks, state, cluster.get());
+}
+
+/**
+ * @brief Continue a training which was interrupted after writing `checkpoint_file` (see Config::checkpoint),
+ * at the chunk where the checkpoint was taken, with its learning rate, word count and random generators.
+ * Training on one thread gives the same model as an uninterrupted training.
+ *
+ * The model must be loaded from `checkpoint_file` first, so that the options which aren't saved in the
+ * model (e.g. the checkpoints) can be set in between. The number of threads can change.
+ */
+void MonolingualModel::resume(const string& training_file, const string& checkpoint_file) {
+    std::cout << "Training file: " << training_file << std::endl;
+    Corpus corpus(training_file);
+
+    checkTrainable();
+    if (vocab_word_count == 0 || (output_weights.empty() && output_weights_hs.empty())) {
+        throw runtime_error("the model needs to be loaded from the checkpoint before resuming");
+    }
+    if (!config->cluster.empty()) {
+        throw runtime_error("checkpoints can't be resumed by a distributed training");
+    }
+
+    TrainingState state;
+    loadTrainingState(checkpoint_file, state);
+    metrics.reset();
+
+    // same chunks as the interrupted training
+    auto phase_start = high_resolution_clock::now();
+    auto chunks = chunkify(corpus, static_cast<int>(state.chunks));
+    metrics.addTime(TrainingMetrics::chunkify, phase_start);
+    if (static_cast<long long>(corpus.size()) != state.corpus_size || training_words != state.training_words) {
+        throw runtime_error("the checkpoint " + checkpoint_file + " wasn't written when training on " + training_file);
+    }
+
+    if (config->sent_vector) {
+        indexDocuments(corpus, chunks);
+        if (!config->sent_vector_file.empty())
+            initSentWeights(false); // not in the checkpoint: training continues with the current values of the file
+        if (sent_weights.rows() != (config->doc_ids ? doc_ids.size() : static_cast<size_t>(training_lines))) {
+            throw runtime_error("the sentence vectors of " + checkpoint_file + " don't match " + training_file);
+        }
+    }
+
+    initSampler();
+    ann_index.clear();
+    words_processed = state.words_processed;
+    alpha = state.alpha;
+
+    if (config->verbose)
+        std::cout << "Resuming epoch " << state.task / max(state.chunks, 1LL) + 1 << " at chunk "
+                  << state.task % max(state.chunks, 1LL) << std::endl;
+
+    trainChunks(corpus, chunks, state);
+}
+
+/**
+ * @brief Train the chunks of all the epochs from `state.task`, in parallel, and write checkpoints if
+ * config->checkpoint is set. `state.threads` contains the initial state of each thread (threads which
+ * aren't in there start with their own seed).
+ *
+ * With a cluster, the weights are averaged over the processes every config->sync_words words (see
+ * WeightAverager), and at the end of training, so that all the processes end up with the same model.
+ *
+ * The threads publish their counts to `metrics`, which are written to config->metrics_file every
+ * config->metrics_interval seconds if it is set.
+ */
+void MonolingualModel::trainChunks(const Corpus& corpus, const vector<Chunk>& chunks, TrainingState& state,
+                                   Cluster* cluster) {
+    size_t n_threads = max(config->threads, 1);
+    state.chunks = chunks.size();
+    words_processed += state.setThreads(n_threads, config->seed); // threads of the checkpoint which aren't resumed
+    state.corpus_size = corpus.size();
+    state.training_words = training_words;
+    ChunkScheduler scheduler(chunks.size(), config->iterations, state.task);
+
+    unique_ptr<CheckpointWriter> writer;
+    vector<const mat*> weights = { &input_weights, &output_weights, &output_weights_hs, &sent_weights };
+    mat no_sent_weights; // sentence vectors stored in a file are too large to be copied into the checkpoints
+    if (!config->sent_vector_file.empty())
+        weights[3] = &no_sent_weights;
+    if (!config->checkpoint.empty()) {
+        writer.reset(new CheckpointWriter(config->checkpoint, [this](const string& filename, const Checkpoint& checkpoint) {
+            saveCheckpoint(filename, *this, checkpoint);
+        }));
+        scheduler.setCheckpoints(checkpointInterval(config->checkpoint_words, training_words, chunks.size()),
+            [&](long long task) {
+                state.task = task;
+                state.words_processed = words_processed;
+                state.alpha = alpha.load(memory_order_relaxed);
+                writer->push(weights, state);
+            });
+    }
+
+    unique_ptr<WeightAverager> averager;
+    if (cluster && cluster->size() > 1) {
+        averager.reset(new WeightAverager(*cluster, { &input_weights, &output_weights, &output_weights_hs }));
+        long long words = cluster->sum(training_words) / cluster->size(); // same interval on all the processes
+        scheduler.setSynchronization(checkpointInterval(config->sync_words, words, chunks.size()),
+            [&]() { averager->sync(); });
+    }
+
+    ThreadCounters* counters = metrics.startThreads(n_threads);
+    unique_ptr<MetricsWriter> metrics_writer;
+    if (!config->metrics_file.empty())
+        metrics_writer.reset(new MetricsWriter(config->metrics_file, config->metrics_interval, metrics));
 
     high_resolution_clock::time_point start = high_resolution_clock::now();
-    if (config->threads == 1) {
-        trainChunk(training_file, chunks, 0);
+    if (n_threads == 1) {
+        trainChunk(corpus, chunks, scheduler, state.threads[0], counters[0]);
     } else {
         vector<thread> threads;
 
-        for (int i = 0; i < config->threads; ++i) {
-            threads.push_back(thread(&MonolingualModel::trainChunk, this,
-                training_file, chunks, i));
+        for (size_t i = 0; i < n_threads; ++i) {
+            threads.push_back(thread([&, i]() {
+                if (config->pin_threads)
+                    numa::pinThread(i);
+                trainChunk(corpus, chunks, scheduler, state.threads[i], counters[i]);
+            }));
         }
 
         for (auto it = threads.begin(); it != threads.end(); ++it) {
             it->join();
         }
     }
+    if (writer)
+        writer->finish();
+    if (averager)
+        averager->sync();
+    metrics.addTime(TrainingMetrics::training, start);
+    if (metrics_writer)
+        metrics_writer->finish();
     high_resolution_clock::time_point end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start).count();
 
@@ -472,258 +1272,362 @@ void MonolingualModel::train(const string& training_file, bool initialize) {
 }
 
 /**
- * @brief Divide a given file into chunks with the same number of lines each
- *
- * @param filename path of the file
- * @param n_chunks number of chunks
- * @return starting position (in bytes) of each chunk
+ * @brief Divide the training corpus into chunks of roughly the same size, and count its lines and
+ * words (used for progress estimation and sentence vectors). With a cluster, only the chunks of the
+ * shard of this process.
  */
-vector<long long> MonolingualModel::chunkify(const string& filename, int n_chunks) {
-    ifstream infile(filename);
-
-    try {
-        check_is_open(infile, filename);
-        check_is_non_empty(infile, filename);
-    } catch (...) {
-        throw;
-    }
-
-    vector<long long> chunks;
-    vector<long long> line_positions;
-    long long words = 0;
-
-    string line;
-    do {
-        line_positions.push_back(static_cast<long long>(infile.tellg()));
-        words += split(line).size();
-    } while (getline(infile, line));
-    words += split(line).size();
-
-    training_lines = line_positions.size() - 1;
-    training_words = words;
-    int chunk_size = line_positions.size() / n_chunks;  // number of lines in each chunk
+vector<Chunk> MonolingualModel::chunkify(const Corpus& corpus, int n_chunks, const Cluster* cluster) {
+    if (cluster)
+        return setTrainingStats(corpus.chunkify(n_chunks, config->threads, cluster->rank(), cluster->size()));
+    return setTrainingStats(corpus.chunkify(n_chunks, config->threads));
+}
 
-    for (int i = 0; i < n_chunks; i++) {
-        long long chunk_start = line_positions[i * chunk_size];
-        chunks.push_back(chunk_start);
+vector<Chunk> MonolingualModel::setTrainingStats(const vector<Chunk>& chunks) {
+    training_lines = 0;
+    training_words = 0;
+    for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+        training_lines += it->lines;
+        training_words += it->words;
     }
-
     return chunks;
 }
 
-void MonolingualModel::trainChunk(const string& training_file,
-                                  const vector<long long>& chunks,
-                                  int chunk_id) {
-    ifstream infile(training_file);
+/**
+ * @brief Training thread: trains the chunks handed out by `scheduler` until all the epochs are done,
+ * starting from `thread_state`, which is updated after each chunk (for the checkpoints). Its counts are
+ * published to `counters` with the same frequency as the learning rate updates.
+ */
+void MonolingualModel::trainChunk(const Corpus& corpus,
+                                  const vector<Chunk>& chunks,
+                                  ChunkScheduler& scheduler,
+                                  ThreadState& thread_state,
+                                  ThreadCounters& counters) {
     float starting_alpha = config->learning_rate;
     int max_iterations = config->iterations;
 
-    try {
-        check_is_open(infile, training_file);
-        check_is_non_empty(infile, training_file);
-    } catch (...) {
-        throw;
-    }
-
-    for (int k = 0; k < max_iterations; ++k) {
-        int word_count = 0, last_count = 0;
-
-        infile.clear();
-        infile.seekg(chunks[chunk_id], infile.beg);
+    // random generator and buffers of this thread, reused from one sentence to the next
+    TrainingContext ctx(config->dimension, thread_state.rand_state);
+    ctx.alpha = alpha.load(memory_order_relaxed); // until the first update
+
+    int epoch, current_epoch = thread_state.epoch;
+    size_t chunk_id;
+    int word_count = static_cast<int>(thread_state.pending_words), last_count = 0;
+    while (scheduler.next(epoch, chunk_id)) {
+        if (epoch != current_epoch) {
+            words_processed.fetch_add(word_count - last_count);
+            word_count = last_count = 0;
+            current_epoch = epoch;
+        }
 
-        int chunk_size = training_lines / chunks.size();
-        int sent_id = chunk_id * chunk_size;
+        const Chunk& chunk = chunks[chunk_id];
+        int sent_id = chunk.first_line;
 
-        string sent;
-        while (getline(infile, sent)) {
-            word_count += trainSentence(sent, sent_id++); // asynchronous update (possible race conditions)
+        // sentences are tokenized directly from the mapped file
+        const char* end = corpus.data() + chunk.end;
+        for (const char* sent = corpus.data() + chunk.begin; sent < end; ) {
+            const char* eol = Corpus::lineEnd(sent, end);
+            int row = config->doc_ids ? documentRow(sent, eol) : sent_id;
+            word_count += trainSentence(ctx, sent, eol, row); // asynchronous update (possible race conditions)
+            ++sent_id;
+            sent = eol + 1;
 
             // update learning rate
             if (word_count - last_count > 10000) {
-                words_processed += word_count - last_count; // asynchronous update
+                long long processed = words_processed.fetch_add(word_count - last_count) + word_count - last_count;
                 last_count = word_count;
+                counters.publish(ctx.counts);
 
                 // decreasing learning rate
-                alpha = starting_alpha * (1 - static_cast<float>(words_processed) / (max_iterations * training_words));
-                alpha = max(alpha, starting_alpha * 0.0001f);
+                ctx.alpha = starting_alpha * (1 - static_cast<float>(processed) / (max_iterations * training_words));
+                ctx.alpha = max(ctx.alpha, starting_alpha * 0.0001f);
+                alpha.store(ctx.alpha, memory_order_relaxed); // for the checkpoints
 
                 if (config->verbose) {
-                    printf("\rAlpha: %f  Progress: %.2f%%", alpha, 100.0 * words_processed /
+                    printf("\rAlpha: %f  Progress: %.2f%%", ctx.alpha, 100.0 * processed /
                                     (max_iterations * training_words));
                     fflush(stdout);
                 }
             }
-
-            // stop when reaching the end of a chunk
-            if (chunk_id < chunks.size() - 1 && infile.tellg() >= chunks[chunk_id + 1])
-                break;
         }
 
-        words_processed += word_count - last_count;
+        // before the chunk is done, so that a checkpoint taken after it sees this state
+        thread_state.rand_state = ctx.rand.state();
+        thread_state.pending_words = word_count - last_count;
+        thread_state.epoch = current_epoch;
+        counters.publish(ctx.counts);
+        scheduler.done();
     }
+
+    words_processed.fetch_add(word_count - last_count);
 }
 
-int MonolingualModel::trainSentence(const string& sent, int sent_id) {
-    auto nodes = getNodes(sent);  // same size as sent, OOV words are replaced by <UNK>
+int MonolingualModel::trainSentence(TrainingContext& ctx, const char* begin, const char* end, int sent_id) {
+    vector<int>& nodes = ctx.nodes;
+    getIndices(begin, end, nodes);  // same size as sent, OOV words are replaced by -1
 
     // counts the number of words that are in the vocabulary
-    int words = nodes.size() - count(nodes.begin(), nodes.end(), HuffmanNode::UNK);
+    int words = nodes.size() - count(nodes.begin(), nodes.end(), -1);
+    ctx.counts.words += words;
+    ++ctx.counts.sentences;
 
     if (config->subsampling > 0) {
-        subsample(nodes); // puts <UNK> tokens in place of the discarded tokens
+        subsample(nodes, ctx.rand); // puts -1 in place of the discarded tokens
     }
 
+    // remove OOV and discarded words
+    nodes.erase(remove(nodes.begin(), nodes.end(), -1), nodes.end());
+
     if (nodes.empty()) {
+        ++ctx.counts.skipped_sentences;
         return words;
     }
 
-    // remove <UNK> tokens
-    nodes.erase(
-        remove(nodes.begin(), nodes.end(), HuffmanNode::UNK),
-        nodes.end());
-
     // Monolingual training
     for (int pos = 0; pos < nodes.size(); ++pos) {
-        trainWord(nodes, pos, sent_id);
+        trainWord(ctx, pos, sent_id);
     }
 
     return words; // returns the number of words processed, for progress estimation
 }
 
-void MonolingualModel::trainWord(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
+void MonolingualModel::trainWord(TrainingContext& ctx, int word_pos, int sent_id) {
     if (config->skip_gram) {
-        trainWordSkipGram(nodes, word_pos, sent_id);
+        trainWordSkipGram(ctx, word_pos, sent_id);
     } else {
-        trainWordCBOW(nodes, word_pos, sent_id);
+        trainWordCBOW(ctx, word_pos, sent_id);
     }
 }
 
-void MonolingualModel::trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
-    int dimension = config->dimension;
-    vec hidden(dimension, 0);
-    HuffmanNode cur_node = nodes[word_pos];
+void MonolingualModel::trainWordCBOW(TrainingContext& ctx, int word_pos, int sent_id) {
+    const vector<int>& nodes = ctx.nodes;
+    const simd::Kernels& kernels = ctx.kernels;
+    size_t d = config->dimension;
+    vec& hidden = ctx.hidden;
+    hidden.fill(0);
+    int cur_node = nodes[word_pos];
 
-    int this_window_size = 1 + multivec::rand() % config->window_size; // reduced window
+    int this_window_size = 1 + ctx.rand() % config->window_size; // reduced window
     int count = 0;
 
     for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
-        hidden += input_weights[nodes[pos].index];
+        kernels.axpy(1.0f, input_weights[nodes[pos]].data(), hidden.data(), d);
         ++count;
     }
 
-    if (config->sent_vector) {
-        hidden += sent_weights[sent_id];
+    bool sent_vector = config->sent_vector && sent_id >= 0; // lines without a document ID have no sentence vector
+    if (sent_vector) {
+        kernels.axpy(1.0f, sent_weights[sent_id].data(), hidden.data(), d);
         ++count;
     }
 
     if (count == 0) return;
-    hidden /= count;
+    kernels.scale(1.0f / count, hidden.data(), d);
 
-    vec error(dimension, 0);
+    vec& error = ctx.error;
+    error.fill(0);
     if (config->hierarchical_softmax) {
-        error += hierarchicalUpdate(cur_node, hidden, alpha);
+        hierarchicalUpdate(ctx, cur_node, hidden, ctx.alpha);
     }
     if (config->negative > 0) {
-        error += negSamplingUpdate(cur_node, hidden, alpha);
+        negSamplingUpdate(ctx, cur_node, hidden, ctx.alpha);
     }
 
     // update input weights
     for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
-        input_weights[nodes[pos].index] += error;
+        kernels.axpy(1.0f, error.data(), input_weights[nodes[pos]].data(), d);
     }
 
-    if (config->sent_vector) {
-        sent_weights[sent_id] += error;
+    if (sent_vector) {
+        kernels.axpy(1.0f, error.data(), sent_weights[sent_id].data(), d);
     }
 }
 
-void MonolingualModel::trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
-    int dimension = config->dimension;
-    HuffmanNode input_word = nodes[word_pos]; // use this word to predict surrounding words
+void MonolingualModel::trainWordSkipGram(TrainingContext& ctx, int word_pos, int sent_id) {
+    const vector<int>& nodes = ctx.nodes;
+    int input_word = nodes[word_pos]; // use this word to predict surrounding words
 
-    int this_window_size = 1 + multivec::rand() % config->window_size;
+    int this_window_size = 1 + ctx.rand() % config->window_size;
+    bool shared_negatives = config->shared_negatives && config->negative > 0;
+    bool pairs = config->hierarchical_softmax || !shared_negatives; // updates for each (word, context word) pair
 
-    for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
+    for (int pos = word_pos - this_window_size; pairs && pos <= word_pos + this_window_size; ++pos) {
         int p = pos;
         if (p == word_pos) continue;
         if (p < 0 || p >= nodes.size()) continue;
-        HuffmanNode output_word = nodes[p];
+        int output_word = nodes[p];
 
-        vec error(dimension, 0);
+        ctx.error.fill(0);
         if (config->hierarchical_softmax) {
-            error += hierarchicalUpdate(output_word, input_weights[input_word.index], alpha);
+            hierarchicalUpdate(ctx, output_word, input_weights[input_word], ctx.alpha);
+        }
+        if (config->negative > 0 && !shared_negatives) {
+            negSamplingUpdate(ctx, output_word, input_weights[input_word], ctx.alpha);
+        }
+
+        ctx.kernels.axpy(1.0f, ctx.error.data(), input_weights[input_word].data(), config->dimension);
+    }
+
+    if (shared_negatives) {
+        trainWindowSharedNegatives(ctx, word_pos, this_window_size);
+    }
+}
+
+namespace {
+
+const SigmoidTable sigmoid_table;
+
+/**
+ * @brief Sigmoid of the training updates: clipped to 0 or 1 beyond MAX_EXP, exact or read from the table
+ * in between (sigmoid_table option)
+ */
+inline float predict(const Config& config, float x) {
+    if (x >= MAX_EXP) return 1;
+    if (x <= -MAX_EXP) return 0;
+    return config.sigmoid_table ? sigmoid_table(x) : sigmoid(x);
+}
+
+} // namespace
+
+/**
+ * @brief Negative sampling on a whole skip-gram window at once (shared_negatives option), as in Ji et al.,
+ * "Parallelizing Word2Vec in Shared and Distributed Memory": the context words predict the current word,
+ * against a single set of negative samples for the window.
+ *
+ * The rows involved are copied into two small matrices, of inputs (context words) and outputs (current word
+ * and negative samples). The errors are computed from their product inputs * outputs^T, and the updates are
+ * the products errors * outputs and errors^T * inputs, which are then added to the weights. Each output
+ * row is read and written once per window, instead of once per context word, which means fewer samples to
+ * draw, and much less contention between threads on the rows of frequent words.
+ */
+void MonolingualModel::trainWindowSharedNegatives(TrainingContext& ctx, int word_pos, int window_size) {
+    const vector<int>& nodes = ctx.nodes;
+    int word = nodes[word_pos];
+    size_t d = config->dimension;
+    const simd::Kernels& kernels = ctx.kernels;
+
+    vector<int>& inputs = ctx.window_inputs;
+    vector<int>& outputs = ctx.window_outputs;
+    inputs.clear();
+    outputs.clear();
+    for (int pos = word_pos - window_size; pos <= word_pos + window_size; ++pos) {
+        if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
+        inputs.push_back(nodes[pos]);
+    }
+    if (inputs.empty()) return;
+
+    outputs.push_back(word); // positive example, followed by the negative examples
+    const UnigramSampler& local_sampler = localSampler(ctx);
+    for (int k = 0; k < config->negative; ++k) {
+        int target = local_sampler.sample(ctx.rand());
+        if (target != word) outputs.push_back(target);
+    }
+
+    size_t m = inputs.size(), n = outputs.size();
+    ctx.window_weights.resize((m + n) * d);
+    ctx.window_updates.assign((m + n) * d, 0.0f);
+    ctx.window_errors.resize(m * n);
+    float* in = ctx.window_weights.data();
+    float* out = in + m * d;
+    float* in_updates = ctx.window_updates.data();
+    float* out_updates = in_updates + m * d;
+    float* errors = ctx.window_errors.data();
+
+    for (size_t i = 0; i < m; ++i) {
+        memcpy(in + i * d, input_weights[inputs[i]].data(), sizeof(float) * d);
+    }
+    for (size_t j = 0; j < n; ++j) {
+        memcpy(out + j * d, output_weights[outputs[j]].data(), sizeof(float) * d);
+    }
+
+    ctx.counts.negative_updates += m * n;
+    for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            float x = kernels.dot(in + i * d, out + j * d, d);
+            float pred = predict(*config, x);
+            errors[i * n + j] = ctx.alpha * ((j == 0 ? 1 : 0) - pred);
         }
-        if (config->negative > 0) {
-            error += negSamplingUpdate(output_word, input_weights[input_word.index], alpha);
+    }
+
+    for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            kernels.axpy(errors[i * n + j], out + j * d, in_updates + i * d, d);
+            kernels.axpy(errors[i * n + j], in + i * d, out_updates + j * d, d);
         }
+    }
 
-        input_weights[input_word.index] += error;
+    for (size_t i = 0; i < m; ++i) {
+        kernels.axpy(1.0f, in_updates + i * d, input_weights[inputs[i]].data(), d);
+    }
+    for (size_t j = 0; j < n; ++j) {
+        kernels.axpy(1.0f, out_updates + j * d, output_weights[outputs[j]].data(), d);
     }
 }
 
-vec MonolingualModel::negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update) {
-    int dimension = config->dimension;
-    vec temp(dimension, 0);
+void MonolingualModel::negSamplingUpdate(TrainingContext& ctx, int word, ConstVecRef hidden, float alpha, bool update) {
+    const simd::Kernels& kernels = ctx.kernels;
+    const UnigramSampler& local_sampler = localSampler(ctx);
+    size_t dimension = config->dimension;
 
     for (int d = 0; d < config->negative + 1; ++d) {
         int label;
-        const HuffmanNode* target;
+        int target;
 
         if (d == 0) { // 1 positive example
-            target = &node;
+            target = word;
             label = 1;
         } else { // n negative examples
-            target = getRandomHuffmanNode();
-            if (*target == node) continue;
+            target = local_sampler.sample(ctx.rand());
+            if (target == word) continue;
             label = 0;
         }
+        ++ctx.counts.negative_updates;
 
-        float x = hidden.dot(output_weights[target->index]);
+        float* output = output_weights[target].data();
+        float x = kernels.dot(hidden.data(), output, dimension);
 
-        float pred;
-        if (x >= MAX_EXP) {
-            pred = 1;
-        } else if (x <= -MAX_EXP) {
-            pred = 0;
-        } else {
-            pred = sigmoid(x);
-        }
-        float error = alpha * (label - pred);
+        float error = alpha * (label - predict(*config, x));
 
-        temp += error * output_weights[target->index];
-
-        if (update)
-            output_weights[target->index] += error * hidden;
+        if (update) // ctx.error += error * output, then output += error * hidden
+            kernels.update(error, hidden.data(), output, ctx.error.data(), dimension);
+        else
+            kernels.axpy(error, output, ctx.error.data(), dimension);
     }
-
-    return temp;
 }
 
-vec MonolingualModel::hierarchicalUpdate(const HuffmanNode& node, const vec& hidden,
+void MonolingualModel::hierarchicalUpdate(TrainingContext& ctx, int word, ConstVecRef hidden,
         float alpha, bool update) {
-    int dimension = config->dimension;
-    vec temp(dimension, 0);
+    const simd::Kernels& kernels = ctx.kernels;
+    const HuffmanCodes& codes = localHuffman(ctx);
+    size_t dimension = config->dimension;
 
-    for (int j = 0; j < node.code.size(); ++j) {
-        int parent_index = node.parents[j];
-        float x = hidden.dot(output_weights_hs[parent_index]);
+    for (int j = codes.offsets[word]; j < codes.offsets[word + 1]; ++j) {
+        float* output = output_weights_hs[codes.parents[j]].data();
+        float x = kernels.dot(hidden.data(), output, dimension);
 
         if (x <= -MAX_EXP || x >= MAX_EXP) {
             continue;
         }
+        ++ctx.counts.hs_updates;
 
-        float pred = sigmoid(x);
-        float error = -alpha * (pred - node.code[j]);
-
-        temp += error * output_weights_hs[parent_index];
+        float pred = predict(*config, x);
+        float error = -alpha * (pred - codes.bit(j));
 
         if (update)
-            output_weights_hs[parent_index] += error * hidden;
+            kernels.update(error, hidden.data(), output, ctx.error.data(), dimension);
+        else
+            kernels.axpy(error, output, ctx.error.data(), dimension);
     }
+}
 
-    return temp;
+vector<string> MonolingualModel::getWordsByIndex() const {
+    vector<string> res;
+    res.reserve(words_by_index.size());
+    for (auto it = words_by_index.begin(); it != words_by_index.end(); ++it) {
+        res.push_back(**it);
+    }
+    return res;
 }
 
 vector<pair<string, int>> MonolingualModel::getWords() const {
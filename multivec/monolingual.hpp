@@ -1,11 +1,64 @@
 #pragma once
 #include "utils.hpp"
+#include "corpus.hpp"
+#include "vocab.hpp"
+#include "knn.hpp"
+#include "ann.hpp"
+#include "vectors.hpp"
+#include "checkpoint.hpp"
+#include "numa.hpp"
+#include "cluster.hpp"
+#include "metrics.hpp"
+
+class ModelReader;
+
+/**
+ * @brief State owned by a single training thread: random generator, scratch buffers for the
+ * hidden layer and the error, and token buffer. Nothing in here is shared between threads.
+ */
+struct TrainingContext {
+    multivec::Random rand;
+    vec hidden;
+    vec error;
+    vector<int> nodes; // vocabulary indices of the current sentence
+
+    // skip-gram with shared negatives (see trainWindowSharedNegatives)
+    vector<int> window_inputs, window_outputs; // rows of input_weights and output_weights
+    vector<float> window_weights; // copies of those rows
+    vector<float> window_updates;
+    vector<float> window_errors;
+
+    const simd::Kernels& kernels; // kernels compiled for this dimension, if it is one of the fixed dimensions
+    int node; // NUMA node of this thread, whose copies of the read-only structures it uses (see Config::pin_threads)
+    TrainingCounts counts; // published to the TrainingMetrics of the model by the training loop
+    float alpha; // learning rate, computed by this thread from the words processed by all the threads
+
+    TrainingContext(int dimension, unsigned long long seed) :
+        rand(seed), hidden(dimension), error(dimension), kernels(simd::kernelsFor(dimension)),
+        node(numa::currentNode()), alpha(0) {}
+};
+
+/**
+ * @brief Scratch buffers for scoring sentence pairs (e.g. softWER), reused from one pair to the next.
+ */
+struct ScoringContext {
+    vector<int> words1, words2; // vocabulary indices (-1 for OOV words)
+    vector<const float*> units1, units2; // normalized embeddings of those words
+    vector<float> storage1, storage2; // normalized embeddings, when they aren't precomputed
+    vector<float> costs; // substitution costs (flat matrix)
+    vector<float> row; // current row of the edit distance matrix
+};
 
 class MonolingualModel
 {
     friend class BilingualModel;
-    friend void save(ofstream& outfile, const MonolingualModel& model);
-    friend void load(ifstream& infile, MonolingualModel& model);
+    friend void save(ofstream& outfile, const MonolingualModel& model, Precision precision);
+    friend void load(const string& filename, MonolingualModel& model);
+    friend void saveSection(ofstream& outfile, const MonolingualModel& model, Precision precision, const mat* weights);
+    friend void saveCheckpoint(const string& filename, const MonolingualModel& model, const Checkpoint& checkpoint);
+    friend void loadSection(ModelReader& reader, MonolingualModel& model, Precision precision);
+    friend void loadLegacy(ifstream& infile, MonolingualModel& model);
+    friend struct PerfBenchmark; // microbenchmarks of the training methods (benchmarks/perf.cpp)
 
 private:
     Config* const config;
@@ -13,7 +66,7 @@ private:
     mat input_weights;
     mat output_weights; // output weights for negative sampling
     mat output_weights_hs; // output weights for hierarchical softmax
-    mat sent_weights;
+    mat sent_weights; // one row per line of the training file, or per document (see Config::doc_ids)
 
     long long vocab_word_count; // property of vocabulary (sum of all word counts)
 
@@ -21,76 +74,161 @@ private:
     long long training_words; // total number of words in training file (used for progress estimation)
     long long training_lines;
     // training state
-    long long words_processed;
-    float alpha;
+    std::atomic<long long> words_processed; // added to by all the training threads
+    std::atomic<float> alpha; // last learning rate of the training threads (each one uses its own, see TrainingContext)
 
     unordered_map<string, HuffmanNode> vocabulary;
-    vector<HuffmanNode*> unigram_table;
+    UnigramSampler sampler; // negative sampling distribution (only built for training)
+    std::mutex sampler_mutex; // see initInferenceSampler
 
-    void addWordToVocab(const string& word);
-    void reduceVocab();
-    void createBinaryTree();
-    void assignCodes(HuffmanNode* node, vector<int> code, vector<int> parents) const;
-    void initUnigramTable();
+    // inference mode (see load): embeddings of a single policy, and the same embeddings normalized
+    int inference_policy; // -1 when the model isn't in inference mode
+    mat embeddings;
+    mat unit_embeddings;
+    // inference mode with a quantized model: only the normalized embeddings (quantized), and their norms
+    QuantizedMat unit_quantized;
+    vector<float> embedding_norms;
 
-    HuffmanNode* getRandomHuffmanNode(); // uses the unigram frequency table to sample a random node
+    vector<QuantizedMat> quantized_weights; // matrices of a quantized model file, until load() is done with them
 
-    vector<HuffmanNode> getNodes(const string& sentence) const;
-    void subsample(vector<HuffmanNode>& node) const;
+    AnnIndex ann_index; // approximate nearest neighbor index, saved next to the model file (see buildIndex)
 
-    void readVocab(const string& training_file);
-    void initNet();
-    void initSentWeights();
+    // flat per-word arrays, indexed by word index
+    vector<int> word_counts; // built by indexVocab
+    vector<const string*> words_by_index; // built by indexVocab
+    HuffmanCodes huffman; // built by createBinaryTree
 
-    void trainChunk(const string& training_file, const vector<long long>& chunks, int chunk_id);
+    // copies of the read-only training structures on each NUMA node, built by initSampler (see Config::pin_threads)
+    struct NodeCopy {
+        UnigramSampler sampler;
+        HuffmanCodes huffman;
+    };
+    vector<NodeCopy> node_copies;
 
-    int trainSentence(const string& sent, int sent_id);
-    void trainWord(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
-    void trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
-    void trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
+    // metrics of the current or last training, including its save time (hence mutable)
+    mutable TrainingMetrics metrics;
 
-    vec hierarchicalUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true);
-    vec negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true);
+    // documents of the training file (see Config::doc_ids), whose rows in sent_weights are in order of first appearance
+    vector<string> doc_ids;
+    unordered_map<string, int> doc_rows;
 
-    vector<long long> chunkify(const string& filename, int n_chunks);
+    void addWordToVocab(const string& word, int count = 1);
+    void reduceVocab();
+    void createBinaryTree();
+    void initSampler();
+    void initInferenceSampler();
+    const UnigramSampler& localSampler(const TrainingContext& ctx) const {
+        return ctx.node < static_cast<int>(node_copies.size()) ? node_copies[ctx.node].sampler : sampler;
+    }
+    const HuffmanCodes& localHuffman(const TrainingContext& ctx) const {
+        return ctx.node < static_cast<int>(node_copies.size()) ? node_copies[ctx.node].huffman : huffman;
+    }
+    void indexVocab();
+    void initInference(int policy);
+    void initUnitEmbeddings();
+    void clearInference();
+    void dequantizeWeights();
+    void checkPolicy(int policy) const;
+    void checkTrainable() const;
+    float cosine(int index, const vec& v, float v_norm, int policy) const;
+    const mat& unitWeights(int policy, mat& storage) const;
+    size_t unitVectors(const vector<int>& indices, int policy, vector<float>& storage, vector<const float*>& units) const;
+    float softWER(ScoringContext& ctx, const string& hyp, const string& ref, int policy) const;
+    vector<vector<pair<string, float>>> closest(const mat& queries, int n, int policy, const vector<int>& exclude,
+                                                int probes) const;
+
+    void getIndices(const char* begin, const char* end, vector<int>& indices) const; // OOV words get index -1
+    void getIndices(const string& sentence, vector<int>& indices) const;
+    void subsample(vector<int>& indices, multivec::Random& rand) const;
+
+    vector<WordCounts> countWords(const Corpus& corpus, const Cluster* cluster = nullptr) const;
+    void readVocab(const Corpus& corpus, Cluster* cluster = nullptr);
+    void gatherVocab(const vector<WordCounts>& shards, Cluster& cluster, size_t& distinct_words);
+    void growVocab(const Corpus& corpus);
+    void growBinaryTree(int old_words);
+    void initNet();
+    mat newWeights(size_t rows) const;
+    void indexDocuments(const Corpus& corpus, const vector<Chunk>& chunks);
+    int documentRow(const char*& begin, const char* end) const;
+    void initSentWeights(bool randomize = true);
+
+    void trainChunks(const Corpus& corpus, const vector<Chunk>& chunks, TrainingState& state, Cluster* cluster = nullptr);
+    void trainChunk(const Corpus& corpus, const vector<Chunk>& chunks, ChunkScheduler& scheduler, ThreadState& thread_state,
+                    ThreadCounters& counters);
+
+    bool sentVec(TrainingContext& ctx, const char* begin, const char* end, VecRef sent_vec);
+    void sentVecBatch(const vector<string>& sentences, mat& vectors);
+
+    int trainSentence(TrainingContext& ctx, const char* begin, const char* end, int sent_id);
+    void trainWord(TrainingContext& ctx, int word_pos, int sent_id);
+    void trainWordCBOW(TrainingContext& ctx, int word_pos, int sent_id);
+    void trainWordSkipGram(TrainingContext& ctx, int word_pos, int sent_id);
+    void trainWindowSharedNegatives(TrainingContext& ctx, int word_pos, int window_size);
+
+    // those add the gradient with respect to `hidden` to ctx.error
+    void hierarchicalUpdate(TrainingContext& ctx, int word, ConstVecRef hidden, float alpha, bool update = true);
+    void negSamplingUpdate(TrainingContext& ctx, int word, ConstVecRef hidden, float alpha, bool update = true);
+
+    // those also update training_lines and training_words
+    vector<Chunk> chunkify(const Corpus& corpus, int n_chunks, const Cluster* cluster = nullptr);
+    vector<Chunk> setTrainingStats(const vector<Chunk>& chunks);
     vec wordVec(int index, int policy) const;
 
 public:
-    MonolingualModel(Config* config) : config(config) {}  // prefer this constructor
+    MonolingualModel(Config* config) : config(config), vocab_word_count(0), inference_policy(-1) {}  // prefer this constructor
 
     vec wordVec(const string& word, int policy = 0) const; // word embedding
+    mat wordVecBatch(const vector<string>& words, int policy = 0) const; // one row per word (zeros for OOV words)
+    const mat& getEmbeddings(int policy = 0) const; // embedding matrix, without copy (rows in the order of getWordsByIndex)
     vec sentVec(const string& sentence); // paragraph vector (Le & Mikolov), TODO: custom alpha and iterations
-    void sentVec(istream& infile); // compute paragraph vector for all lines in a stream
+    mat sentVecBatch(const vector<string>& sentences); // paragraph vectors of many sentences, in parallel
+    void sentVec(istream& input, ostream& output = std::cout, bool binary = false); // paragraph vectors of all lines in a stream
 
     void train(const string& training_file, bool initialize = true); // training from scratch (resets vocabulary and weights)
+    // continues the training interrupted after writing this checkpoint (the model must be loaded from it first)
+    void resume(const string& training_file, const string& checkpoint_file);
 
     void saveVectorsBin(const string &filename, int policy = 0) const; // saves word embeddings in the word2vec binary format
     void saveVectors(const string &filename, int policy = 0) const; // saves word embeddings in the word2vec text format
-    void saveSentVectors(const string &filename) const;
-    void load(const string& filename); // loads the entire model
-    void save(const string& filename) const; // saves the entire model
+    void saveSentVectors(const string &filename, bool binary = false) const;
+    void loadVectors(const string& filename); // replaces the model with word embeddings in the word2vec text or binary format
+    void load(const string& filename, bool inference = false, int policy = 0); // loads the entire model, or only what `policy` needs
+    // saves the entire model (and its index), with quantized matrices if precision isn't float32 (see inference mode)
+    void save(const string& filename, Precision precision = Precision::float32) const;
+
+    // builds an approximate nearest neighbor index of the embeddings of `policy` (lists = 0: square root of the vocabulary size)
+    void buildIndex(int lists = 0, int policy = 0);
+    bool hasIndex() const { return !ann_index.empty(); }
 
     void normalizeWeights(); // normalize all weights between 0 and 1
 
     float similarity(const string& word1, const string& word2, int policy = 0) const; // cosine similarity
     float distance(const string& word1, const string& word2, int policy = 0) const; // 1 - cosine similarity
+    vector<float> similarityBatch(const vector<string>& words1, const vector<string>& words2, int policy = 0) const;
     float similarityNgrams(const string& seq1, const string& seq2, int policy = 0) const; // similarity between two sequences of same size
     float similaritySentence(const string& seq1, const string& seq2, int policy = 0) const; // similarity between two variable-size sequences
     // similarity between two variable-size sequences taking into account part-of-speech tags and inverse document frequencies of terms in the sequences
     float similaritySentenceSyntax(const string& seq1, const string& seq2, const string& tags1, const string& tags2,
                                    const vector<float>& idf1, const vector<float>& idf2, float alpha = 0.0, int policy = 0) const;
     float softWER(const string& hyp, const string& ref, int policy = 0) const; // soft Word Error Rate
+    vector<float> softWERBatch(const vector<string>& hyps, const vector<string>& refs, int policy = 0) const; // many pairs, in parallel
 
     vector<pair<string, float>> trg_closest(const string& src_word, int n = 10, int policy = 0) const; // n closest words to given word
     vector<pair<string, float>> src_closest(const string& trg_word, int n = 10, int policy = 0) const;
 
     int getDimension() const { return config->dimension; };
+    // metrics of the current or last training (thread-safe, can be read while another thread is training)
+    const TrainingMetrics& getMetrics() const { return metrics; }
 
-    vector<pair<string, float>> closest(const string& word, int n = 10, int policy = 0) const; // n closest words to given word
+    // with probes > 0, the search is approximate: only `probes` lists of the index are scanned (more probes: better recall, but slower)
+    vector<pair<string, float>> closest(const string& word, int n = 10, int policy = 0, int probes = 0) const; // n closest words to given word
     vector<pair<string, float>> closest(const string& word, const vector<string>& words, int policy = 0) const;
-    vector<pair<string, float>> closest(const vec& v, int n = 10, int policy = 0) const;
+    vector<pair<string, float>> closest(const vec& v, int n = 10, int policy = 0, int probes = 0) const;
+    vector<vector<pair<string, float>>> closestBatch(const vector<string>& words, int n = 10, int policy = 0,
+                                                     int probes = 0) const; // closest words for many words at once
 
     vector<pair<string, int>> getWords() const; // get words with their counts
+    vector<string> getWordsByIndex() const; // words in the order of the rows of the embedding matrices
     
-    void analogicalReasoning(const string& filename, int max_voc = 0, int policy = 0) const;
+    float analogicalReasoning(const string& filename, int max_voc = 0, int policy = 0, ostream& output = std::cout) const;
 };
@@ -0,0 +1,143 @@
+#include "numa.hpp"
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief CPUs of the process on each node, read once (before any thread is pinned)
+ */
+struct Topology {
+    vector<vector<int>> node_cpus;
+    vector<int> cpu_nodes; // node of each CPU (indexed by CPU number)
+    vector<int> order; // CPUs in pinning order: one from each node in turn
+
+    Topology() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(getpid(), sizeof(allowed), &allowed) != 0) { // mask of the main thread
+            return;
+        }
+
+        cpu_nodes.assign(CPU_SETSIZE, 0);
+        vector<int> node_ids; // node numbers aren't always contiguous
+        if (DIR* dir = opendir("/sys/devices/system/node")) {
+            while (dirent* entry = readdir(dir)) {
+                int id;
+                if (sscanf(entry->d_name, "node%d", &id) == 1) node_ids.push_back(id);
+            }
+            closedir(dir);
+        }
+        sort(node_ids.begin(), node_ids.end());
+
+        for (auto id = node_ids.begin(); id != node_ids.end(); ++id) {
+            ifstream infile("/sys/devices/system/node/node" + to_string(*id) + "/cpulist");
+            vector<int> cpus;
+            string range;
+            while (getline(infile, range, ',')) { // e.g. 0-15,32-47
+                int first, last;
+                int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if (n < 1) continue;
+                if (n == 1) last = first;
+                for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+                }
+            }
+            if (cpus.empty()) continue; // memory-only node, or not allowed
+            for (auto cpu = cpus.begin(); cpu != cpus.end(); ++cpu) cpu_nodes[*cpu] = node_cpus.size();
+            node_cpus.push_back(cpus);
+        }
+
+        if (node_cpus.empty()) { // no NUMA information: a single node
+            node_cpus.resize(1);
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &allowed)) node_cpus[0].push_back(cpu);
+            }
+        }
+
+        size_t max_cpus = 0;
+        for (auto cpus = node_cpus.begin(); cpus != node_cpus.end(); ++cpus) max_cpus = max(max_cpus, cpus->size());
+        for (size_t i = 0; i < max_cpus; ++i) {
+            for (auto cpus = node_cpus.begin(); cpus != node_cpus.end(); ++cpus) {
+                if (i < cpus->size()) order.push_back((*cpus)[i]);
+            }
+        }
+    }
+};
+
+const Topology& topology() {
+    static Topology topology; // thread-safe initialization
+    return topology;
+}
+
+void setAffinity(const vector<int>& cpus) {
+    if (cpus.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu = cpus.begin(); cpu != cpus.end(); ++cpu) CPU_SET(*cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set); // calling thread; pinning is only a hint, errors are ignored
+}
+
+}
+
+namespace numa {
+
+int nodes() {
+    return max<int>(topology().node_cpus.size(), 1);
+}
+
+int currentNode() {
+    const Topology& t = topology();
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < static_cast<int>(t.cpu_nodes.size()) ? t.cpu_nodes[cpu] : 0;
+}
+
+int pinThread(int i) {
+    const Topology& t = topology();
+    if (t.order.empty()) return 0;
+    int cpu = t.order[i % t.order.size()];
+    setAffinity(vector<int>(1, cpu));
+    return t.cpu_nodes[cpu];
+}
+
+void pinToNode(int node) {
+    const Topology& t = topology();
+    if (node < static_cast<int>(t.node_cpus.size())) setAffinity(t.node_cpus[node]);
+}
+
+Mat interleavedMat(size_t rows, size_t cols) {
+    size_t stride = Mat::paddedSize(cols);
+    size_t size = rows * stride * sizeof(float);
+    int n = nodes();
+    if (n < 2 || size == 0) return Mat(rows, cols);
+
+    // anonymous pages are zeros, and are allocated on the node of the thread which touches them first
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) throw bad_alloc();
+    shared_ptr<void> storage(addr, [size](void* p) { munmap(p, size); });
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    vector<thread> threads;
+    for (int node = 0; node < n; ++node) {
+        threads.push_back(thread([=]() {
+            pinToNode(node);
+            volatile char* data = static_cast<char*>(addr);
+            for (size_t offset = node * page; offset < size; offset += n * page) data[offset] = 0;
+        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+
+    return Mat(static_cast<float*>(addr), rows, cols, stride, storage);
+}
+
+}
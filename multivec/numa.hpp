@@ -0,0 +1,31 @@
+#pragma once
+#include "vec.hpp"
+
+/**
+ * @brief NUMA placement of the training threads and weights, from the topology in sysfs (Linux only).
+ * Without NUMA information, the machine is seen as a single node with all the CPUs of the process.
+ */
+namespace numa {
+
+int nodes(); // number of NUMA nodes with CPUs this process may run on (at least 1)
+int currentNode(); // node of the CPU the calling thread is running on
+
+/**
+ * @brief Pin the calling thread to the i-th CPU of the process, taken from each node in turn, so that
+ * consecutive threads are spread over the nodes.
+ * @return node of this CPU
+ */
+int pinThread(int i);
+
+/**
+ * @brief Restrict the calling thread to the CPUs of `node`, e.g. to allocate memory on this node
+ */
+void pinToNode(int node);
+
+/**
+ * @brief Zero matrix whose pages are interleaved over the nodes: each page is touched first by a thread
+ * pinned to the next node, and is allocated on this node. On a single node, this is a regular matrix.
+ */
+Mat interleavedMat(size_t rows, size_t cols);
+
+}
@@ -0,0 +1,115 @@
+#include "quantized.hpp"
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+Precision parsePrecision(const string& name) {
+    if (name == "float32") return Precision::float32;
+    if (name == "float16") return Precision::float16;
+    if (name == "int8") return Precision::int8;
+    throw runtime_error("unknown precision " + name + " (float32, float16 or int8)");
+}
+
+string precisionName(Precision precision) {
+    switch (precision) {
+        case Precision::float32: return "float32";
+        case Precision::float16: return "float16";
+        case Precision::int8: return "int8";
+    }
+    throw runtime_error("invalid precision");
+}
+
+size_t QuantizedMat::elementSize(Precision precision) {
+    switch (precision) {
+        case Precision::float16: return sizeof(uint16_t);
+        case Precision::int8: return sizeof(int8_t);
+        default: throw runtime_error("invalid precision for a quantized matrix");
+    }
+}
+
+size_t QuantizedMat::paddedStride(size_t cols, Precision precision) {
+    size_t k = Mat::alignment / elementSize(precision);
+    return (cols + k - 1) / k * k;
+}
+
+QuantizedMat::QuantizedMat(const Mat& m, Precision precision) :
+    precision_(precision), rows_(m.rows()), cols_(m.cols()), stride_(paddedStride(m.cols(), precision)),
+    scales_(m.rows(), 1.0f) {
+    size_t bytes = rows_ * stride_ * elementSize(precision);
+    void* ptr = nullptr;
+    if (bytes > 0) {
+        if (posix_memalign(&ptr, Mat::alignment, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+        memset(ptr, 0, bytes);
+        storage_ = shared_ptr<void>(ptr, free);
+    }
+    data_ = static_cast<const char*>(ptr);
+
+    for (size_t i = 0; i < rows_; ++i) {
+        const float* x = m[i].data();
+        if (precision == Precision::float16) {
+            uint16_t* row = static_cast<uint16_t*>(ptr) + i * stride_;
+            for (size_t j = 0; j < cols_; ++j) {
+                row[j] = simd::floatToHalf(x[j]);
+            }
+        } else {
+            int8_t* row = static_cast<int8_t*>(ptr) + i * stride_;
+            float max_abs = 0;
+            for (size_t j = 0; j < cols_; ++j) {
+                max_abs = max(max_abs, fabs(x[j]));
+            }
+            if (max_abs == 0) continue;
+            scales_[i] = max_abs / 127;
+            for (size_t j = 0; j < cols_; ++j) {
+                row[j] = static_cast<int8_t>(lrintf(x[j] / scales_[i]));
+            }
+        }
+    }
+}
+
+QuantizedMat::QuantizedMat(Precision precision, const char* data, size_t rows, size_t cols, size_t stride,
+                           vector<float> scales, shared_ptr<void> storage) :
+    precision_(precision), data_(data), rows_(rows), cols_(cols), stride_(stride), scales_(std::move(scales)),
+    storage_(storage) {
+    elementSize(precision); // checks the precision
+    if (scales_.size() != rows || stride < cols) {
+        throw runtime_error("invalid quantized matrix");
+    }
+}
+
+void QuantizedMat::row(size_t i, float* out) const {
+    if (precision_ == Precision::float16) {
+        const uint16_t* row = reinterpret_cast<const uint16_t*>(data_) + i * stride_;
+        for (size_t j = 0; j < cols_; ++j) {
+            out[j] = scales_[i] * simd::halfToFloat(row[j]);
+        }
+    } else {
+        const int8_t* row = reinterpret_cast<const int8_t*>(data_) + i * stride_;
+        for (size_t j = 0; j < cols_; ++j) {
+            out[j] = scales_[i] * row[j];
+        }
+    }
+}
+
+Mat QuantizedMat::dequantize() const {
+    Mat m(rows_, cols_);
+    for (size_t i = 0; i < rows_; ++i) {
+        row(i, m[i].data());
+    }
+    return m;
+}
+
+vector<float> QuantizedMat::normalize() {
+    vector<float> norms(rows_);
+    vector<float> buffer(cols_);
+    for (size_t i = 0; i < rows_; ++i) {
+        row(i, buffer.data());
+        norms[i] = simd::norm(buffer.data(), cols_);
+        if (norms[i] > 0) scales_[i] /= norms[i];
+    }
+    return norms;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vec.hpp"
+
+/**
+ * @brief Element type of the matrices saved in a model file
+ */
+enum class Precision : uint32_t {
+    float32 = 0,
+    float16 = 1, // IEEE half precision
+    int8 = 2 // signed bytes, with one scale per row (symmetric quantization of each row)
+};
+
+Precision parsePrecision(const std::string& name); // "float32", "float16" or "int8"
+std::string precisionName(Precision precision);
+
+/**
+ * @brief Read-only matrix stored in float16 or int8, for serving embeddings with half or a quarter of the
+ * memory of a Mat. Row i represents scales[i] times the stored values of row i (scales are 1 in float16,
+ * until the rows are normalized).
+ *
+ * Like a Mat, each row starts on a 64-byte boundary, and the data can be used directly from a memory-mapped
+ * file. Dot products with float vectors convert the stored values in registers (simd::dotF16 and simd::dotI8),
+ * without dequantizing the rows in memory.
+ */
+class QuantizedMat {
+    Precision precision_;
+    const char* data_;
+    size_t rows_;
+    size_t cols_;
+    size_t stride_; // distance in elements between the beginning of two consecutive rows
+    std::vector<float> scales_;
+    std::shared_ptr<void> storage_; // owner of the data (allocated by this matrix, or memory-mapped file)
+
+public:
+    QuantizedMat() : precision_(Precision::float32), data_(nullptr), rows_(0), cols_(0), stride_(0) {}
+
+    /**
+     * @brief Quantize the rows of `m` with the given precision (float16 or int8). In int8, each row is scaled
+     * so that its largest absolute value is 127.
+     */
+    QuantizedMat(const Mat& m, Precision precision);
+
+    /**
+     * @brief Matrix stored in external memory, which is kept alive by `storage` (e.g. mapped file)
+     */
+    QuantizedMat(Precision precision, const char* data, size_t rows, size_t cols, size_t stride,
+                 std::vector<float> scales, std::shared_ptr<void> storage);
+
+    static size_t elementSize(Precision precision);
+    static size_t paddedStride(size_t cols, Precision precision); // in elements
+
+    Precision precision() const { return precision_; }
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t stride() const { return stride_; }
+    bool empty() const { return rows_ == 0; }
+    const char* data() const { return data_; }
+    const std::vector<float>& scales() const { return scales_; }
+
+    float dot(size_t i, const float* x) const { // row i . x
+        const char* row = data_ + i * stride_ * elementSize(precision_);
+        float res = precision_ == Precision::float16 ? simd::dotF16(reinterpret_cast<const uint16_t*>(row), x, cols_)
+                                                     : simd::dotI8(reinterpret_cast<const int8_t*>(row), x, cols_);
+        return scales_[i] * res;
+    }
+
+    void row(size_t i, float* out) const; // dequantized row i (cols() floats)
+    Mat dequantize() const;
+
+    /**
+     * @brief Scale the rows to unit norm (zero rows are left unchanged), by updating their scales only.
+     * @return the norms of the rows before normalization
+     */
+    std::vector<float> normalize();
+};
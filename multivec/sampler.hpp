@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <cmath>
+
+/**
+ * @brief Draws random word indices according to the unigram distribution raised to the power 0.75
+ * (distribution of the negative samples in word2vec).
+ *
+ * Two implementations are available:
+ * - Walker's alias method (Vose's construction): O(V) memory, O(1) sampling with a single
+ *   random access per sample (default);
+ * - word2vec's unigram table: repeated word indices in a table of `table_size` int32 entries.
+ *
+ * Each sample consumes one 32-bit random number: its high bits select a bucket and its low
+ * bits decide between the bucket's word and its alias.
+ */
+class UnigramSampler {
+    struct Bucket {
+        float prob; // probability of keeping this bucket's word rather than its alias
+        int alias;
+    };
+
+    std::vector<Bucket> buckets;
+    std::vector<int> table;
+
+public:
+    /**
+     * @param counts word counts, indexed by word index
+     * @param table_size size of the unigram table, or 0 to use the alias method
+     */
+    void init(const std::vector<int>& counts, long long table_size, double power = 0.75) {
+        clear();
+        int v = static_cast<int>(counts.size());
+        if (v == 0) return;
+
+        std::vector<double> weights(v);
+        double total = 0.0;
+        for (int i = 0; i < v; ++i) {
+            weights[i] = pow(counts[i], power);
+            total += weights[i];
+        }
+
+        if (table_size > 0) {
+            table.resize(table_size);
+            int i = 0;
+            double cumulative = weights[0] / total;
+            for (long long a = 0; a < table_size; ++a) {
+                table[a] = i;
+                if (static_cast<double>(a) / table_size > cumulative && i < v - 1) {
+                    cumulative += weights[++i] / total;
+                }
+            }
+            return;
+        }
+
+        // Vose's algorithm: scaled probabilities are split between "small" (< 1) and "large" buckets,
+        // and each small bucket is filled up with a piece of a large one.
+        buckets.resize(v);
+        std::vector<double> scaled(v);
+        std::vector<int> small, large;
+        for (int i = 0; i < v; ++i) {
+            scaled[i] = weights[i] * v / total;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(); small.pop_back();
+            int l = large.back();
+            buckets[s] = {static_cast<float>(scaled[s]), l};
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // leftovers have probability 1 (up to rounding errors)
+        for (int i : large) buckets[i] = {1.0f, i};
+        for (int i : small) buckets[i] = {1.0f, i};
+    }
+
+    /**
+     * @param r random number in [0, 2^32)
+     */
+    int sample(unsigned long long r) const {
+        r &= 0xFFFFFFFFULL;
+        if (!table.empty()) {
+            return table[(r * table.size()) >> 32];
+        }
+        unsigned long long x = r * buckets.size();
+        const Bucket& bucket = buckets[x >> 32];
+        float u = static_cast<float>(x & 0xFFFFFFFFULL) / 4294967296.0f; // fractional part of r * V / 2^32
+        return u < bucket.prob ? static_cast<int>(x >> 32) : bucket.alias;
+    }
+
+    bool empty() const {
+        return buckets.empty() && table.empty();
+    }
+
+    void clear() {
+        buckets.clear();
+        buckets.shrink_to_fit();
+        table.clear();
+        table.shrink_to_fit();
+    }
+};
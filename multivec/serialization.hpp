@@ -1,5 +1,7 @@
 #pragma once
 #include "bilingual.hpp"
+#include "mapping.hpp"
+#include <cstdint>
 
 template<typename T>
 inline void save(ofstream& outfile, T x) {
@@ -63,6 +65,32 @@ inline void load(ifstream& infile, vec& v) {
     }
 }
 
+/**
+ * Legacy format: matrices are saved row by row, each row prefixed by its size (same layout as a vector of vec).
+ * Each row is read in a single call, directly into the matrix memory.
+ */
+inline void load(ifstream& infile, mat& m) {
+    size_t rows = 0;
+    load(infile, rows);
+    if (rows == 0) {
+        m = mat();
+        return;
+    }
+
+    size_t cols = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        size_t size = 0;
+        load(infile, size);
+        if (i == 0) {
+            cols = size;
+            m = mat(rows, cols);
+        } else if (size != cols) {
+            throw runtime_error("inconsistent matrix row size");
+        }
+        infile.read(reinterpret_cast<char*>(m[i].data()), sizeof(float) * cols);
+    }
+}
+
 inline void save(ofstream& outfile, const Config& cfg) {
     save(outfile, cfg.learning_rate);
     save(outfile, cfg.dimension);
@@ -103,65 +131,565 @@ inline void load(ifstream& infile, BilingualConfig& cfg) {
     load(infile, cfg.beta);
 }
 
-inline void save(ofstream& outfile, const HuffmanNode& node) {
-    save(outfile, node.index);
-    save(outfile, node.count);
-    save(outfile, node.word);
-    save(outfile, node.code);
-    save(outfile, node.parents);
-}
-
-inline void load(ifstream& infile, HuffmanNode& node) {
+/**
+ * Legacy format (version 1): read a vocabulary entry, followed by its Huffman code and by the indices
+ * of its parent nodes (two vectors of int), and append them to `code` and `parents` (in file order).
+ */
+inline void load(ifstream& infile, HuffmanNode& node, vector<int>& code, vector<int>& parents) {
     load(infile, node.index);
     load(infile, node.count);
     load(infile, node.word);
-    load(infile, node.code);
-    load(infile, node.parents);
-}
 
-inline void save(ofstream& outfile, const MonolingualModel& model) {
-    save(outfile, *model.config);
-    save(outfile, model.vocabulary.size());
-
-    // transform into map to save in lexicographical order (for consistency)
-    map<string, HuffmanNode> voc_ordered(model.vocabulary.begin(), model.vocabulary.end());
-    for (auto it = voc_ordered.begin(); it != voc_ordered.end(); ++it) {
-        save(outfile, it->second);
-    }
+    size_t length = 0;
+    load(infile, length);
+    code.resize(code.size() + length);
+    infile.read(reinterpret_cast<char*>(code.data() + code.size() - length), sizeof(int) * length);
 
-    save(outfile, model.input_weights);
-    save(outfile, model.output_weights);
-    save(outfile, model.output_weights_hs);
-    save(outfile, model.sent_weights);
+    load(infile, length);
+    parents.resize(parents.size() + length);
+    infile.read(reinterpret_cast<char*>(parents.data() + parents.size() - length), sizeof(int) * length);
 }
 
-inline void load(ifstream& infile, MonolingualModel& model) {
+/**
+ * Legacy format (version 1): configuration, vocabulary in lexicographical order, and the four
+ * matrices, with a separate write call for each value. Models in this format can still be loaded.
+ */
+inline void loadLegacy(ifstream& infile, MonolingualModel& model) {
     load(infile, *model.config);
 
     size_t vocabulary_size = 0;
     load(infile, vocabulary_size);
     model.vocabulary.clear();
 
+    // codes are read in file order (lexicographic), and then sorted by word index
+    vector<int> code, parents, indices, lengths(vocabulary_size);
     for (size_t i = 0; i < vocabulary_size; ++i) {
         HuffmanNode node(0, ""); // empty constructor creates UNK node
-        load(infile, node);
+        size_t begin = parents.size();
+        load(infile, node, code, parents);
+        if (node.index < 0 || node.index >= vocabulary_size) {
+            throw runtime_error("invalid word index in model file");
+        }
+        indices.push_back(node.index);
+        lengths[node.index] = parents.size() - begin;
         model.vocabulary.insert({node.word, node});
     }
 
+    model.huffman.reset(lengths);
+    for (size_t i = 0, pos = 0; i < vocabulary_size; ++i) {
+        int j = model.huffman.offsets[indices[i]];
+        for (int k = 0; k < lengths[indices[i]]; ++k, ++pos, ++j) {
+            model.huffman.parents[j] = parents[pos];
+            model.huffman.setBit(j, code[pos] != 0);
+        }
+    }
+
     load(infile, model.input_weights);
     load(infile, model.output_weights);
     load(infile, model.output_weights_hs);
     load(infile, model.sent_weights);
 }
 
-inline void save(ofstream& outfile, const BilingualModel& model) {
+inline void loadLegacy(ifstream& infile, BilingualModel& model) {
+    load(infile, *model.config);
+    loadLegacy(infile, model.src_model);
+    loadLegacy(infile, model.trg_model);
+}
+
+/**
+ * Model format version 2. The file starts with a header (magic number, version and byte order mark),
+ * followed by the configuration, and by one section per monolingual model:
+ * - vocabulary size, dimension, size of the string pool and total length of the Huffman codes;
+ * - blocks of word counts, string pool offsets, string pool (words in index order), and Huffman codes
+ *   (CSR layout of HuffmanCodes);
+ * - the four matrices: rows, columns and stride, then all the rows in one block (with their padding).
+ *
+ * Every block starts at a multiple of Mat::alignment bytes, so that the matrices can be used directly
+ * from a memory mapping of the file, without reading or copying them.
+ *
+ * Version 3 is the same format with quantized matrices (float16 or int8, given by the header): each matrix
+ * has a block of row scales before its rows (see QuantizedMat). Models in float32 are still saved in version 2.
+ *
+ * A checkpoint (see CheckpointWriter) is a model file in version 2, followed by the training state: a
+ * TrainingStateHeader, one ThreadRecord per thread, and the offset of the TrainingStateHeader (last 8 bytes
+ * of the file). Checkpoints can be loaded as models, which ignores the training state.
+ */
+namespace model_format {
+    const char magic[8] = {'M', 'U', 'L', 'T', 'I', 'V', 'E', 'C'};
+    const uint32_t version = 2;
+    const uint32_t quantized_version = 3;
+    const uint32_t byte_order = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t models; // number of model sections (1 for monolingual, 2 for bilingual)
+        uint32_t precision; // Precision of the matrices (always 0, float32, in version 2)
+    };
+
+    struct SectionHeader {
+        uint64_t vocabulary_size;
+        uint64_t dimension;
+        uint64_t pool_size; // bytes in the string pool
+        uint64_t code_size; // total length of the Huffman codes
+    };
+
+    struct MatHeader {
+        uint64_t rows;
+        uint64_t cols;
+        uint64_t stride;
+    };
+
+    const char state_magic[8] = {'M', 'V', '-', 'S', 'T', 'A', 'T', 'E'};
+    const uint32_t state_version = 1;
+
+    struct TrainingStateHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t threads;
+        int64_t task;
+        int64_t chunks;
+        int64_t corpus_size;
+        int64_t training_words;
+        int64_t words_processed;
+        float alpha;
+        uint32_t padding;
+    };
+
+    struct ThreadRecord {
+        uint64_t rand_state;
+        int64_t pending_words;
+        int64_t epoch;
+    };
+}
+
+/**
+ * Write zeros until the position in the file is a multiple of Mat::alignment.
+ */
+inline void alignBlock(ofstream& outfile) {
+    static const char zeros[Mat::alignment] = {0};
+    long long pos = outfile.tellp();
+    long long padding = (Mat::alignment - pos % Mat::alignment) % Mat::alignment;
+    outfile.write(zeros, padding);
+}
+
+template<typename T>
+inline void saveBlock(ofstream& outfile, const T* data, size_t n) {
+    alignBlock(outfile);
+    outfile.write(reinterpret_cast<const char*>(data), sizeof(T) * n);
+}
+
+inline void saveHeader(ofstream& outfile, uint32_t models, Precision precision) {
+    model_format::Header header;
+    memcpy(header.magic, model_format::magic, sizeof(header.magic));
+    header.version = precision == Precision::float32 ? model_format::version : model_format::quantized_version;
+    header.byte_order = model_format::byte_order;
+    header.models = models;
+    header.precision = static_cast<uint32_t>(precision);
+    save(outfile, header);
+}
+
+/**
+ * Read the header of a model file, and the precision of its matrices. Returns false (and goes back to the
+ * beginning of the file) if the file is in the legacy format, which has no header.
+ */
+inline bool loadHeader(ifstream& infile, uint32_t models, Precision& precision) {
+    model_format::Header header;
+    load(infile, header);
+
+    if (!infile || memcmp(header.magic, model_format::magic, sizeof(header.magic)) != 0) {
+        infile.clear();
+        infile.seekg(0, infile.beg);
+        return false;
+    }
+    if (header.byte_order != model_format::byte_order) {
+        throw runtime_error("model file has a different byte order");
+    }
+    if (header.version != model_format::version && header.version != model_format::quantized_version) {
+        throw runtime_error("unsupported model file version");
+    }
+    if (header.models != models) {
+        throw runtime_error(models == 1 ? "this is not a monolingual model" : "this is not a bilingual model");
+    }
+
+    precision = header.version == model_format::version ? Precision::float32 : static_cast<Precision>(header.precision);
+    if (precision != Precision::float16 && precision != Precision::int8 && precision != Precision::float32) {
+        throw runtime_error("unsupported matrix precision in model file");
+    }
+    return true;
+}
+
+inline void save(ofstream& outfile, const mat& m) {
+    model_format::MatHeader header = { m.rows(), m.cols(), m.stride() };
+    save(outfile, header);
+    saveBlock(outfile, m.data(), m.rows() * m.stride());
+}
+
+// quantized matrix: the stride is in elements, and the row scales come before the rows
+inline void save(ofstream& outfile, const QuantizedMat& m) {
+    model_format::MatHeader header = { m.rows(), m.cols(), m.stride() };
+    save(outfile, header);
+    saveBlock(outfile, m.scales().data(), m.rows());
+    saveBlock(outfile, m.data(), m.rows() * m.stride() * QuantizedMat::elementSize(m.precision()));
+}
+
+inline void save(ofstream& outfile, const mat& m, Precision precision) {
+    if (precision == Precision::float32) {
+        save(outfile, m);
+    } else {
+        save(outfile, QuantizedMat(m, precision));
+    }
+}
+
+/**
+ * Write a model section. If `weights` isn't null, it replaces the four matrices of the model (e.g. copies
+ * of them taken for a checkpoint).
+ */
+inline void saveSection(ofstream& outfile, const MonolingualModel& model, Precision precision,
+                        const mat* weights) {
+    size_t v = model.vocabulary.size();
+
+    // words in index order
+    vector<const HuffmanNode*> nodes(v);
+    for (auto it = model.vocabulary.begin(); it != model.vocabulary.end(); ++it) {
+        nodes[it->second.index] = &it->second;
+    }
+
+    vector<int> counts(v);
+    vector<uint64_t> pool_offsets(v + 1, 0);
+    for (size_t i = 0; i < v; ++i) {
+        counts[i] = nodes[i]->count;
+        pool_offsets[i + 1] = pool_offsets[i] + nodes[i]->word.size();
+    }
+
+    model_format::SectionHeader header = { v, static_cast<uint64_t>(model.config->dimension),
+                                           pool_offsets[v], model.huffman.parents.size() };
+    save(outfile, header);
+
+    saveBlock(outfile, counts.data(), v);
+    saveBlock(outfile, pool_offsets.data(), v + 1);
+    alignBlock(outfile);
+    for (size_t i = 0; i < v; ++i) {
+        outfile.write(nodes[i]->word.data(), nodes[i]->word.size());
+    }
+
+    vector<int> code_offsets(model.huffman.offsets);
+    code_offsets.resize(v + 1, 0); // no codes in an empty model
+    saveBlock(outfile, code_offsets.data(), v + 1);
+    saveBlock(outfile, model.huffman.parents.data(), model.huffman.parents.size());
+    saveBlock(outfile, model.huffman.bits.data(), model.huffman.bits.size());
+
+    save(outfile, weights ? weights[0] : model.input_weights, precision);
+    save(outfile, weights ? weights[1] : model.output_weights, precision);
+    save(outfile, weights ? weights[2] : model.output_weights_hs, precision);
+    save(outfile, weights ? weights[3] : model.sent_weights, precision);
+}
+
+/**
+ * @brief Sequential reader of the sections of a memory-mapped model file.
+ */
+class ModelReader {
+    std::shared_ptr<MappedFile> file;
+    size_t pos;
+
+    void check(size_t bytes) const {
+        if (bytes > file->size() || pos + bytes > file->size()) {
+            throw runtime_error("truncated model file");
+        }
+    }
+
+public:
+    ModelReader(std::shared_ptr<MappedFile> file, size_t pos) : file(file), pos(pos) {}
+
+    template<typename T>
+    T read() {
+        T x;
+        check(sizeof(T));
+        memcpy(&x, file->data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return x;
+    }
+
+    // pointer to a block of n values of type T
+    template<typename T>
+    T* block(size_t n) {
+        pos = (pos + Mat::alignment - 1) / Mat::alignment * Mat::alignment;
+        if (n > file->size() / sizeof(T)) {
+            throw runtime_error("truncated model file");
+        }
+        check(sizeof(T) * n);
+        T* data = reinterpret_cast<T*>(file->data() + pos);
+        pos += sizeof(T) * n;
+        return data;
+    }
+
+    // matrix whose data stays in the mapped file (copy-on-write)
+    mat readMat() {
+        model_format::MatHeader header = read<model_format::MatHeader>();
+        if (header.stride < header.cols || header.stride % (Mat::alignment / sizeof(float)) != 0) {
+            throw runtime_error("invalid matrix in model file");
+        }
+        float* data = block<float>(header.rows * header.stride);
+        if (header.rows == 0) return mat();
+        return mat(data, header.rows, header.cols, header.stride, file);
+    }
+
+    // quantized matrix whose rows stay in the mapped file (the scales are copied)
+    QuantizedMat readQuantized(Precision precision) {
+        model_format::MatHeader header = read<model_format::MatHeader>();
+        if (header.stride < header.cols || header.stride * QuantizedMat::elementSize(precision) % Mat::alignment != 0) {
+            throw runtime_error("invalid matrix in model file");
+        }
+        const float* scales = block<float>(header.rows);
+        const char* data = block<char>(header.rows * header.stride * QuantizedMat::elementSize(precision));
+        return QuantizedMat(precision, data, header.rows, header.cols, header.stride,
+                            vector<float>(scales, scales + header.rows), file);
+    }
+};
+
+/**
+ * Check that the matrix read for a model section has `rows` rows (any number if `rows` is -1), or none if
+ * `optional`, with a column per dimension.
+ */
+template<typename M>
+inline void checkSectionMat(const M& m, long long rows, bool optional, size_t dimension) {
+    bool valid;
+    if (m.rows() == 0) {
+        valid = optional || rows <= 0;
+    } else {
+        valid = (rows < 0 || m.rows() == static_cast<size_t>(rows)) && m.cols() == dimension;
+    }
+    if (!valid) {
+        throw runtime_error("invalid model file");
+    }
+}
+
+/**
+ * Read a model section. Quantized matrices are kept in model.quantized_weights (input, output, output_hs and
+ * sent weights), and the float matrices are left empty: MonolingualModel::load then either dequantizes them,
+ * or uses them directly in inference mode.
+ *
+ * The vocabulary, Huffman codes and matrix shapes are checked, so that a corrupt file can't lead to reads
+ * out of the mapping later on.
+ */
+inline void loadSection(ModelReader& reader, MonolingualModel& model, Precision precision) {
+    model_format::SectionHeader header = reader.read<model_format::SectionHeader>();
+    size_t v = header.vocabulary_size;
+
+    const int* counts = reader.block<int>(v);
+    const uint64_t* pool_offsets = reader.block<uint64_t>(v + 1);
+    const char* pool = reader.block<char>(header.pool_size);
+    const int* code_offsets = reader.block<int>(v + 1);
+    const int* parents = reader.block<int>(header.code_size);
+    const unsigned long long* bits = reader.block<unsigned long long>((header.code_size + 63) / 64);
+
+    model.vocabulary.clear();
+    model.vocabulary.reserve(v);
+    for (size_t i = 0; i < v; ++i) {
+        if (pool_offsets[i + 1] < pool_offsets[i] || pool_offsets[i + 1] > header.pool_size) {
+            throw runtime_error("invalid vocabulary in model file");
+        }
+        string word(pool + pool_offsets[i], pool_offsets[i + 1] - pool_offsets[i]);
+        HuffmanNode node(static_cast<int>(i), word);
+        node.count = counts[i];
+        model.vocabulary.insert({word, node});
+    }
+
+    if (code_offsets[0] != 0 || static_cast<uint64_t>(code_offsets[v]) != header.code_size) {
+        throw runtime_error("invalid model file");
+    }
+    for (size_t i = 0; i < v; ++i) {
+        if (code_offsets[i + 1] < code_offsets[i]) {
+            throw runtime_error("invalid model file");
+        }
+    }
+    for (size_t j = 0; j < header.code_size; ++j) {
+        if (parents[j] < 0 || static_cast<size_t>(parents[j]) >= v) {
+            throw runtime_error("invalid model file");
+        }
+    }
+
+    model.huffman.clear();
+    if (v > 0) {
+        model.huffman.offsets.assign(code_offsets, code_offsets + v + 1);
+        model.huffman.parents.assign(parents, parents + header.code_size);
+        model.huffman.bits.assign(bits, bits + (header.code_size + 63) / 64);
+    }
+
+    model.quantized_weights.clear();
+    if (precision == Precision::float32) {
+        model.input_weights = reader.readMat();
+        model.output_weights = reader.readMat();
+        model.output_weights_hs = reader.readMat();
+        model.sent_weights = reader.readMat();
+    } else {
+        model.input_weights = mat();
+        model.output_weights = mat();
+        model.output_weights_hs = mat();
+        model.sent_weights = mat();
+        for (int i = 0; i < 4; ++i) {
+            model.quantized_weights.push_back(reader.readQuantized(precision));
+        }
+    }
+
+    // input weights for all the words, output weights for all the words or none (e.g. vectors loaded
+    // with loadVectors), and any number of sentence vectors
+    size_t d = model.config->dimension;
+    long long rows = static_cast<long long>(v);
+    if (precision == Precision::float32) {
+        checkSectionMat(model.input_weights, rows, false, d);
+        checkSectionMat(model.output_weights, rows, true, d);
+        checkSectionMat(model.output_weights_hs, rows, true, d);
+        checkSectionMat(model.sent_weights, -1, true, d);
+    } else {
+        checkSectionMat(model.quantized_weights[0], rows, false, d);
+        checkSectionMat(model.quantized_weights[1], rows, true, d);
+        checkSectionMat(model.quantized_weights[2], rows, true, d);
+        checkSectionMat(model.quantized_weights[3], -1, true, d);
+    }
+}
+
+inline void save(ofstream& outfile, const MonolingualModel& model, Precision precision) {
+    saveHeader(outfile, 1, precision);
     save(outfile, *model.config);
-    save(outfile, model.src_model);
-    save(outfile, model.trg_model);
+    saveSection(outfile, model, precision, nullptr);
 }
 
-inline void load(ifstream& infile, BilingualModel& model) {
+inline void save(ofstream& outfile, const BilingualModel& model, Precision precision) {
+    saveHeader(outfile, 2, precision);
+    save(outfile, *model.config);
+    saveSection(outfile, model.src_model, precision, nullptr);
+    saveSection(outfile, model.trg_model, precision, nullptr);
+}
+
+inline void save(ofstream& outfile, const TrainingState& state) {
+    model_format::TrainingStateHeader header = {};
+    memcpy(header.magic, model_format::state_magic, sizeof(header.magic));
+    header.version = model_format::state_version;
+    header.threads = state.threads.size();
+    header.task = state.task;
+    header.chunks = state.chunks;
+    header.corpus_size = state.corpus_size;
+    header.training_words = state.training_words;
+    header.words_processed = state.words_processed;
+    header.alpha = state.alpha;
+
+    alignBlock(outfile);
+    uint64_t offset = outfile.tellp();
+    save(outfile, header);
+    for (auto it = state.threads.begin(); it != state.threads.end(); ++it) {
+        model_format::ThreadRecord record = { it->rand_state, it->pending_words, it->epoch };
+        save(outfile, record);
+    }
+    save(outfile, offset);
+}
+
+/**
+ * Write a checkpoint: the model with the weights of `checkpoint` (input, output, output_hs and sent weights
+ * of each monolingual model), then its training state.
+ */
+inline void saveCheckpoint(const string& filename, const MonolingualModel& model, const Checkpoint& checkpoint) {
+    ofstream outfile(filename, ios::binary);
+    if (!outfile.is_open()) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+    saveHeader(outfile, 1, Precision::float32);
+    save(outfile, *model.config);
+    saveSection(outfile, model, Precision::float32, checkpoint.weights.data());
+    save(outfile, checkpoint.state);
+    if (!outfile) {
+        throw runtime_error("couldn't write checkpoint " + filename);
+    }
+}
+
+inline void saveCheckpoint(const string& filename, const BilingualModel& model, const Checkpoint& checkpoint) {
+    ofstream outfile(filename, ios::binary);
+    if (!outfile.is_open()) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+    saveHeader(outfile, 2, Precision::float32);
+    save(outfile, *model.config);
+    saveSection(outfile, model.src_model, Precision::float32, checkpoint.weights.data());
+    saveSection(outfile, model.trg_model, Precision::float32, checkpoint.weights.data() + 4);
+    save(outfile, checkpoint.state);
+    if (!outfile) {
+        throw runtime_error("couldn't write checkpoint " + filename);
+    }
+}
+
+/**
+ * Read the training state at the end of a checkpoint.
+ */
+inline void loadTrainingState(const string& filename, TrainingState& state) {
+    ifstream infile(filename, ios::binary);
+    check_is_open(infile, filename);
+
+    uint64_t offset = 0;
+    model_format::TrainingStateHeader header;
+    infile.seekg(-static_cast<long long>(sizeof(offset)), infile.end);
+    load(infile, offset);
+    if (infile) {
+        infile.seekg(offset, infile.beg);
+        load(infile, header);
+    }
+    if (!infile || memcmp(header.magic, model_format::state_magic, sizeof(header.magic)) != 0) {
+        throw runtime_error(filename + " is not a checkpoint");
+    }
+    if (header.version != model_format::state_version) {
+        throw runtime_error("unsupported checkpoint version");
+    }
+
+    state.task = header.task;
+    state.chunks = header.chunks;
+    state.corpus_size = header.corpus_size;
+    state.training_words = header.training_words;
+    state.words_processed = header.words_processed;
+    state.alpha = header.alpha;
+    state.threads.clear();
+    for (uint32_t i = 0; i < header.threads; ++i) {
+        model_format::ThreadRecord record;
+        load(infile, record);
+        ThreadState thread_state(record.rand_state, static_cast<int>(record.epoch));
+        thread_state.pending_words = record.pending_words;
+        state.threads.push_back(thread_state);
+    }
+    if (!infile) {
+        throw runtime_error("truncated checkpoint " + filename);
+    }
+}
+
+/**
+ * Load a model in either format. In version 2, the matrices are not read: they are used directly from a
+ * private mapping of the file, and pages are only loaded from disk when they are accessed.
+ */
+inline void load(const string& filename, MonolingualModel& model) {
+    ifstream infile(filename, ios::binary);
+    check_is_open(infile, filename);
+
+    Precision precision;
+    if (!loadHeader(infile, 1, precision)) {
+        loadLegacy(infile, model);
+        return;
+    }
+
+    load(infile, *model.config);
+    ModelReader reader(std::make_shared<MappedFile>(filename, true), infile.tellg());
+    loadSection(reader, model, precision);
+}
+
+inline void load(const string& filename, BilingualModel& model) {
+    ifstream infile(filename, ios::binary);
+    check_is_open(infile, filename);
+
+    Precision precision;
+    if (!loadHeader(infile, 2, precision)) {
+        loadLegacy(infile, model);
+        return;
+    }
+
     load(infile, *model.config);
-    load(infile, model.src_model);
-    load(infile, model.trg_model);
+    ModelReader reader(std::make_shared<MappedFile>(filename, true), infile.tellg());
+    loadSection(reader, model.src_model, precision);
+    loadSection(reader, model.trg_model, precision);
 }
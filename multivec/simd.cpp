@@ -0,0 +1,555 @@
+#include "simd.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MULTIVEC_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define MULTIVEC_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * The float kernels are templates on the size of the vectors: N = 0 for any size (given at runtime),
+ * otherwise they are compiled for vectors of size N, whose loops the compiler unrolls (see simd::kernelsFor).
+ */
+template <size_t N>
+inline size_t dimension(size_t n) {
+    return N == 0 ? n : N;
+}
+
+template <size_t N>
+float dot_scalar(const float* x, const float* y, size_t n) {
+    n = dimension<N>(n);
+    float res = 0;
+    for (size_t i = 0; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template <size_t N>
+void axpy_scalar(float a, const float* x, float* y, size_t n) {
+    n = dimension<N>(n);
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+template <size_t N>
+void scale_scalar(float a, float* x, size_t n) {
+    n = dimension<N>(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] *= a;
+    }
+}
+
+template <size_t N>
+void update_scalar(float a, const float* x, float* y, float* z, size_t n) {
+    n = dimension<N>(n);
+    for (size_t i = 0; i < n; ++i) {
+        z[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+float dotF16_scalar(const uint16_t* x, const float* y, size_t n) {
+    float res = 0;
+    for (size_t i = 0; i < n; ++i) {
+        res += simd::halfToFloat(x[i]) * y[i];
+    }
+    return res;
+}
+
+float dotI8_scalar(const int8_t* x, const float* y, size_t n) {
+    float res = 0;
+    for (size_t i = 0; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+#ifdef MULTIVEC_X86
+
+template <size_t N>
+__attribute__((target("avx2,fma")))
+float dot_avx2(const float* x, const float* y, size_t n) {
+    n = dimension<N>(n);
+    // two accumulators to hide the latency of the FMA instructions
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), acc1);
+    }
+    if (i + 8 <= n) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+        i += 8;
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+
+    // horizontal sum
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    float res = _mm_cvtss_f32(s);
+
+    // i = n - n % 8, written so that GCC sees that this loop is empty for fixed sizes multiple of 8
+    for (i = n - n % 8; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template <size_t N>
+__attribute__((target("avx2,fma")))
+void axpy_avx2(float a, const float* x, float* y, size_t n) {
+    n = dimension<N>(n);
+    __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (i = n - n % 8; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+template <size_t N>
+__attribute__((target("avx2,fma")))
+void scale_avx2(float a, float* x, size_t n) {
+    n = dimension<N>(n);
+    __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(va, _mm256_loadu_ps(x + i)));
+    }
+    for (i = n - n % 8; i < n; ++i) {
+        x[i] *= a;
+    }
+}
+
+template <size_t N>
+__attribute__((target("avx2,fma")))
+void update_avx2(float a, const float* x, float* y, float* z, size_t n) {
+    n = dimension<N>(n);
+    __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vy = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(z + i, _mm256_fmadd_ps(va, vy, _mm256_loadu_ps(z + i)));
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), vy));
+    }
+    for (i = n - n % 8; i < n; ++i) {
+        z[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+inline float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+float dotF16_avx2(const uint16_t* x, const float* y, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 x0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        __m256 x1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 8)));
+        acc0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(y + i), acc0);
+        acc1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(y + i + 8), acc1);
+    }
+    if (i + 8 <= n) {
+        __m256 x0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        acc0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(y + i), acc0);
+        i += 8;
+    }
+    float res = hsum_avx2(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        res += simd::halfToFloat(x[i]) * y[i];
+    }
+    return res;
+}
+
+__attribute__((target("avx2,fma")))
+float dotI8_avx2(const int8_t* x, const float* y, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m256 x0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+        __m256 x1 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8)));
+        acc0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(y + i), acc0);
+        acc1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(y + i + 8), acc1);
+    }
+    if (i + 8 <= n) {
+        __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i));
+        acc0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b)), _mm256_loadu_ps(y + i), acc0);
+        i += 8;
+    }
+    float res = hsum_avx2(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template <size_t N>
+__attribute__((target("avx512f")))
+float dot_avx512(const float* x, const float* y, size_t n) {
+    n = dimension<N>(n);
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+    }
+    if (i < n) { // masked tail
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+template <size_t N>
+__attribute__((target("avx512f")))
+void axpy_avx512(float a, const float* x, float* y, size_t n) {
+    n = dimension<N>(n);
+    __m512 va = _mm512_set1_ps(a);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 vy = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));
+        _mm512_mask_storeu_ps(y + i, mask, vy);
+    }
+}
+
+template <size_t N>
+__attribute__((target("avx512f")))
+void scale_avx512(float a, float* x, size_t n) {
+    n = dimension<N>(n);
+    __m512 va = _mm512_set1_ps(a);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(va, _mm512_loadu_ps(x + i)));
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(x + i, mask, _mm512_mul_ps(va, _mm512_maskz_loadu_ps(mask, x + i)));
+    }
+}
+
+template <size_t N>
+__attribute__((target("avx512f")))
+void update_avx512(float a, const float* x, float* y, float* z, size_t n) {
+    n = dimension<N>(n);
+    __m512 va = _mm512_set1_ps(a);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 vy = _mm512_loadu_ps(y + i);
+        _mm512_storeu_ps(z + i, _mm512_fmadd_ps(va, vy, _mm512_loadu_ps(z + i)));
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), vy));
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 vy = _mm512_maskz_loadu_ps(mask, y + i);
+        _mm512_mask_storeu_ps(z + i, mask, _mm512_fmadd_ps(va, vy, _mm512_maskz_loadu_ps(mask, z + i)));
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(mask, x + i), vy));
+    }
+}
+
+__attribute__((target("avx512f")))
+float dotF16_avx512(const uint16_t* x, const float* y, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 x0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+        __m512 x1 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i + 16)));
+        acc0 = _mm512_fmadd_ps(x0, _mm512_loadu_ps(y + i), acc0);
+        acc1 = _mm512_fmadd_ps(x1, _mm512_loadu_ps(y + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 x0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+        acc0 = _mm512_fmadd_ps(x0, _mm512_loadu_ps(y + i), acc0);
+    }
+    float res = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    for (; i < n; ++i) { // no masked 16-bit loads in AVX-512F
+        res += simd::halfToFloat(x[i]) * y[i];
+    }
+    return res;
+}
+
+__attribute__((target("avx512f")))
+float dotI8_avx512(const int8_t* x, const float* y, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 x0 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+        __m512 x1 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 16))));
+        acc0 = _mm512_fmadd_ps(x0, _mm512_loadu_ps(y + i), acc0);
+        acc1 = _mm512_fmadd_ps(x1, _mm512_loadu_ps(y + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 x0 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+        acc0 = _mm512_fmadd_ps(x0, _mm512_loadu_ps(y + i), acc0);
+    }
+    float res = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+#endif // MULTIVEC_X86
+
+#ifdef MULTIVEC_NEON
+
+template <size_t N>
+float dot_neon(const float* x, const float* y, size_t n) {
+    n = dimension<N>(n);
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(y + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(y + i + 4));
+    }
+    float res = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template <size_t N>
+void axpy_neon(float a, const float* x, float* y, size_t n) {
+    n = dimension<N>(n);
+    float32x4_t va = vdupq_n_f32(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(y + i, vfmaq_f32(vld1q_f32(y + i), va, vld1q_f32(x + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+template <size_t N>
+void scale_neon(float a, float* x, size_t n) {
+    n = dimension<N>(n);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(x + i, vmulq_n_f32(vld1q_f32(x + i), a));
+    }
+    for (; i < n; ++i) {
+        x[i] *= a;
+    }
+}
+
+template <size_t N>
+void update_neon(float a, const float* x, float* y, float* z, size_t n) {
+    n = dimension<N>(n);
+    float32x4_t va = vdupq_n_f32(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t vy = vld1q_f32(y + i);
+        vst1q_f32(z + i, vfmaq_f32(vld1q_f32(z + i), va, vy));
+        vst1q_f32(y + i, vfmaq_f32(vy, va, vld1q_f32(x + i)));
+    }
+    for (; i < n; ++i) {
+        z[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+float dotF16_neon(const uint16_t* x, const float* y, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t x0 = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(x + i)));
+        float32x4_t x1 = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(x + i + 4)));
+        acc0 = vfmaq_f32(acc0, x0, vld1q_f32(y + i));
+        acc1 = vfmaq_f32(acc1, x1, vld1q_f32(y + i + 4));
+    }
+    float res = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        res += simd::halfToFloat(x[i]) * y[i];
+    }
+    return res;
+}
+
+float dotI8_neon(const int8_t* x, const float* y, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t b = vmovl_s8(vld1_s8(x + i));
+        float32x4_t x0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(b)));
+        float32x4_t x1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(b)));
+        acc0 = vfmaq_f32(acc0, x0, vld1q_f32(y + i));
+        acc1 = vfmaq_f32(acc1, x1, vld1q_f32(y + i + 4));
+    }
+    float res = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+#endif // MULTIVEC_NEON
+
+// implementation for vectors of size N (any size if N = 0)
+#define KERNELS(isa, N) { #isa, dot_##isa<N>, axpy_##isa<N>, scale_##isa<N>, update_##isa<N>, dotF16_##isa, dotI8_##isa }
+
+// generic kernels, followed by the kernels of each fixed dimension
+#define KERNEL_TABLE(isa) { KERNELS(isa, 0), KERNELS(isa, 100), KERNELS(isa, 200), KERNELS(isa, 300) }
+
+const size_t fixed_dimensions[] = { 100, 200, 300 };
+const size_t n_fixed_dimensions = sizeof(fixed_dimensions) / sizeof(fixed_dimensions[0]);
+
+const simd::Kernels scalar_kernels[] = KERNEL_TABLE(scalar);
+
+#ifdef MULTIVEC_X86
+const simd::Kernels avx2_kernels[] = KERNEL_TABLE(avx2);
+const simd::Kernels avx512_kernels[] = KERNEL_TABLE(avx512);
+#endif
+
+#ifdef MULTIVEC_NEON
+const simd::Kernels neon_kernels[] = KERNEL_TABLE(neon);
+#endif
+
+const simd::Kernels* selected_kernels = scalar_kernels; // table of the selected implementation
+
+/**
+ * @brief Select the fastest implementation supported by this CPU (or the one given by
+ * the MULTIVEC_SIMD environment variable) before main() starts.
+ */
+bool init() {
+    const char* env = std::getenv("MULTIVEC_SIMD");
+    if (env != nullptr && simd::select(env)) {
+        return true;
+    }
+    return simd::select("avx512") || simd::select("avx2") || simd::select("neon") || simd::select("scalar");
+}
+
+} // namespace
+
+// constant initialization: the scalar kernels are valid even before dynamic initialization
+simd::Kernels simd::kernels = KERNELS(scalar, 0);
+
+static const bool initialized = init();
+
+bool simd::select(const std::string& name) {
+    const simd::Kernels* table = nullptr;
+    if (name == "scalar") {
+        table = scalar_kernels;
+    }
+#ifdef MULTIVEC_X86
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+        && __builtin_cpu_supports("f16c")) {
+        table = avx2_kernels;
+    }
+    if (name == "avx512" && __builtin_cpu_supports("avx512f")) {
+        table = avx512_kernels;
+    }
+#endif
+#ifdef MULTIVEC_NEON
+    if (name == "neon") {
+        table = neon_kernels;
+    }
+#endif
+    if (table == nullptr) {
+        return false;
+    }
+    selected_kernels = table;
+    kernels = table[0];
+    return true;
+}
+
+const simd::Kernels& simd::kernelsFor(size_t n) {
+    for (size_t i = 0; i < n_fixed_dimensions; ++i) {
+        if (fixed_dimensions[i] == n) {
+            return selected_kernels[i + 1];
+        }
+    }
+    return kernels;
+}
+
+uint16_t simd::floatToHalf(float x) {
+    uint32_t f;
+    std::memcpy(&f, &x, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t abs = f & 0x7fffffff;
+
+    if (abs >= 0x7f800000) { // inf or nan
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    if (abs >= 0x477ff000) { // rounds to a value above the largest half (65504)
+        return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) { // subnormal half (or zero): align the mantissa on 2^-24, rounding to nearest even
+        if (abs < 0x33000000) return sign;
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        int shift = 126 - (abs >> 23); // 14 to 24
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) ++half;
+        return sign | half;
+    }
+    // normal half: rebias the exponent, and round the mantissa to 10 bits (a carry increments the exponent)
+    uint32_t half = ((abs >> 13) - (112 << 10));
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;
+    return sign | half;
+}
+
+float simd::halfToFloat(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t f;
+
+    if (exponent == 0x1f) { // inf or nan
+        f = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        f = sign;
+    } else { // subnormal: normalize the mantissa
+        exponent = 113;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+
+    float x;
+    std::memcpy(&x, &f, sizeof(x));
+    return x;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <string>
+
+/**
+ * SIMD kernels for the vector operations in the inner loops of training and queries (dot product,
+ * fused y += a * x, norm). Several implementations are compiled (AVX-512, AVX2+FMA, NEON and
+ * portable scalar code), and the best one for the current CPU is selected at runtime.
+ *
+ * The environment variable MULTIVEC_SIMD (scalar, avx2, avx512 or neon) forces a given implementation.
+ *
+ * Vec expressions use these kernels automatically when their operands are stored contiguously (Vec, VecRef).
+ * The dotF16 and dotI8 kernels compute dot products with quantized vectors (see quantized.hpp), converting
+ * their values to float in registers.
+ *
+ * The training loops use the kernels returned by kernelsFor(dimension): for the most common dimensions
+ * (100, 200 and 300), the float kernels are also compiled for this fixed size, without loop counters or
+ * remainder loops. They give the same results as the generic kernels.
+ */
+namespace simd {
+    struct Kernels {
+        const char* name;
+        float (*dot)(const float* x, const float* y, size_t n);
+        void (*axpy)(float a, const float* x, float* y, size_t n);  // y += a * x
+        void (*scale)(float a, float* x, size_t n);  // x *= a
+        void (*update)(float a, const float* x, float* y, float* z, size_t n);  // z += a * y, then y += a * x
+        float (*dotF16)(const uint16_t* x, const float* y, size_t n);  // x in half precision
+        float (*dotI8)(const int8_t* x, const float* y, size_t n);
+    };
+
+    extern Kernels kernels; // selected implementation
+
+    bool select(const std::string& name); // returns false if this implementation isn't supported by the CPU
+
+    /**
+     * @brief Kernels of the selected implementation compiled for vectors of size n, or the generic kernels
+     * if n isn't one of the fixed dimensions (the `n` arguments of fixed-size kernels are ignored)
+     */
+    const Kernels& kernelsFor(size_t n);
+
+    inline float dot(const float* x, const float* y, size_t n) {
+        return kernels.dot(x, y, n);
+    }
+
+    inline void axpy(float a, const float* x, float* y, size_t n) {
+        kernels.axpy(a, x, y, n);
+    }
+
+    inline void scale(float a, float* x, size_t n) {
+        kernels.scale(a, x, n);
+    }
+
+    inline float norm(const float* x, size_t n) {
+        return std::sqrt(kernels.dot(x, x, n));
+    }
+
+    inline float dotF16(const uint16_t* x, const float* y, size_t n) {
+        return kernels.dotF16(x, y, n);
+    }
+
+    inline float dotI8(const int8_t* x, const float* y, size_t n) {
+        return kernels.dotI8(x, y, n);
+    }
+
+    // IEEE half precision conversions (round to nearest even), in portable code
+    uint16_t floatToHalf(float x);
+    float halfToFloat(uint16_t h);
+}
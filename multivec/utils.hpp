@@ -9,25 +9,55 @@
 #include <fstream>
 #include <sstream>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <assert.h>
 #include <iomanip> // setprecision, setw, left
 #include <chrono>
 #include <iterator>
+#include <limits>
 #include "vec.hpp"
+#include "sampler.hpp"
 
 using namespace std;
 using namespace std::chrono;
 
 const float MAX_EXP = 6;
-const int UNIGRAM_TABLE_SIZE = 1e8; // size of the frequency table
 
 typedef Vec vec;
-typedef vector<vec> mat;
+typedef Mat mat;
 
 inline float sigmoid(float x) {
     return 1 / (1 + exp(-x));
 }
 
+const int SIGMOID_TABLE_SIZE = 1024;
+
+/**
+ * @brief Sigmoid precomputed on [-MAX_EXP, MAX_EXP] (like the expTable of word2vec), for the training updates.
+ * Each entry holds the sigmoid at the middle of its interval (absolute error below 1.5e-3), and values
+ * outside of [-MAX_EXP, MAX_EXP] are clipped to 0 or 1.
+ */
+class SigmoidTable {
+    float table[SIGMOID_TABLE_SIZE];
+
+public:
+    SigmoidTable() {
+        for (int i = 0; i < SIGMOID_TABLE_SIZE; ++i) {
+            table[i] = sigmoid(((i + 0.5f) / SIGMOID_TABLE_SIZE * 2 - 1) * MAX_EXP);
+        }
+    }
+
+    float operator()(float x) const {
+        if (x >= MAX_EXP) return 1;
+        if (x <= -MAX_EXP) return 0;
+        int i = static_cast<int>((x + MAX_EXP) * (SIGMOID_TABLE_SIZE / (2 * MAX_EXP)));
+        return table[min(i, SIGMOID_TABLE_SIZE - 1)];
+    }
+};
+
 inline float cosineSimilarity(const vec &v1, const vec &v2) {
     return v1.dot(v2) / (v1.norm() * v2.norm());
 }
@@ -49,6 +79,87 @@ inline vector<string> split(const string& sequence) {
     return words;
 }
 
+/**
+ * @brief Call f(begin, end) for each whitespace-delimited token of [begin, end), without copying
+ * the tokens (same tokenization as `istringstream >> word`).
+ */
+template <typename Function>
+inline void forEachToken(const char* begin, const char* end, Function f) {
+    const char* p = begin;
+    while (p != end) {
+        while (p != end && isspace(static_cast<unsigned char>(*p))) ++p;
+        const char* token = p;
+        while (p != end && !isspace(static_cast<unsigned char>(*p))) ++p;
+        if (p != token) f(token, p);
+    }
+}
+
+/**
+ * @brief First whitespace-delimited token of [begin, end) (empty if there is none), and move `begin`
+ * to the end of this token
+ */
+inline string firstToken(const char*& begin, const char* end) {
+    while (begin != end && isspace(static_cast<unsigned char>(*begin))) ++begin;
+    const char* token = begin;
+    while (begin != end && !isspace(static_cast<unsigned char>(*begin))) ++begin;
+    return string(token, begin);
+}
+
+/**
+ * @brief Run f(0), ..., f(n - 1) in parallel, one thread each
+ */
+template <typename Function>
+inline void parallelFor(int n, Function f) {
+    vector<thread> threads;
+    for (int i = 1; i < n; ++i) {
+        threads.push_back(thread(f, i));
+    }
+    f(0);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+}
+
+/**
+ * @brief Queue for passing work between threads: pop() waits until an item is available, and returns
+ * false once the queue is closed and empty.
+ */
+template <typename T>
+class BlockingQueue {
+    deque<T> items;
+    mutex items_mutex;
+    condition_variable available;
+    bool closed;
+
+public:
+    BlockingQueue() : closed(false) {}
+
+    void push(T item) {
+        {
+            lock_guard<mutex> lock(items_mutex);
+            items.push_back(std::move(item));
+        }
+        available.notify_one();
+    }
+
+    bool pop(T& item) {
+        unique_lock<mutex> lock(items_mutex);
+        available.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    void close() { // no more items will be pushed
+        {
+            lock_guard<mutex> lock(items_mutex);
+            closed = true;
+        }
+        available.notify_all();
+    }
+};
+
 inline void check_is_open(ifstream& infile, const string& filename) {
     if (!infile.is_open()) {
         throw runtime_error("couldn't open file " + filename);
@@ -69,50 +180,61 @@ inline void check_is_non_empty(ifstream& infile, const string& filename) {
 
 namespace multivec {
     /**
-     * @brief Custom random generator. std::rand is thread-safe but very slow with multiple threads.
+     * @brief Custom random generator (same as word2vec). std::rand is thread-safe but very slow with
+     * multiple threads, so each training thread owns its own generator (see TrainingContext).
      * https://en.wikipedia.org/wiki/Linear_congruential_generator
-     *
-     * @return next random number
      */
-    inline unsigned long long rand() {
-        static unsigned long long next_random(time(NULL)); // in C++11 the thread_local keyword would solve the thread safety problem.
-        next_random = next_random * static_cast<unsigned long long>(25214903917) + 11; // unsafe, but we don't care
-        return next_random >> 16; // with this generator, the most significant bits are bits 47...16
-    }
+    class Random {
+        unsigned long long next_random;
+    public:
+        Random(unsigned long long seed = 1) : next_random(seed) {}
 
-    inline float randf() {
-        return  (multivec::rand() & 0xFFFF) / 65536.0f;
-    }
+        /**
+         * @brief Seed of the `stream`-th generator derived from a global seed (e.g. one stream per thread).
+         * Different streams start from well separated states (splitmix64 finalizer).
+         */
+        static unsigned long long seed(unsigned long long seed, int stream) {
+            unsigned long long z = seed + static_cast<unsigned long long>(stream + 1) * 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        /**
+         * @return next random number
+         */
+        unsigned long long operator()() {
+            next_random = next_random * static_cast<unsigned long long>(25214903917) + 11;
+            return next_random >> 16; // with this generator, the most significant bits are bits 47...16
+        }
+
+        float randf() {
+            return (operator()() & 0xFFFF) / 65536.0f;
+        }
+
+        unsigned long long state() const { return next_random; }
+        void setState(unsigned long long state) { next_random = state; }
+    };
 }
 
 /**
- * @brief Node of a Huffman binary tree, used for the hierarchical softmax algorithm.
+ * @brief Vocabulary entry (leaf of the Huffman binary tree used by hierarchical softmax).
+ * The Huffman codes themselves are stored in HuffmanCodes.
  */
 struct HuffmanNode {
     static const HuffmanNode UNK; // node for out-of-vocabulary words
 
     string word;
 
-    vector<int> code; // Huffman code of this node: path from root to leaf (0 for left, 1 for right)
-    vector<int> parents; // indices of the parent nodes
-
-    HuffmanNode* left; // used for constructing the tree, useless afterwards
-    HuffmanNode* right;
-
     int index;
     int count;
 
-    bool is_leaf;
     bool is_unk;
 
     HuffmanNode() : index(-1), is_unk(true) {}
 
     HuffmanNode(int index, const string& word) :
-            word(word), index(index), count(1), is_leaf(true), is_unk(false)
-    {}
-
-    HuffmanNode(int index, HuffmanNode* left, HuffmanNode* right) :
-            left(left), right(right), index(index), count(left->count + right->count), is_leaf(false), is_unk(false)
+            word(word), index(index), count(1), is_unk(false)
     {}
 
     bool operator==(const HuffmanNode& node) const {
@@ -122,9 +244,50 @@ struct HuffmanNode {
     bool operator!=(const HuffmanNode& node) const {
         return !(operator==(node));
     }
+};
+
+/**
+ * @brief Huffman codes of all the words in the vocabulary, stored contiguously (CSR layout).
+ * The code of word i (path from the root to the leaf) occupies positions [offsets[i], offsets[i + 1]).
+ * At each position j, parents[j] is the index of the inner node (row in the hierarchical softmax weights),
+ * and bit(j) the direction taken from this node (0 for left, 1 for right).
+ */
+struct HuffmanCodes {
+    vector<int> offsets;
+    vector<int> parents;
+    vector<unsigned long long> bits;
+
+    bool bit(int j) const {
+        return (bits[j >> 6] >> (j & 63)) & 1;
+    }
+
+    void setBit(int j, bool value) {
+        if (value) bits[j >> 6] |= 1ULL << (j & 63);
+        else bits[j >> 6] &= ~(1ULL << (j & 63));
+    }
+
+    int length(int word) const {
+        return offsets[word + 1] - offsets[word];
+    }
 
-    static bool comp(const HuffmanNode* v1, const HuffmanNode* v2) {
-        return (v1->count) > (v2->count);
+    int words() const {
+        return offsets.empty() ? 0 : static_cast<int>(offsets.size()) - 1;
+    }
+
+    // allocate space for the codes of `words` words of given lengths (indexed by word)
+    void reset(const vector<int>& lengths) {
+        offsets.assign(lengths.size() + 1, 0);
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            offsets[i + 1] = offsets[i] + lengths[i];
+        }
+        parents.assign(offsets.back(), 0);
+        bits.assign((offsets.back() + 63) / 64, 0);
+    }
+
+    void clear() {
+        offsets.clear();
+        parents.clear();
+        bits.clear();
     }
 };
 
@@ -141,6 +304,24 @@ struct Config {
     bool skip_gram; // set to true to use skip-gram model instead of CBOW
     int negative; // number of negative samples used for the negative sampling training algorithm
     bool sent_vector; // includes sentence vectors in the training
+    long long unigram_table_size; // size of the negative sampling table (0 for alias sampling)
+    int seed; // random seed for initialization and training
+    long long max_vocab_size; // prune rare words while counting when the vocabulary gets larger than this (0 for no limit)
+    bool shared_negatives; // skip-gram: one set of negative samples per window, trained with matrix products
+    bool sigmoid_table; // training: read the sigmoid from a precomputed table instead of computing exp
+    string checkpoint; // file where the weights and training state are saved during training (empty: none)
+    long long checkpoint_words; // words trained between two checkpoints (0: one checkpoint per epoch)
+    bool grow_vocab; // continued training: add the new words of the training file to the vocabulary
+    string sent_vector_file; // sentence vectors are trained in this memory-mapped file instead of in memory (empty: in memory)
+    bool doc_ids; // the first token of each line is a document ID: lines with the same ID share a sentence vector
+    bool pin_threads; // pin the training threads to CPUs spread over the NUMA nodes, each node with its own copy of the read-only structures
+    bool numa_interleave; // interleave the pages of the weight matrices over the NUMA nodes
+    string cluster; // distributed training: host:port of process 0 (empty: a single process, see Cluster)
+    int cluster_rank; // distributed training: number of this process, which trains this shard of the corpus
+    int cluster_size; // distributed training: number of processes
+    long long sync_words; // distributed training: words trained by each process between two weight averagings (0: one per epoch)
+    string metrics_file; // training metrics are appended to this file as JSON lines (empty: none, see TrainingMetrics)
+    float metrics_interval; // seconds between two lines of metrics_file
 
     Config() :
         learning_rate(0.05),
@@ -154,7 +335,25 @@ struct Config {
         hierarchical_softmax(false),
         skip_gram(false),
         negative(5),
-        sent_vector(false)
+        sent_vector(false),
+        unigram_table_size(0), // not serialized
+        seed(1), // not serialized
+        max_vocab_size(0), // not serialized
+        shared_negatives(false), // not serialized
+        sigmoid_table(false), // not serialized
+        checkpoint(""), // not serialized
+        checkpoint_words(0), // not serialized
+        grow_vocab(false), // not serialized
+        sent_vector_file(""), // not serialized
+        doc_ids(false), // not serialized
+        pin_threads(false), // not serialized
+        numa_interleave(false), // not serialized
+        cluster(""), // not serialized
+        cluster_rank(0), // not serialized
+        cluster_size(1), // not serialized
+        sync_words(0), // not serialized
+        metrics_file(""), // not serialized
+        metrics_interval(10) // not serialized
         {}
 
     virtual void print() const {
@@ -170,15 +369,50 @@ struct Config {
         std::cout << "HS:          " << hierarchical_softmax << std::endl;
         std::cout << "negative:    " << negative << std::endl;
         std::cout << "sent vector: " << sent_vector << std::endl;
+        std::cout << "seed:        " << seed << std::endl;
+        if (unigram_table_size > 0)
+            std::cout << "neg. table:  " << unigram_table_size << std::endl;
+        if (max_vocab_size > 0)
+            std::cout << "max vocab:   " << max_vocab_size << std::endl;
+        if (skip_gram && shared_negatives)
+            std::cout << "shared neg.: " << shared_negatives << std::endl;
+        if (sigmoid_table)
+            std::cout << "sig. table:  " << sigmoid_table << std::endl;
+        if (!checkpoint.empty())
+            std::cout << "checkpoint:  " << checkpoint << std::endl;
+        if (grow_vocab)
+            std::cout << "grow vocab:  " << grow_vocab << std::endl;
+        if (!sent_vector_file.empty())
+            std::cout << "sent. file:  " << sent_vector_file << std::endl;
+        if (doc_ids)
+            std::cout << "doc IDs:     " << doc_ids << std::endl;
+        if (pin_threads)
+            std::cout << "pin threads: " << pin_threads << std::endl;
+        if (numa_interleave)
+            std::cout << "interleave:  " << numa_interleave << std::endl;
+        if (!cluster.empty())
+            std::cout << "cluster:     " << cluster << " (process " << cluster_rank << " of " << cluster_size << ")" << std::endl;
+        if (!metrics_file.empty())
+            std::cout << "metrics:     " << metrics_file << " (every " << metrics_interval << " s)" << std::endl;
     }
 };
 
 struct BilingualConfig : Config {
     float beta;
-    BilingualConfig() : beta(1.0f) {}
+    int reader_threads; // threads which tokenize and align the sentence pairs ahead of the training threads (0: none)
+    string line_index; // file where the line index of the parallel corpus is saved and reused (empty: not saved)
+
+    BilingualConfig() :
+        beta(1.0f),
+        reader_threads(0), // not serialized
+        line_index("") // not serialized
+        {}
+
     void print() const {
         Config::print();
         std::cout << "beta:        " << beta << std::endl;
+        if (reader_threads > 0)
+            std::cout << "readers:     " << reader_threads << std::endl;
     }
 };
 
@@ -4,6 +4,14 @@
 #include <sstream>
 #include <algorithm>
 #include <iterator>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <memory>
+#include <type_traits>
+#include <assert.h>
+#include "simd.hpp"
 
 /**
  * Small linear algebra library that supports basic operations between vectors: difference, addition or dot product of 
@@ -13,6 +21,8 @@
  * 
  * Vector operations like: (u + alpha * v) use a single for loop, while
  * naive operator overloading would use two loops.
+ *
+ * Matrices (Mat) are stored contiguously, and their rows (VecRef) can be used in the same expressions as vectors.
  * 
  * Examples:
  * Vec v1({2,0,2});
@@ -22,7 +32,7 @@
  * float u = v1.dot(v2);
  * std::cout << v << std::endl;    #[1, 0, 0.5]
  * 
- * TODO: integrate with BLAS
+ * Operations between contiguous vectors (dot products, u += alpha * v, norms) use the SIMD kernels of simd.hpp.
  */
 
 template <typename E>
@@ -40,7 +50,106 @@ public:
     operator E const&() const { return static_cast<const E&>(*this); }
 };
 
-class Vec : public VecExpression<Vec> {
+class Vec;
+template <typename T> class VecView;
+template <typename E> class VecScaled;
+
+// vector types that expose their data as a contiguous array, and can use the SIMD kernels
+template <typename E> struct is_dense : std::false_type {};
+template <> struct is_dense<Vec> : std::true_type {};
+template <typename T> struct is_dense<VecView<T>> : std::true_type {};
+
+/**
+ * Operations shared by the vector types whose elements are stored contiguously in memory (Vec and VecView).
+ * The derived class needs to provide data() and size().
+ *
+ * When the right operand is itself contiguous (possibly scaled, like `alpha * v`), these operations
+ * use the SIMD kernels of simd.hpp instead of the element-wise loops.
+ */
+template <typename E>
+class DenseVecExpression : public VecExpression<E> {
+    E& derived() { return static_cast<E&>(*this); }
+    E const& derived() const { return static_cast<E const&>(*this); }
+
+    template <typename F>
+    float dot(F const& v, std::false_type) const {
+        const float* data = derived().data();
+        float x = 0;
+        for (size_type i = 0; i != v.size(); ++i) {
+            x += data[i] * v[i];
+        }
+        return x;
+    }
+
+    template <typename F>
+    float dot(F const& v, std::true_type) const {
+        return simd::dot(derived().data(), v.data(), v.size());
+    }
+
+    // this += a * v
+    template <typename F>
+    void add(F const& v, float a, std::false_type) {
+        float* data = derived().data();
+        for (size_type i = 0; i != v.size(); ++i) {
+            data[i] += a * v[i];
+        }
+    }
+
+    template <typename F>
+    void add(F const& v, float a, std::true_type) {
+        simd::axpy(a, v.data(), derived().data(), v.size());
+    }
+
+    template <typename F>
+    void add(F const& v, float a) {
+        add(v, a, is_dense<F>());
+    }
+
+    template <typename F>
+    void add(VecScaled<F> const& v, float a) {
+        if (is_dense<F>::value) {
+            add(v.operand(), a * v.scale(), is_dense<F>());
+        } else {
+            add(v, a, std::false_type());
+        }
+    }
+
+public:
+    typedef std::vector<float>::size_type size_type;
+
+    template <typename F>
+    float dot(VecExpression<F> const& vec) const {
+        return dot(static_cast<F const&>(vec), is_dense<F>());
+    }
+
+    template <typename F>
+    void operator+=(VecExpression<F> const& vec) {
+        add(static_cast<F const&>(vec), 1.0f);
+    }
+
+    template <typename F>
+    void operator-=(VecExpression<F> const& vec) {
+        add(static_cast<F const&>(vec), -1.0f);
+    }
+
+    void operator*=(float alpha) {
+        simd::scale(alpha, derived().data(), derived().size());
+    }
+
+    void fill(float value) {
+        std::fill(derived().data(), derived().data() + derived().size(), value);
+    }
+
+    void operator/=(float alpha) {
+        simd::scale(1 / alpha, derived().data(), derived().size());
+    }
+
+    float norm() const {
+        return simd::norm(derived().data(), derived().size());
+    }
+};
+
+class Vec : public DenseVecExpression<Vec> {
     container_type _data;
 public:
     reference operator[](size_type i) { return _data[i]; }
@@ -79,48 +188,177 @@ public:
         }
     }
 
-    template <typename E>
-    float dot(VecExpression<E> const& vec) const {
-        E const& v = vec;
-        float x = 0;
-        for (size_type i = 0; i != v.size(); ++i) {
-            x += _data[i] * v[i];
-        }
-        return x;
-    }
-
+    // unlike views, vectors grow to the size of the right operand (missing values are zeros)
     template <typename E>
     void operator+=(VecExpression<E> const& vec) {
-        *this = *this + vec;
+        if (vec.size() > size()) _data.resize(vec.size());
+        DenseVecExpression<Vec>::operator+=(vec);
     }
 
     template <typename E>
     void operator-=(VecExpression<E> const& vec) {
-        *this = *this - vec;
+        if (vec.size() > size()) _data.resize(vec.size());
+        DenseVecExpression<Vec>::operator-=(vec);
     }
 
-    void operator*=(float alpha) {
-        for (size_type i = 0; i != size(); ++i) {
-            _data[i] *= alpha;
+    const value_type* data() const { return _data.data(); }
+    value_type* data() { return _data.data(); }
+};
+
+/**
+ * Non-owning view on `size` contiguous floats, typically a row of a Mat. A view can be used in
+ * vector expressions like any Vec, and assigning to a view writes through to the viewed memory
+ * (the size of a view never changes).
+ *
+ * VecRef gives read-write access, ConstVecRef read-only access.
+ */
+template <typename T>
+class VecView : public DenseVecExpression<VecView<T>> {
+    T* _data;
+    std::size_t _size;
+public:
+    typedef std::size_t size_type;
+    typedef float value_type;
+
+    T& operator[](size_type i) const { return _data[i]; }
+    size_type size() const { return _size; }
+
+    VecView(T* data, size_type size) : _data(data), _size(size) {}
+    VecView(Vec& v) : _data(v.data()), _size(v.size()) {}
+    VecView(const Vec& v) : _data(v.data()), _size(v.size()) {}  // only compiles for ConstVecRef
+    template <typename U>
+    VecView(const VecView<U>& v) : _data(v.data()), _size(v.size()) {}  // VecRef -> ConstVecRef
+
+    VecView& operator=(const VecView& view) { return operator=<VecView>(view); }
+
+    template <typename E>
+    VecView& operator=(VecExpression<E> const& vec) {
+        E const& v = vec;
+        assert(v.size() == _size);
+        for (size_type i = 0; i != _size; ++i) {
+            _data[i] = v[i];
         }
+        return *this;
     }
 
-    void operator/=(float alpha) {
-        for (size_type i = 0; i != size(); ++i) {
-            _data[i] /= alpha;
+    T* data() const { return _data; }
+};
+
+typedef VecView<float> VecRef;
+typedef VecView<const float> ConstVecRef;
+
+/**
+ * Dense row-major matrix, stored in a single 64-byte aligned block of memory. Each row is padded to
+ * a multiple of 16 floats, so that every row starts on a cache line boundary.
+ *
+ * Indexing a matrix returns a view on the corresponding row:
+ * Mat m(10, 3);
+ * m[0] += Vec({1,2,3});
+ * float u = m[0].dot(m[1]);
+ */
+class Mat {
+public:
+    typedef std::size_t size_type;
+    static const size_type alignment = 64; // in bytes
+
+private:
+    float* _data;
+    size_type _rows;
+    size_type _cols;
+    size_type _stride; // distance in floats between the beginning of two consecutive rows
+    size_type _capacity; // number of rows allocated
+    std::shared_ptr<void> _storage; // owner of the data when it isn't allocated by this matrix (e.g. memory-mapped file)
+
+    static float* allocate(size_type n) {
+        if (n == 0) return nullptr;
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, alignment, n * sizeof(float)) != 0) {
+            throw std::bad_alloc();
         }
+        return static_cast<float*>(ptr);
     }
-    
-    float norm() const {
-        float res = 0;
-        for (size_type i = 0; i != size(); ++i) {
-            res += pow(_data[i], 2);
+
+public:
+    // stride of the rows of `cols` floats (so that each row is aligned)
+    static size_type paddedSize(size_type cols) {
+        const size_type k = alignment / sizeof(float);
+        return (cols + k - 1) / k * k;
+    }
+
+    Mat() : _data(nullptr), _rows(0), _cols(0), _stride(0), _capacity(0) {}
+
+    Mat(size_type rows, size_type cols) : _rows(rows), _cols(cols), _stride(paddedSize(cols)), _capacity(rows) {
+        _data = allocate(_rows * _stride);
+        if (_data) std::memset(_data, 0, _rows * _stride * sizeof(float));
+    }
+
+    /**
+     * @brief Matrix stored in external memory (`data` must be aligned, and have `rows * stride` floats),
+     * which is kept alive by `storage`. Copies of this matrix allocate their own memory.
+     */
+    Mat(float* data, size_type rows, size_type cols, size_type stride, std::shared_ptr<void> storage) :
+        _data(data), _rows(rows), _cols(cols), _stride(stride), _capacity(rows), _storage(storage) {}
+
+    Mat(const Mat& m) : _rows(m._rows), _cols(m._cols), _stride(m._stride), _capacity(m._rows) {
+        _data = allocate(_rows * _stride);
+        if (_data) std::memcpy(_data, m._data, _rows * _stride * sizeof(float));
+    }
+
+    Mat(Mat&& m) : _data(m._data), _rows(m._rows), _cols(m._cols), _stride(m._stride), _capacity(m._capacity),
+        _storage(std::move(m._storage)) {
+        m._data = nullptr;
+        m._rows = m._cols = m._stride = m._capacity = 0;
+    }
+
+    ~Mat() {
+        if (!_storage) std::free(_data);
+    }
+
+    Mat& operator=(Mat m) {  // copy-and-swap
+        swap(m);
+        return *this;
+    }
+
+    void swap(Mat& m) {
+        std::swap(_data, m._data);
+        std::swap(_rows, m._rows);
+        std::swap(_cols, m._cols);
+        std::swap(_stride, m._stride);
+        std::swap(_capacity, m._capacity);
+        std::swap(_storage, m._storage);
+    }
+
+    /**
+     * @brief Change the number of rows (new rows are zeros). When there is no room for the new rows, all the
+     * rows are moved at once to a new block with 25% more rows than needed, so that a matrix which grows
+     * little by little (e.g. embeddings of a growing vocabulary) is rarely reallocated. The rows of external
+     * memory are copied the first time the matrix grows.
+     */
+    void resize(size_type rows) {
+        if (rows > _capacity || (_storage && rows > _rows)) {
+            size_type capacity = rows + rows / 4;
+            float* data = allocate(capacity * _stride);
+            if (_rows > 0) std::memcpy(data, _data, _rows * _stride * sizeof(float));
+            if (!_storage) std::free(_data);
+            _storage.reset();
+            _data = data;
+            _capacity = capacity;
         }
-        return sqrt(res);
+        if (rows > _rows && _stride > 0) std::memset(_data + _rows * _stride, 0, (rows - _rows) * _stride * sizeof(float));
+        _rows = rows;
     }
-    
-    const value_type* data() const { return _data.data(); }
-    value_type* data() { return _data.data(); }
+
+    VecRef operator[](size_type i) { return VecRef(_data + i * _stride, _cols); }
+    ConstVecRef operator[](size_type i) const { return ConstVecRef(_data + i * _stride, _cols); }
+
+    size_type rows() const { return _rows; }
+    size_type cols() const { return _cols; }
+    size_type stride() const { return _stride; }
+    size_type size() const { return _rows; }
+    bool empty() const { return _rows == 0; }
+
+    float* data() { return _data; }
+    const float* data() const { return _data; }
 };
 
 template <typename E1, typename E2>
@@ -166,6 +404,8 @@ public:
     VecScaled(float alpha, VecExpression<E> const& v) : alpha(alpha), v(v) {}
     Vec::size_type size() const { return v.size(); }
     Vec::value_type operator[](Vec::size_type i) const { return alpha * v[i]; }
+    float scale() const { return alpha; }
+    E const& operand() const { return v; }
 };
 
 template <typename E1, typename E2>
@@ -0,0 +1,307 @@
+#include "vectors.hpp"
+#include "mapping.hpp"
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+const double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) { // spaces of the current line
+    while (p != end && isSpace(*p) && *p != '\n') ++p;
+    return p;
+}
+
+const char* lineEnd(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol == nullptr ? end : eol;
+}
+
+bool isBlankLine(const char* p, const char* eol) {
+    return skipBlanks(p, eol) == eol;
+}
+
+struct Range {
+    const char* begin;
+    const char* end;
+    long long first_row;
+    long long rows;
+};
+
+void countRows(Range& range) {
+    range.rows = 0;
+    for (const char* p = range.begin; p < range.end; ) {
+        const char* eol = lineEnd(p, range.end);
+        if (!isBlankLine(p, eol)) ++range.rows;
+        p = eol + 1;
+    }
+}
+
+/**
+ * Parse the lines of `range` ("word x1 x2 ... xn") into the rows of `vectors` (until `rows` rows are
+ * filled). Returns an empty string, or an error message (exceptions can't leave the thread).
+ */
+string parseRows(const Range& range, long long rows, vector<string>& words, Mat& vectors) {
+    size_t dim = vectors.cols();
+    long long row = range.first_row;
+
+    for (const char* p = range.begin; p < range.end && row < rows; ) {
+        const char* eol = lineEnd(p, range.end);
+        p = skipBlanks(p, eol);
+        if (p == eol) {
+            p = eol + 1;
+            continue;
+        }
+
+        const char* word = p;
+        while (p != eol && !isSpace(*p)) ++p;
+        words[row].assign(word, p);
+
+        float* v = vectors[row].data();
+        for (size_t j = 0; j < dim; ++j) {
+            p = skipBlanks(p, eol);
+            if (!parseFloat(p, eol, v[j]) || (p != eol && !isSpace(*p))) {
+                return "invalid vector for word " + words[row];
+            }
+        }
+        if (skipBlanks(p, eol) != eol) {
+            return "too many values for word " + words[row];
+        }
+
+        ++row;
+        p = eol + 1;
+    }
+    return "";
+}
+
+long long countValues(const char* p, const char* eol) {
+    long long n = 0;
+    for (float x; (p = skipBlanks(p, eol)) != eol; ++n) {
+        if (!parseFloat(p, eol, x) || (p != eol && !isSpace(*p))) return -1;
+    }
+    return n;
+}
+
+/**
+ * The first record of the text format is a line "word x1 ... xn" with `dim` values, which the raw floats
+ * of the binary format don't parse as. Otherwise, the bytes after the first word must be printable text
+ * (the values of a text line are ASCII, even when the words are not), or it is a malformed text file.
+ */
+bool isBinary(const char* p, const char* end, long long dim) {
+    while (p != end && isSpace(*p)) ++p;
+    if (p == end) return false;
+    const char* eol = lineEnd(p, end);
+    while (p != eol && !isSpace(*p)) ++p;
+    if (countValues(p, eol) == dim) return false;
+
+    if (p != end) ++p;
+    for (long long i = 0; i < 4 * dim && p != end; ++i, ++p) {
+        unsigned char c = *p;
+        if ((c < 0x20 || c > 0x7e) && !isSpace(c)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool parseFloat(const char*& p, const char* end, float& x) {
+    const char* s = p;
+    bool negative = s != end && *s == '-';
+    if (s != end && (*s == '-' || *s == '+')) ++s;
+
+    unsigned long long mantissa = 0;
+    int digits = 0; // significant digits in the mantissa
+    int exponent = 0;
+    bool any_digit = false;
+
+    for (; s != end && isDigit(*s); ++s) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa != 0) ++digits;
+        } else {
+            ++exponent; // digits beyond the precision of a float
+        }
+    }
+    if (s != end && *s == '.') {
+        for (++s; s != end && isDigit(*s); ++s) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                if (mantissa != 0) ++digits;
+                --exponent;
+            }
+        }
+    }
+
+    if (!any_digit) { // e.g. "inf" or "nan"
+        char buffer[32];
+        size_t n = 0;
+        while (p + n != end && !isSpace(p[n]) && n < sizeof(buffer) - 1) {
+            buffer[n] = p[n];
+            ++n;
+        }
+        buffer[n] = '\0';
+        char* parse_end = nullptr;
+        x = strtof(buffer, &parse_end);
+        if (parse_end == buffer) return false;
+        p += parse_end - buffer;
+        return true;
+    }
+
+    if (s != end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negative_exponent = e != end && *e == '-';
+        if (e != end && (*e == '-' || *e == '+')) ++e;
+        if (e != end && isDigit(*e)) {
+            int value = 0;
+            for (; e != end && isDigit(*e); ++e) {
+                if (value < 10000) value = value * 10 + (*e - '0');
+            }
+            exponent += negative_exponent ? -value : value;
+            s = e;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (mantissa == 0) {
+        value = 0;
+    } else if (exponent >= 0 && exponent <= 22) {
+        value *= powers_of_ten[exponent];
+    } else if (exponent < 0 && exponent >= -22) {
+        value /= powers_of_ten[-exponent];
+    } else {
+        value *= pow(10.0, exponent);
+    }
+
+    x = static_cast<float>(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+WordVectors loadVectors(const string& filename, long long max_words, int threads) {
+    MappedFile file(filename);
+    file.adviseSequential();
+    const char* data = file.data();
+    const char* end = data + file.size();
+    if (data == nullptr) {
+        throw runtime_error("vector file " + filename + " is empty");
+    }
+
+    // "words dimension" header (optional in the text format)
+    const char* eol = lineEnd(data, end);
+    long long header_words = -1, dim = -1;
+    {
+        string header(data, eol);
+        istringstream iss(header);
+        long long words = 0, size = 0;
+        string extra;
+        if (header.find_first_not_of(" \t\r0123456789") == string::npos && iss >> words >> size && !(iss >> extra) && size > 0) {
+            header_words = words;
+            dim = size;
+        }
+    }
+
+    const char* body = data;
+    if (header_words >= 0) {
+        body = eol == end ? end : eol + 1;
+    } else {
+        // the first line is "word x1 ... xn": skip the word
+        const char* p = skipBlanks(data, eol);
+        while (p != eol && !isSpace(*p)) ++p;
+        dim = countValues(p, eol);
+        if (dim <= 0) {
+            throw runtime_error("invalid vector file " + filename);
+        }
+    }
+
+    long long rows = header_words >= 0 ? header_words : -1;
+    if (max_words > 0 && (rows < 0 || max_words < rows)) rows = max_words;
+
+    WordVectors res;
+
+    if (header_words >= 0 && isBinary(body, end, dim)) {
+        res.words.resize(rows);
+        res.vectors = Mat(rows, dim);
+        const char* p = body;
+        for (long long i = 0; i < rows; ++i) {
+            while (p != end && isSpace(*p)) ++p; // newline after the previous vector
+            const char* word = p;
+            while (p != end && *p != ' ') ++p;
+            if (p == end || end - (p + 1) < static_cast<long long>(sizeof(float) * dim)) {
+                throw runtime_error("truncated vector file " + filename);
+            }
+            res.words[i].assign(word, p);
+            memcpy(res.vectors[i].data(), p + 1, sizeof(float) * dim);
+            p += 1 + sizeof(float) * dim;
+        }
+        return res;
+    }
+
+    // text format: byte ranges snapped to the beginning of a line
+    threads = max(1, threads);
+    vector<Range> ranges(threads);
+    size_t size = end - body;
+    for (int t = 0; t < threads; ++t) {
+        const char* p = body + size / threads * t;
+        if (t > 0 && p != body && p[-1] != '\n') {
+            p = lineEnd(p, end);
+            if (p != end) ++p;
+        }
+        ranges[t].begin = p;
+    }
+    for (int t = 0; t < threads; ++t) {
+        ranges[t].end = t < threads - 1 ? ranges[t + 1].begin : end;
+    }
+
+    vector<thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.push_back(thread(countRows, std::ref(ranges[t])));
+    }
+    countRows(ranges[0]);
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+
+    long long total = 0;
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        it->first_row = total;
+        total += it->rows;
+    }
+    if (rows < 0 || total < rows) rows = total;
+
+    res.words.resize(rows);
+    res.vectors = Mat(rows, dim);
+    vector<string> errors(threads);
+
+    workers.clear();
+    for (int t = 1; t < threads; ++t) {
+        workers.push_back(thread([&, t]() { errors[t] = parseRows(ranges[t], rows, res.words, res.vectors); }));
+    }
+    errors[0] = parseRows(ranges[0], rows, res.words, res.vectors);
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+
+    for (auto it = errors.begin(); it != errors.end(); ++it) {
+        if (!it->empty()) {
+            throw runtime_error("invalid vector file " + filename + ": " + *it);
+        }
+    }
+    return res;
+}
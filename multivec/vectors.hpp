@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "vec.hpp"
+
+/**
+ * @brief Word embeddings read from a file in the word2vec format: words in file order (usually by
+ * decreasing frequency), and their vectors, one row per word.
+ */
+struct WordVectors {
+    std::vector<std::string> words;
+    Mat vectors;
+};
+
+/**
+ * @brief Read a file in the word2vec text format (e.g. written by saveVectors, or GloVe-style files with
+ * a "words dimension" header) or binary format (written by saveVectorsBin). The format is detected
+ * automatically.
+ *
+ * The file is memory-mapped. In the text format, the lines are divided into byte ranges which
+ * are parsed in parallel (the lines of each range are counted first, so that each thread knows where its
+ * rows start in the matrix), with a parser much faster than std::stof. In the binary format, the vectors
+ * are copied directly.
+ *
+ * @param max_words only read the first `max_words` words (0: all the words)
+ */
+WordVectors loadVectors(const std::string& filename, long long max_words = 0, int threads = 1);
+
+/**
+ * @brief Parse a decimal floating point number (e.g. "-1.25e-3") starting at `p`, and move `p` after it.
+ * Digits beyond the 19th significant digit are ignored, and special values (e.g. "inf") are parsed by strtof.
+ * @return false if there is no number at `p`
+ */
+bool parseFloat(const char*& p, const char* end, float& x);
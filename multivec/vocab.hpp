@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <cstring>
+
+/**
+ * @brief 64-bit FNV-1a hash of a word
+ */
+inline unsigned long long hashWord(const char* word, size_t length) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ static_cast<unsigned char>(word[i])) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Word counts in an open-addressing hash table (linear probing). The words are not copied:
+ * keys point to the text they were read from (e.g. a memory-mapped corpus), which must outlive the table.
+ */
+class WordCounts {
+public:
+    struct Entry {
+        const char* word; // nullptr for empty slots
+        unsigned long long hash;
+        long long count;
+        int length;
+    };
+
+private:
+    std::vector<Entry> entries; // capacity is a power of 2
+    size_t used;
+
+    Entry& find(const char* word, int length, unsigned long long hash) {
+        size_t mask = entries.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            Entry& e = entries[i];
+            if (e.word == nullptr || (e.hash == hash && e.length == length && memcmp(e.word, word, length) == 0))
+                return e;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Entry> old(capacity, Entry());
+        old.swap(entries);
+        used = 0;
+        for (auto it = old.begin(); it != old.end(); ++it) {
+            if (it->word != nullptr) add(it->word, it->length, it->hash, it->count);
+        }
+    }
+
+public:
+    WordCounts() : entries(1024, Entry()), used(0) {}
+
+    void add(const char* word, int length, unsigned long long hash, long long count = 1) {
+        if (2 * (used + 1) > entries.size()) { // max load factor of 0.5
+            rehash(entries.empty() ? 1024 : 2 * entries.size());
+        }
+        Entry& e = find(word, length, hash);
+        if (e.word == nullptr) {
+            e.word = word;
+            e.length = length;
+            e.hash = hash;
+            e.count = 0;
+            ++used;
+        }
+        e.count += count;
+    }
+
+    void add(const char* word, int length) {
+        add(word, length, hashWord(word, length));
+    }
+
+    /**
+     * @brief Remove the words whose count is lower than or equal to `min_count`
+     */
+    void prune(long long min_count) {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->word != nullptr && it->count <= min_count) it->word = nullptr;
+        }
+        rehash(entries.size()); // removed slots would break the probing sequences
+    }
+
+    size_t size() const { return used; }
+
+    template <typename Function>
+    void forEach(Function f) const {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->word != nullptr) f(*it);
+        }
+    }
+
+    void clear() {
+        std::vector<Entry>().swap(entries);
+        used = 0;
+    }
+};
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <iomanip>
 #include <math.h>
+#include "../multivec/vectors.hpp"
 
 using namespace std;
 typedef vector<float> vec;
@@ -117,7 +118,7 @@ void computeAccuracy(istream& infile, map<string, vec>& embeddings, bool verbose
     vector<thread> threads;
     int i = 0;
     for (auto it = topics.begin(); it != topics.end(); ++it, ++i) {
-        threads.push_back(thread(evaluateTopic, it->first, it->second, embeddings, &results[i]));
+        threads.push_back(thread(evaluateTopic, it->first, it->second, std::cref(embeddings), &results[i]));
     }
 
     for (auto it = threads.begin(); it != threads.end(); ++it) {
@@ -156,39 +157,22 @@ void computeAccuracy(istream& infile, map<string, vec>& embeddings, bool verbose
          << setprecision(3) << 100.0 * total / questions << "%\n";
 }
 
+/**
+ * Read the vectors (word2vec text or binary format) with the parallel loader of the library,
+ * and evaluate them on the questions of `infile`
+ */
 void computeAccuracy(const string& model_filename, istream& infile, long long max_vocabulary_size) {
-    map<string, vec> embeddings;
-    ifstream model_file(model_filename);
-
-    if (!model_file.is_open()) {
-        throw runtime_error("couldn't open file " + model_filename);
-    }
+    int threads = max(1u, thread::hardware_concurrency());
+    WordVectors vectors = loadVectors(model_filename, max_vocabulary_size, threads);
+    size_t size = vectors.vectors.cols();
 
-    string line;
-    long long words, size;
-    model_file >> words >> size;    
-    getline(model_file, line);
-
-    cout << "Vocabulary size: " << words << endl;
+    cout << "Vocabulary size: " << vectors.words.size() << endl;
     cout << "Embeddings size: " << size << endl;
 
-    if (max_vocabulary_size > 0) {
-        words = min(max_vocabulary_size, words);
-    }
-
-    for (size_t i = 0; i < words; ++i) {
-        vec v(size);
-        int j = 0;
-
-        getline(model_file, line);
-        vector<string> tokens = split(line);
-        string word = tokens.front();
-
-        for (size_t j = 0; j < size; ++j) {
-            v[j] = std::stof(tokens[j + 1]);
-        }
-        
-        embeddings.insert({word, v});
+    map<string, vec> embeddings;
+    for (size_t i = 0; i < vectors.words.size(); ++i) {
+        const float* v = vectors.vectors[i].data();
+        embeddings.insert({vectors.words[i], vec(v, v + size)});
     }
 
     computeAccuracy(infile, embeddings, true);